@@ -0,0 +1,170 @@
+#include "DRRAtlas.h"
+#include "DRRTrace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <vtkImageData.h>
+
+bool DRRAtlas::Parameters::operator==(const Parameters& other) const
+{
+  return minAngle == other.minAngle && maxAngle == other.maxAngle && step == other.step &&
+         std::equal(pose.rotation, pose.rotation + 3, other.pose.rotation) &&
+         std::equal(pose.translation, pose.translation + 3, other.pose.translation) && scd == other.scd &&
+         threshold == other.threshold && std::equal(size, size + 2, other.size) &&
+         std::equal(spacing, spacing + 2, other.spacing) && window == other.window;
+}
+
+DRRAtlas::DRRAtlas() : m_Step(M_PI / 90), m_ReadyCount(0)
+{
+}
+
+DRRAtlas::~DRRAtlas()
+{
+  this->Stop();
+}
+
+bool DRRAtlas::IsCyclic() const
+{
+  return m_Parameters.maxAngle - m_Parameters.minAngle >= 2 * M_PI - 1e-9;
+}
+
+double DRRAtlas::ViewAngle(int view) const
+{
+  return m_Parameters.minAngle + view * m_Step;
+}
+
+void DRRAtlas::Start(std::shared_ptr<const DRRVolume> volume, const Parameters& parameters, double startAngle)
+{
+  this->Stop();
+  m_Volume = volume;
+  m_Parameters = parameters;
+
+  // 首尾相接时最后一个视图与第一个重合, 不重复渲染; 2π不是step的整数倍时把间隔调整为2π / 视图数
+  const double range = parameters.maxAngle - parameters.minAngle;
+  int viewCount = std::max(1, static_cast<int>(std::floor(range / parameters.step + 1e-9)) + 1);
+  m_Step = parameters.step;
+  if (this->IsCyclic())
+  {
+    viewCount = std::max(1, static_cast<int>(std::lround(2 * M_PI / parameters.step)));
+    m_Step = 2 * M_PI / viewCount;
+  }
+  m_Views.assign(viewCount, std::vector<unsigned char>());
+  m_Ready.reset(new std::atomic<bool>[viewCount]);
+  for (int i = 0; i < viewCount; i++) m_Ready[i] = false;
+  m_ReadyCount = 0;
+
+  // 离当前角度越近的视图越先渲染
+  std::vector<int> order(viewCount);
+  for (int i = 0; i < viewCount; i++) order[i] = i;
+  auto distance = [&](int view)
+  {
+    double d = std::abs(this->ViewAngle(view) - startAngle);
+    return this->IsCyclic() ? std::min(d, 2 * M_PI - std::fmod(d, 2 * M_PI)) : d;
+  };
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return distance(a) < distance(b); });
+
+  m_Token.Reset();
+  m_Thread = std::thread(&DRRAtlas::Run, this, order);
+}
+
+void DRRAtlas::Start(const short* volume, const int dims[3], const double spacing[3], unsigned long volumeMTime,
+                     const Parameters& parameters, double startAngle)
+{
+  this->Start(DRRVolume::New(volume, dims, spacing, volumeMTime), parameters, startAngle);
+}
+
+void DRRAtlas::Start(vtkImageData* image, const double spacing[3], const Parameters& parameters,
+                     double startAngle)
+{
+  this->Start(DRRVolume::New(image, spacing), parameters, startAngle);
+}
+
+void DRRAtlas::Stop()
+{
+  m_Token.Cancel();
+  if (m_Thread.joinable()) m_Thread.join();
+}
+
+bool DRRAtlas::IsCompatible(const short* volume, unsigned long volumeMTime, const Parameters& parameters) const
+{
+  return !m_Views.empty() && m_Volume->GetData() == volume && m_Volume->GetMTime() == volumeMTime &&
+         m_Parameters == parameters;
+}
+
+void DRRAtlas::Run(std::vector<int> order)
+{
+#ifdef __linux__
+  // 只使用空闲的CPU: 降低本线程的优先级, 渲染时创建的工作线程会继承
+  setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#endif
+  if (DRRTrace::IsEnabled()) DRRTrace::SetThreadName("Atlas");
+  DRRGenerator generator;
+  const int hardwareThreads = static_cast<int>(std::thread::hardware_concurrency());
+  generator.SetThreadCount(std::max(1, hardwareThreads - 1));
+  generator.SetVolume(m_Volume);
+  generator.SetSourceToDetectorDistance(m_Parameters.scd);
+  generator.SetThreshold(m_Parameters.threshold);
+  generator.SetSize(m_Parameters.size[0], m_Parameters.size[1], 1);
+  generator.SetSpacing(m_Parameters.spacing[0], m_Parameters.spacing[1], 1.0);
+  generator.SetOutputWindow(m_Parameters.window);
+
+  const size_t pixelCount = static_cast<size_t>(m_Parameters.size[0]) * m_Parameters.size[1];
+  DRRPose pose = m_Parameters.pose;
+  for (int view : order)
+  {
+    if (m_Token.IsCancelled()) return;
+    DRRTrace::Scope trace("AtlasView", "atlas", view);
+    pose.angle = this->ViewAngle(view);
+    generator.SetPose(pose);
+    if (generator.Update(m_Token) != DRRRenderCompleted) return;
+    vtkSmartPointer<vtkImageData> output = generator.GetOutput();
+    const unsigned char* pixels = static_cast<const unsigned char*>(output->GetScalarPointer());
+    m_Views[view].assign(pixels, pixels + pixelCount);
+    m_Ready[view].store(true, std::memory_order_release);
+    m_ReadyCount++;
+  }
+}
+
+bool DRRAtlas::GetPreview(double angle, unsigned char* image) const
+{
+  const int viewCount = this->GetViewCount();
+  if (viewCount == 0) return false;
+
+  double position = (angle - m_Parameters.minAngle) / m_Step;
+  if (this->IsCyclic())
+  {
+    position = std::fmod(position, static_cast<double>(viewCount));
+    if (position < 0) position += viewCount;
+  }
+  else if (position < 0 || position > viewCount - 1)
+  {
+    return false;
+  }
+  const int first = std::min(static_cast<int>(std::floor(position)), viewCount - 1);
+  const int second = (first + 1) % viewCount;
+  const float weight = static_cast<float>(position - first);
+  if (!m_Ready[first].load(std::memory_order_acquire)) return false;
+  if (weight == 0.0f || (second == 0 && !this->IsCyclic()))
+  {
+    memcpy(image, m_Views[first].data(), m_Views[first].size());
+    return true;
+  }
+  if (!m_Ready[second].load(std::memory_order_acquire)) return false;
+
+  const unsigned char* a = m_Views[first].data();
+  const unsigned char* b = m_Views[second].data();
+  const size_t pixelCount = m_Views[first].size();
+  for (size_t i = 0; i < pixelCount; i++)
+  {
+    image[i] = static_cast<unsigned char>(a[i] + weight * (b[i] - a[i]) + 0.5f);
+  }
+  return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "DRRGenerator.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class vtkImageData;
+
+// 相机角度的投影图集:
+// 在后台以低优先级按固定的角度间隔预先渲染DRR, 每个视图保存为8位灰度图(与DRRGenerator::GetOutput
+// 相同的灰度映射和翻转), 拖动角度滑块时由相邻两个视图线性插值得到预览, 无需等待完整的渲染.
+class DRRAtlas
+{
+ public:
+  // 除相机角度以外的渲染参数, 角度均为弧度
+  struct Parameters
+  {
+    double minAngle = -M_PI;
+    double maxAngle = M_PI;  // 与minAngle相差2π时首尾相接
+    double step = M_PI / 90;
+    DRRPose pose;  // 其中的angle不使用
+    double scd = 1000;
+    double threshold = 0;
+    int size[2]{256, 256};
+    double spacing[2]{1., 1.};
+    DRROutputWindow window;  // 视图保存的是灰度映射后的结果
+
+    bool operator==(const Parameters& other) const;
+  };
+
+  DRRAtlas();
+  ~DRRAtlas();
+
+  // 开始在后台渲染, 从startAngle附近的视图开始, 与前台的渲染共享volume及其缓存
+  void Start(std::shared_ptr<const DRRVolume> volume, const Parameters& parameters, double startAngle);
+  // 同上, CT数据在Stop之前需保持有效
+  void Start(const short* volume, const int dims[3], const double spacing[3], unsigned long volumeMTime,
+             const Parameters& parameters, double startAngle);
+  // 同上, 渲染期间持有image的引用(short类型)
+  void Start(vtkImageData* image, const double spacing[3], const Parameters& parameters, double startAngle);
+  void Stop();
+  // 图集是否对应于这份CT和这组参数
+  bool IsCompatible(const short* volume, unsigned long volumeMTime, const Parameters& parameters) const;
+
+  int GetViewCount() const { return static_cast<int>(m_Views.size()); }
+  int GetReadyCount() const { return m_ReadyCount.load(); }
+  // 插值得到angle处的预览图(size[0] * size[1]), 相邻视图尚未渲染时返回false
+  bool GetPreview(double angle, unsigned char* image) const;
+
+ private:
+  DRRAtlas(const DRRAtlas&) = delete;
+  void operator=(const DRRAtlas&) = delete;
+
+  void Run(std::vector<int> order);
+  bool IsCyclic() const;
+  double ViewAngle(int view) const;
+
+  std::shared_ptr<const DRRVolume> m_Volume;
+  Parameters m_Parameters;
+  double m_Step;  // 视图的角度间隔, 首尾相接时为2π / 视图数, 使最后一个间隔与其他的相同
+  std::vector<std::vector<unsigned char>> m_Views;
+  std::unique_ptr<std::atomic<bool>[]> m_Ready;
+  std::atomic<int> m_ReadyCount;
+  DRRRenderToken m_Token;  // Stop时取消正在渲染的视图, 立即让出CPU
+  std::thread m_Thread;
+};
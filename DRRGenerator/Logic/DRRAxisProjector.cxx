@@ -0,0 +1,197 @@
+#include "DRRAxisProjector.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace
+{
+const double AxisTolerance = 1e-6;
+
+int MajorAxis(const double v[3])
+{
+  int axis = 0;
+  for (int i = 1; i < 3; i++)
+    if (std::abs(v[i]) > std::abs(v[axis])) axis = i;
+  return axis;
+}
+
+bool IsAligned(const double v[3], int axis)
+{
+  const double length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  return length > 0 && std::abs(v[axis]) >= (1.0 - AxisTolerance) * length;
+}
+
+// 坐标 x0 + n * dx 离开第k列时的层号
+double NextRun(double x0, double dx, int k)
+{
+  if (dx > 0) return std::ceil((k + 1 - x0) / dx);
+  if (dx < 0) return std::floor((k - x0) / dx) + 1;
+  return INT_MAX;
+}
+
+short ClampToShort(double value)
+{
+  return value < SHRT_MIN ? SHRT_MIN : value > SHRT_MAX ? SHRT_MAX : static_cast<short>(value);
+}
+}  // namespace
+
+DRRAxisProjector::DRRAxisProjector()
+    : m_Axis{0, 1, 2},
+      m_Size{0, 0, 0},
+      m_Spacing{1., 1., 1.},
+      m_Stride{0, 0, 0},
+      m_Source{0., 0., 0.},
+      m_Detector{0., 0., 0.},
+      m_PixelStep{0., 0.},
+      m_AlphaStart(0),
+      m_AlphaStep(0),
+      m_PrefixStride{0, 0, 0}
+{
+}
+
+bool DRRAxisProjector::Setup(const double source[3], const double detector[3], const double u[3],
+                             const double v[3], const int volumeSize[3], const double volumeSpacing[3])
+{
+  const int a = MajorAxis(u), b = MajorAxis(v);
+  if (a == b || !IsAligned(u, a) || !IsAligned(v, b)) return false;
+  const int p = 3 - a - b;
+  const double depth = detector[p] - source[p];
+  if (std::abs(depth) < 1e-9) return false;
+
+  const size_t strides[3]{1, static_cast<size_t>(volumeSize[0]),
+                          static_cast<size_t>(volumeSize[0]) * volumeSize[1]};
+  m_Axis[0] = p;
+  m_Axis[1] = a;
+  m_Axis[2] = b;
+  for (int k = 0; k < 3; k++)
+  {
+    m_Size[k] = volumeSize[m_Axis[k]];
+    m_Spacing[k] = volumeSpacing[m_Axis[k]];
+    m_Stride[k] = strides[m_Axis[k]];
+    m_Source[k] = source[m_Axis[k]];
+    m_Detector[k] = detector[m_Axis[k]];
+  }
+  m_PixelStep[0] = u[a];
+  m_PixelStep[1] = v[b];
+  m_AlphaStart = (0.5 * m_Spacing[0] - m_Source[0]) / depth;
+  m_AlphaStep = m_Spacing[0] / depth;
+  return true;
+}
+
+void DRRAxisProjector::RayLine(int i, int j, double start[2], double step[2]) const
+{
+  // 射线参数为alpha时, 层内坐标为 source + alpha * (pixel - source), 换算为体素单位
+  const double toPixel[2]{m_Detector[1] + i * m_PixelStep[0] - m_Source[1],
+                          m_Detector[2] + j * m_PixelStep[1] - m_Source[2]};
+  for (int k = 0; k < 2; k++)
+  {
+    start[k] = (m_Source[k + 1] + m_AlphaStart * toPixel[k]) / m_Spacing[k + 1];
+    step[k] = m_AlphaStep * toPixel[k] / m_Spacing[k + 1];
+  }
+}
+
+int DRRAxisProjector::GetMaxRuns(int width, int height) const
+{
+  double runs = 1;
+  for (int i : {0, width - 1})
+    for (int j : {0, height - 1})
+    {
+      double start[2], step[2];
+      this->RayLine(i, j, start, step);
+      runs = std::max(runs, 1 + (std::abs(step[0]) + std::abs(step[1])) * m_Size[0]);
+    }
+  return static_cast<int>(std::min<double>(std::ceil(runs), INT_MAX));
+}
+
+std::shared_ptr<const std::vector<float>> DRRAxisProjector::BuildPrefixSum(const short* volume, const int dims[3],
+                                                                           int axis, double threshold)
+{
+  int prefixDims[3]{dims[0], dims[1], dims[2]};
+  prefixDims[axis]++;
+  const size_t prefixStrides[3]{1, static_cast<size_t>(prefixDims[0]),
+                                static_cast<size_t>(prefixDims[0]) * prefixDims[1]};
+
+  // 按内存顺序遍历, 主轴上第n层总是在第n+1层之前写入
+  auto sums = std::make_shared<std::vector<float>>(prefixStrides[2] * prefixDims[2], 0.0f);
+  const size_t next = prefixStrides[axis];
+  const float cut = static_cast<float>(threshold);
+  for (int z = 0; z < dims[2]; z++)
+    for (int y = 0; y < dims[1]; y++)
+    {
+      const short* row = volume + (static_cast<size_t>(z) * dims[1] + y) * dims[0];
+      float* prefix = sums->data() + z * prefixStrides[2] + y * prefixStrides[1];
+      for (int x = 0; x < dims[0]; x++) prefix[x + next] = prefix[x] + std::max(row[x] - cut, 0.0f);
+    }
+  return sums;
+}
+
+void DRRAxisProjector::SetPrefixSum(std::shared_ptr<const std::vector<float>> prefix)
+{
+  int prefixDims[3];
+  for (int k = 0; k < 3; k++) prefixDims[m_Axis[k]] = m_Size[k];
+  prefixDims[m_Axis[0]]++;
+  const size_t prefixStrides[3]{1, static_cast<size_t>(prefixDims[0]),
+                                static_cast<size_t>(prefixDims[0]) * prefixDims[1]};
+  for (int k = 0; k < 3; k++) m_PrefixStride[k] = prefixStrides[m_Axis[k]];
+  m_Prefix = std::move(prefix);
+}
+
+void DRRAxisProjector::RenderShearWarp(const short* volume, double threshold, int imin, int imax, int jmin,
+                                       int jmax, int width, short* image) const
+{
+  std::vector<float> sums(imax - imin);
+  const float cut = static_cast<float>(threshold);
+  for (int j = jmin; j < jmax; j++)
+  {
+    std::fill(sums.begin(), sums.end(), 0.0f);
+    double start[2], step[2], rowStart[2], rowStep[2];
+    this->RayLine(imin, j, start, step);
+    this->RayLine(imin + 1, j, rowStart, rowStep);
+    for (int n = 0; n < m_Size[0]; n++)
+    {
+      const int kb = static_cast<int>(std::floor(start[1] + n * step[1]));
+      if (kb < 0 || kb >= m_Size[2]) continue;
+      // 同一层内, 一行像素对应CT中的一行体素
+      const short* slice = volume + n * m_Stride[0] + kb * m_Stride[2];
+      const double a0 = start[0] + n * step[0];
+      const double da = (rowStart[0] + n * rowStep[0]) - a0;
+      for (int i = 0; i < imax - imin; i++)
+      {
+        const int ka = static_cast<int>(std::floor(a0 + i * da));
+        if (ka < 0 || ka >= m_Size[1]) continue;
+        const float value = slice[ka * m_Stride[1]];
+        if (value > cut) sums[i] += value - cut;
+      }
+    }
+    for (int i = imin; i < imax; i++) image[i + j * width] = ClampToShort(std::abs(m_AlphaStep) * sums[i - imin]);
+  }
+}
+
+void DRRAxisProjector::RenderPrefixSum(int imin, int imax, int jmin, int jmax, int width, short* image) const
+{
+  const int layers = m_Size[0];
+  for (int j = jmin; j < jmax; j++)
+    for (int i = imin; i < imax; i++)
+    {
+      double start[2], step[2];
+      this->RayLine(i, j, start, step);
+      // 射线落在同一列上的每一段用前缀和之差求和
+      double sum = 0;
+      for (int n = 0; n < layers;)
+      {
+        const int ka = static_cast<int>(std::floor(start[0] + n * step[0]));
+        const int kb = static_cast<int>(std::floor(start[1] + n * step[1]));
+        const double end = std::min({NextRun(start[0], step[0], ka), NextRun(start[1], step[1], kb),
+                                     static_cast<double>(layers)});
+        const int last = std::max(n + 1, static_cast<int>(end));
+        if (ka >= 0 && ka < m_Size[1] && kb >= 0 && kb < m_Size[2])
+        {
+          const float* column = m_Prefix->data() + ka * m_PrefixStride[1] + kb * m_PrefixStride[2];
+          sum += column[last * m_PrefixStride[0]] - column[n * m_PrefixStride[0]];
+        }
+        n = last;
+      }
+      image[i + j * width] = ClampToShort(std::abs(m_AlphaStep) * sum);
+    }
+}
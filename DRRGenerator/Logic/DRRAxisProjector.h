@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// 轴对齐几何下的快速投影.
+// 成像平面与CT的某个坐标平面平行时(相机角度为90°的整数倍且CT没有旋转), 所有射线穿过
+// 主轴上同一层时的参数值相同, 层内坐标是像素坐标的仿射函数. 每条射线在每层取最近的体素:
+//  ShearWarp: 逐层累加, 每层内沿像素行连续读取体素;
+//  PrefixSum: 预先沿主轴计算前缀和, 射线落在同一列上的一段只需一次减法,
+//             射线接近平行时每条射线只有很少几段, 代价与CT的层数无关.
+// 两种方式的采样模型相同, 与Siddon相比每层只取一个体素, 结果有细微差别.
+class DRRAxisProjector
+{
+ public:
+  DRRAxisProjector();
+
+  // source为光源, detector为像素(0, 0)的中心, u/v为i/j方向上相邻像素中心的位移, 均为LPS坐标(mm).
+  // 成像平面不与CT的坐标平面平行时返回false
+  bool Setup(const double source[3], const double detector[3], const double u[3], const double v[3],
+             const int volumeSize[3], const double volumeSpacing[3]);
+  // width * height的图像中, 一条射线在穿过CT的过程中最多经过的列数
+  int GetMaxRuns(int width, int height) const;
+
+  // 当前主轴, 即前缀和所沿的方向
+  int GetMainAxis() const { return m_Axis[0]; }
+  // 沿axis计算max(CT - threshold, 0)的前缀和, 内存约为CT的两倍(float), 由DRRVolume缓存
+  static std::shared_ptr<const std::vector<float>> BuildPrefixSum(const short* volume, const int dims[3], int axis,
+                                                                  double threshold);
+  // RenderPrefixSum所用的前缀和, 需沿当前主轴计算
+  void SetPrefixSum(std::shared_ptr<const std::vector<float>> prefix);
+
+  // 计算[imin, imax) x [jmin, jmax)范围内的DRR, image为width宽的short图像
+  void RenderShearWarp(const short* volume, double threshold, int imin, int imax, int jmin, int jmax, int width,
+                       short* image) const;
+  void RenderPrefixSum(int imin, int imax, int jmin, int jmax, int width, short* image) const;
+
+ private:
+  // 射线(i, j)在第n层的层内坐标为 start + n * step
+  void RayLine(int i, int j, double start[2], double step[2]) const;
+
+  int m_Axis[3];          // 主轴以及与像素i/j方向平行的CT坐标轴
+  int m_Size[3];          // 按m_Axis排列的CT size
+  double m_Spacing[3];    // 按m_Axis排列的CT spacing
+  size_t m_Stride[3];     // 按m_Axis排列的CT数据步长
+  double m_Source[3];     // 按m_Axis排列的光源坐标
+  double m_Detector[3];   // 按m_Axis排列的像素(0, 0)坐标
+  double m_PixelStep[2];  // 相邻像素在两个层内坐标轴上的位移
+  double m_AlphaStart;    // 第0层中心处的射线参数值
+  double m_AlphaStep;     // 相邻两层的射线参数增量(有符号)
+
+  std::shared_ptr<const std::vector<float>> m_Prefix;  // 主轴方向多一层的前缀和, 其余布局与CT相同
+  size_t m_PrefixStride[3];                            // 按m_Axis排列的前缀和步长
+};
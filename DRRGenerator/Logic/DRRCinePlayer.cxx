@@ -0,0 +1,239 @@
+#include "DRRCinePlayer.h"
+#include "DRRTrace.h"
+
+#include <iostream>
+
+#include <vtkImageData.h>
+
+namespace
+{
+const size_t QueueLength = 2;      // 每级队列最多积压的帧数
+const int ProbeInterval = 30;      // 降级后每隔多少帧试一次全分辨率
+const double SmoothingFactor = 0.25;
+
+double Milliseconds(std::chrono::steady_clock::duration duration)
+{
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+void Smooth(double& average, double value)
+{
+  average = average > 0 ? average + SmoothingFactor * (value - average) : value;
+}
+}  // namespace
+
+DRRCinePlayer::DRRCinePlayer()
+    : m_Size{0, 0}, m_Period(0), m_Stopping(false), m_RenderDone(true), m_PostDone(true)
+{
+}
+
+DRRCinePlayer::~DRRCinePlayer()
+{
+  this->Stop();
+}
+
+bool DRRCinePlayer::Start(std::shared_ptr<DRRGenerator> context, std::shared_ptr<DRRGenerator> reduced,
+                          const std::vector<double>& angles, double fps)
+{
+  this->Stop();
+  if (!context || angles.empty() || !(fps > 0))
+  {
+    std::cerr << "Cine needs a render context, angles and a positive frame rate" << std::endl;
+    return false;
+  }
+  m_Context = context;
+  m_Reduced = reduced;
+  m_Angles = angles;
+  m_Size[0] = context->GetSize()[0];
+  m_Size[1] = context->GetSize()[1];
+  m_Period = 1000.0 / fps;
+  m_Statistics = Statistics();
+  m_RenderDone = false;
+  m_PostDone = false;
+  m_Token.Reset();
+  // 留出填满流水线的时间
+  m_Begin = std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::milli>(QueueLength * m_Period));
+  m_RenderThread = std::thread(&DRRCinePlayer::RenderMain, this);
+  m_PostThread = std::thread(&DRRCinePlayer::PostMain, this);
+  return true;
+}
+
+void DRRCinePlayer::Stop()
+{
+  m_Stopping = true;
+  m_Token.Cancel();
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Condition.notify_all();
+  }
+  if (m_RenderThread.joinable()) m_RenderThread.join();
+  if (m_PostThread.joinable()) m_PostThread.join();
+  m_Rendered.clear();
+  m_Ready.clear();
+  m_RenderDone = true;
+  m_PostDone = true;
+  m_Stopping = false;
+}
+
+DRRCinePlayer::TimePoint DRRCinePlayer::DisplayTime(size_t index) const
+{
+  return m_Begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                       std::chrono::duration<double, std::milli>(index * m_Period));
+}
+
+void DRRCinePlayer::RenderMain()
+{
+  DRRTrace::SetThreadName("Cine render");
+  bool degraded = false;
+  int degradedRun = 0;
+  size_t index = 0;
+  while (index < m_Angles.size() && !m_Stopping)
+  {
+    double expected;
+    {
+      std::lock_guard<std::mutex> lock(m_Mutex);
+      expected = (degraded ? m_Statistics.reducedTime : m_Statistics.renderTime) + m_Statistics.postTime;
+    }
+    // 跳到预计能在显示时刻之前完成的第一帧, 都来不及时渲染最后一帧
+    const TimePoint finish = std::chrono::steady_clock::now() +
+                             std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                 std::chrono::duration<double, std::milli>(expected));
+    size_t target = index;
+    while (target + 1 < m_Angles.size() && this->DisplayTime(target) < finish) target++;
+
+    DRRGenerator& generator = degraded ? *m_Reduced : *m_Context;
+    auto begin = std::chrono::steady_clock::now();
+    {
+      DRRTrace::Scope trace("CineRender");
+      generator.SetAngle(m_Angles[target]);
+      if (generator.Update(m_Token) != DRRRenderCompleted) break;
+    }
+    const double elapsed = Milliseconds(std::chrono::steady_clock::now() - begin);
+
+    Rendered rendered;
+    rendered.index = target;
+    rendered.degraded = degraded;
+    rendered.size[0] = generator.GetSize()[0];
+    rendered.size[1] = generator.GetSize()[1];
+    const short* pixels = generator.GetRawOutput();
+    rendered.pixels.assign(pixels, pixels + static_cast<size_t>(rendered.size[0]) * rendered.size[1]);
+    generator.GetOutputLookupTable(rendered.lut, rendered.low);
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Statistics.droppedCount += target - index;
+    if (degraded)
+    {
+      m_Statistics.degradedCount++;
+      Smooth(m_Statistics.reducedTime, elapsed);
+    }
+    else
+    {
+      Smooth(m_Statistics.renderTime, elapsed);
+    }
+    m_Condition.wait(lock, [this] { return m_Rendered.size() < QueueLength || m_Stopping; });
+    m_Rendered.push_back(std::move(rendered));
+    m_Condition.notify_all();
+
+    // 全分辨率跟不上帧率时降级, 降级期间定期试一次全分辨率, 以便在负载下降后恢复
+    if (!m_Reduced)
+      degraded = false;
+    else if (degraded)
+      degraded = ++degradedRun % ProbeInterval != 0;
+    else
+      degraded = m_Statistics.renderTime > m_Period;
+    index = target + 1;
+  }
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_RenderDone = true;
+  m_Condition.notify_all();
+}
+
+void DRRCinePlayer::PostMain()
+{
+  DRRTrace::SetThreadName("Cine post");
+  while (true)
+  {
+    Rendered rendered;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Condition.wait(lock, [this] { return !m_Rendered.empty() || m_RenderDone || m_Stopping; });
+      if (m_Stopping || m_Rendered.empty()) break;
+      rendered = std::move(m_Rendered.front());
+      m_Rendered.pop_front();
+      m_Condition.notify_all();
+    }
+
+    // 灰度映射到[0, 255]并上下翻转, 低分辨率的帧按最近邻放大到输出的size
+    auto begin = std::chrono::steady_clock::now();
+    Frame frame;
+    frame.index = rendered.index;
+    frame.angle = m_Angles[rendered.index];
+    frame.degraded = rendered.degraded;
+    frame.image = vtkSmartPointer<vtkImageData>::New();
+    frame.image->SetDimensions(m_Size[0], m_Size[1], 1);
+    frame.image->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    frame.image->SetSpacing(1.0, 1.0, 1.0);
+    const int last = static_cast<int>(rendered.lut.size()) - 1;
+    unsigned char* output = static_cast<unsigned char*>(frame.image->GetScalarPointer());
+    std::vector<int> columns(m_Size[0]);
+    for (int i = 0; i < m_Size[0]; i++)
+    {
+      columns[i] = static_cast<int>(static_cast<long long>(i) * rendered.size[0] / m_Size[0]);
+    }
+    for (int j = 0; j < m_Size[1]; j++)
+    {
+      const int row = static_cast<int>(static_cast<long long>(m_Size[1] - 1 - j) * rendered.size[1] / m_Size[1]);
+      const short* source = rendered.pixels.data() + static_cast<size_t>(row) * rendered.size[0];
+      unsigned char* target = output + static_cast<size_t>(j) * m_Size[0];
+      for (int i = 0; i < m_Size[0]; i++)
+      {
+        const int index = source[columns[i]] - rendered.low;
+        target[i] = rendered.lut[index < 0 ? 0 : index > last ? last : index];
+      }
+    }
+    const double elapsed = Milliseconds(std::chrono::steady_clock::now() - begin);
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    Smooth(m_Statistics.postTime, elapsed);
+    m_Condition.wait(lock, [this] { return m_Ready.size() < QueueLength || m_Stopping; });
+    if (m_Stopping) break;
+    m_Ready.push_back(std::move(frame));
+  }
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_PostDone = true;
+  m_Condition.notify_all();
+}
+
+bool DRRCinePlayer::NextFrame(Frame& frame)
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  const TimePoint now = std::chrono::steady_clock::now();
+  bool found = false;
+  while (!m_Ready.empty() && this->DisplayTime(m_Ready.front().index) <= now)
+  {
+    if (found) m_Statistics.droppedCount++;
+    frame = std::move(m_Ready.front());
+    m_Ready.pop_front();
+    found = true;
+  }
+  if (found)
+  {
+    m_Statistics.shownCount++;
+    m_Condition.notify_all();
+  }
+  return found;
+}
+
+bool DRRCinePlayer::IsFinished()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_PostDone && m_Ready.empty();
+}
+
+DRRCinePlayer::Statistics DRRCinePlayer::GetStatistics()
+{
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return m_Statistics;
+}
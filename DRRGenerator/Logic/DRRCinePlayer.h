@@ -0,0 +1,98 @@
+#pragma once
+
+#include "DRRGenerator.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <vtkSmartPointer.h>
+
+class vtkImageData;
+
+// 按角度序列连续播放DRR(cine)的流水线:
+// 渲染线程渲染第N+1帧的同时, 后处理线程对第N帧做灰度映射和翻转(同DRRGenerator::GetOutput), 显示线程显示第N-1帧.
+// 各级之间的队列容量有限, 后一级积压时前一级等待. 每帧按帧率有一个显示时刻,
+// 渲染线程预计某帧来不及时跳过它; 全分辨率的渲染耗时超过帧间隔时改用低分辨率的渲染上下文, 放大后显示.
+class DRRCinePlayer
+{
+ public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Frame
+  {
+    size_t index = 0;                     // 在角度序列中的序号
+    double angle = 0.0;                   // 相机角度(弧度)
+    bool degraded = false;                // 以低分辨率渲染后放大
+    vtkSmartPointer<vtkImageData> image;  // unsigned char, 同DRRGenerator::GetOutput
+  };
+
+  struct Statistics
+  {
+    size_t shownCount = 0;     // 交给显示线程的帧数
+    size_t droppedCount = 0;   // 因来不及而跳过或过时丢弃的帧数
+    size_t degradedCount = 0;  // 以低分辨率渲染的帧数
+    double renderTime = 0.0;   // 全分辨率渲染耗时的滑动平均(ms)
+    double reducedTime = 0.0;  // 低分辨率渲染耗时的滑动平均(ms)
+    double postTime = 0.0;     // 后处理耗时的滑动平均(ms)
+  };
+
+  DRRCinePlayer();
+  ~DRRCinePlayer();
+
+  // context为设置好CT, 几何参数和除角度以外的pose的渲染上下文; reduced与之相同但分辨率较低, 为空时不降级.
+  // angles为相机角度序列(弧度), fps为目标帧率
+  bool Start(std::shared_ptr<DRRGenerator> context, std::shared_ptr<DRRGenerator> reduced,
+             const std::vector<double>& angles, double fps);
+  void Stop();
+  // 取出已到显示时刻的最新一帧, 在它之前的帧已过时, 计为丢弃; 没有到时的帧时返回false.
+  // 由显示线程以不低于帧率的频率调用
+  bool NextFrame(Frame& frame);
+  // 所有帧都已取出或丢弃
+  bool IsFinished();
+  Statistics GetStatistics();
+
+ private:
+  DRRCinePlayer(const DRRCinePlayer&) = delete;
+  void operator=(const DRRCinePlayer&) = delete;
+
+  // 渲染完成, 等待后处理的一帧
+  struct Rendered
+  {
+    size_t index;
+    bool degraded;
+    int size[2];
+    std::vector<short> pixels;
+    std::vector<unsigned char> lut;  // 渲染上下文按其直方图给出的灰度映射
+    int low;
+  };
+
+  void RenderMain();
+  void PostMain();
+  TimePoint DisplayTime(size_t index) const;
+
+  std::shared_ptr<DRRGenerator> m_Context;  // 全分辨率的渲染上下文
+  std::shared_ptr<DRRGenerator> m_Reduced;  // 低分辨率的渲染上下文
+  std::vector<double> m_Angles;
+  int m_Size[2];            // 输出图像的size
+  double m_Period;          // 帧间隔(ms)
+  TimePoint m_Begin;        // 第0帧的显示时刻
+  std::thread m_RenderThread;
+  std::thread m_PostThread;
+  std::atomic<bool> m_Stopping;
+  DRRRenderToken m_Token;   // Stop时取消正在渲染的帧
+
+  std::mutex m_Mutex;  // 保护以下的队列和统计
+  std::condition_variable m_Condition;
+  std::deque<Rendered> m_Rendered;  // 等待后处理的帧
+  std::deque<Frame> m_Ready;        // 等待显示的帧
+  bool m_RenderDone;
+  bool m_PostDone;
+  Statistics m_Statistics;
+};
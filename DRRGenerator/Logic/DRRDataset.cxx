@@ -0,0 +1,441 @@
+#include "DRRDataset.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+const uint32_t DatasetMagic = 0x44525244;  // "DRRD"
+const uint32_t DatasetVersion = 1;
+const uint64_t FrameAlignment = 64;
+
+struct DatasetHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  int32_t size[2];
+  double spacing[2];
+  uint64_t frameCount;
+  uint64_t indexOffset;     // 索引的偏移, 0表示文件未写完
+  uint64_t fiducialCount;   // 索引之后的标记点总数
+};
+
+const uint64_t HeaderLength = (sizeof(DatasetHeader) + FrameAlignment - 1) / FrameAlignment * FrameAlignment;
+
+uint64_t Align(uint64_t offset)
+{
+  return (offset + FrameAlignment - 1) / FrameAlignment * FrameAlignment;
+}
+
+// 行内差分后以zigzag变长整数存储, 每个差值1~3字节
+void EncodeDelta(const short* frame, int width, int height, std::vector<unsigned char>& out)
+{
+  out.clear();
+  for (int j = 0; j < height; j++)
+  {
+    const short* row = frame + static_cast<size_t>(j) * width;
+    int previous = 0;
+    for (int i = 0; i < width; i++)
+    {
+      const int delta = row[i] - previous;
+      previous = row[i];
+      uint32_t zigzag = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+      while (zigzag >= 0x80)
+      {
+        out.push_back(static_cast<unsigned char>(zigzag | 0x80));
+        zigzag >>= 7;
+      }
+      out.push_back(static_cast<unsigned char>(zigzag));
+    }
+  }
+}
+
+bool DecodeDelta(const unsigned char* data, size_t length, int width, int height, short* frame)
+{
+  const unsigned char* end = data + length;
+  for (int j = 0; j < height; j++)
+  {
+    int previous = 0;
+    for (int i = 0; i < width; i++)
+    {
+      uint32_t zigzag = 0;
+      for (int shift = 0;; shift += 7)
+      {
+        if (data == end || shift > 14) return false;
+        const unsigned char byte = *data++;
+        zigzag |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+      }
+      previous += static_cast<int>(zigzag >> 1) ^ -static_cast<int>(zigzag & 1);
+      *frame++ = static_cast<short>(previous);
+    }
+  }
+  return data == end;
+}
+}  // namespace
+
+// 索引中的一项
+struct DRRDatasetWriter::FrameEntry
+{
+  uint64_t offset;       // 帧数据在文件中的偏移
+  uint32_t bytes;        // 帧数据的字节数
+  uint32_t compression;  // 该帧实际使用的Compression
+  uint64_t fiducialFirst;
+  uint64_t fiducialCount;
+  double angle;
+  double rotation[3];
+  double translation[3];
+};
+
+void DRRDatasetWriter::Chunk::Clear()
+{
+  frames.clear();
+  poses.clear();
+  fiducials.clear();
+  fiducialCounts.clear();
+}
+
+DRRDatasetWriter::DRRDatasetWriter()
+    : m_Size{0, 0},
+      m_Spacing{1., 1.},
+      m_Compression(Delta),
+      m_ChunkBytes(16 * 1024 * 1024),
+      m_FrameCount(0),
+      m_Filling(0),
+      m_Pending(false),
+      m_Closing(false),
+      m_Failed(false),
+      m_Offset(0)
+{
+}
+
+DRRDatasetWriter::~DRRDatasetWriter()
+{
+  this->Close();
+}
+
+bool DRRDatasetWriter::Open(const std::string& fileName, const int size[2], const double spacing[2])
+{
+  this->Close();
+  if (size[0] <= 0 || size[1] <= 0)
+  {
+    std::cerr << "Invalid DRR size " << size[0] << "x" << size[1] << std::endl;
+    return false;
+  }
+  m_File.open(fileName, std::ios::binary | std::ios::trunc);
+  if (!m_File)
+  {
+    std::cerr << "Cannot create " << fileName << std::endl;
+    return false;
+  }
+  m_FileName = fileName;
+  std::copy(size, size + 2, m_Size);
+  std::copy(spacing, spacing + 2, m_Spacing);
+  m_FrameCount = 0;
+  m_Filling = 0;
+  m_Pending = false;
+  m_Closing = false;
+  m_Failed = false;
+  m_Index.clear();
+  m_Fiducials.clear();
+  m_Chunks[0].Clear();
+  m_Chunks[1].Clear();
+
+  // 文件头先占位, indexOffset为0, Close时再写入帧数和索引位置
+  const std::vector<char> header(HeaderLength, 0);
+  m_File.write(header.data(), header.size());
+  m_Offset = HeaderLength;
+  m_Thread = std::thread(&DRRDatasetWriter::WriterMain, this);
+  return true;
+}
+
+bool DRRDatasetWriter::Append(const short* frame, const DRRPose& pose, const double* fiducials, size_t count)
+{
+  if (!m_Thread.joinable()) return false;
+  const size_t frameLength = static_cast<size_t>(m_Size[0]) * m_Size[1];
+  Chunk& chunk = m_Chunks[m_Filling];
+  chunk.frames.insert(chunk.frames.end(), frame, frame + frameLength);
+  chunk.poses.push_back(pose);
+  if (count > 0) chunk.fiducials.insert(chunk.fiducials.end(), fiducials, fiducials + 2 * count);
+  chunk.fiducialCounts.push_back(static_cast<uint32_t>(count));
+  m_FrameCount++;
+  if (chunk.frames.size() * sizeof(short) >= m_ChunkBytes) this->Submit();
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  return !m_Failed;
+}
+
+void DRRDatasetWriter::Submit()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  // 上一块还没写完时才需要等待
+  m_Condition.wait(lock, [this] { return !m_Pending; });
+  m_Pending = true;
+  m_Filling ^= 1;
+  m_Condition.notify_all();
+}
+
+void DRRDatasetWriter::WriterMain()
+{
+  while (true)
+  {
+    int writing;
+    {
+      std::unique_lock<std::mutex> lock(m_Mutex);
+      m_Condition.wait(lock, [this] { return m_Pending || m_Closing; });
+      if (!m_Pending) break;
+      writing = m_Filling ^ 1;
+    }
+    this->WriteChunk(m_Chunks[writing]);
+    m_Chunks[writing].Clear();
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Pending = false;
+    m_Condition.notify_all();
+  }
+}
+
+void DRRDatasetWriter::WriteChunk(Chunk& chunk)
+{
+  // 整块拼接好后一次写盘
+  const size_t frameLength = static_cast<size_t>(m_Size[0]) * m_Size[1];
+  const size_t frameBytes = frameLength * sizeof(short);
+  m_Buffer.clear();
+  size_t fiducial = 0;
+  for (size_t n = 0; n < chunk.poses.size(); n++)
+  {
+    const short* frame = chunk.frames.data() + n * frameLength;
+    const char* payload = reinterpret_cast<const char*>(frame);
+    FrameEntry entry;
+    entry.compression = None;
+    entry.bytes = static_cast<uint32_t>(frameBytes);
+    if (m_Compression == Delta)
+    {
+      EncodeDelta(frame, m_Size[0], m_Size[1], m_Encoded);
+      if (m_Encoded.size() < frameBytes)
+      {
+        entry.compression = Delta;
+        entry.bytes = static_cast<uint32_t>(m_Encoded.size());
+        payload = reinterpret_cast<const char*>(m_Encoded.data());
+      }
+    }
+    // 未压缩的帧对齐后可以在映射中直接作为short数组使用
+    uint64_t offset = m_Offset + m_Buffer.size();
+    if (entry.compression == None) m_Buffer.resize(m_Buffer.size() + (Align(offset) - offset), 0);
+    entry.offset = m_Offset + m_Buffer.size();
+    m_Buffer.insert(m_Buffer.end(), payload, payload + entry.bytes);
+
+    const DRRPose& pose = chunk.poses[n];
+    entry.angle = pose.angle;
+    std::copy(pose.rotation, pose.rotation + 3, entry.rotation);
+    std::copy(pose.translation, pose.translation + 3, entry.translation);
+    entry.fiducialFirst = m_Fiducials.size() / 2;
+    entry.fiducialCount = chunk.fiducialCounts[n];
+    m_Fiducials.insert(m_Fiducials.end(), chunk.fiducials.begin() + 2 * fiducial,
+                       chunk.fiducials.begin() + 2 * (fiducial + entry.fiducialCount));
+    fiducial += entry.fiducialCount;
+    m_Index.push_back(entry);
+  }
+
+  m_File.write(m_Buffer.data(), m_Buffer.size());
+  m_Offset += m_Buffer.size();
+  if (!m_File)
+  {
+    std::cerr << "Cannot write " << m_FileName << std::endl;
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Failed = true;
+  }
+}
+
+bool DRRDatasetWriter::Close()
+{
+  if (!m_Thread.joinable()) return false;
+  if (!m_Chunks[m_Filling].poses.empty()) this->Submit();
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Closing = true;
+    m_Condition.notify_all();
+  }
+  m_Thread.join();
+
+  // 索引和标记点放在帧数据之后, 最后写文件头
+  const uint64_t padding = Align(m_Offset) - m_Offset;
+  m_File.write(std::vector<char>(padding, 0).data(), padding);
+  DatasetHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = DatasetMagic;
+  header.version = DatasetVersion;
+  std::copy(m_Size, m_Size + 2, header.size);
+  std::copy(m_Spacing, m_Spacing + 2, header.spacing);
+  header.frameCount = m_Index.size();
+  header.indexOffset = m_Offset + padding;
+  header.fiducialCount = m_Fiducials.size() / 2;
+  m_File.write(reinterpret_cast<const char*>(m_Index.data()), m_Index.size() * sizeof(FrameEntry));
+  m_File.write(reinterpret_cast<const char*>(m_Fiducials.data()), m_Fiducials.size() * sizeof(double));
+  m_File.seekp(0);
+  m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  m_File.close();
+  const bool succeeded = !m_Failed && !m_File.fail();
+  if (!succeeded) std::cerr << "Cannot finish " << m_FileName << std::endl;
+  m_Index.clear();
+  m_Fiducials.clear();
+  return succeeded;
+}
+
+DRRDatasetReader::DRRDatasetReader()
+    : m_Size{0, 0},
+      m_Spacing{1., 1.},
+      m_FrameCount(0),
+      m_Index(nullptr),
+      m_Fiducials(nullptr),
+      m_FiducialCount(0),
+      m_IndexOffset(0),
+      m_Mapping(nullptr),
+      m_MappingLength(0),
+#ifdef _WIN32
+      m_FileHandle(INVALID_HANDLE_VALUE),
+      m_MappingHandle(nullptr)
+#else
+      m_FileDescriptor(-1)
+#endif
+{
+}
+
+DRRDatasetReader::~DRRDatasetReader()
+{
+  this->Close();
+}
+
+bool DRRDatasetReader::Open(const std::string& fileName)
+{
+  this->Close();
+#ifdef _WIN32
+  HANDLE fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (fileHandle == INVALID_HANDLE_VALUE)
+  {
+    std::cerr << "Cannot open " << fileName << std::endl;
+    return false;
+  }
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(fileHandle, &fileSize);
+  m_FileHandle = fileHandle;
+  m_MappingLength = static_cast<size_t>(fileSize.QuadPart);
+  m_MappingHandle = m_MappingLength ? CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+  m_Mapping = m_MappingHandle ? MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+  m_FileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+  if (m_FileDescriptor < 0)
+  {
+    std::cerr << "Cannot open " << fileName << std::endl;
+    return false;
+  }
+  struct stat fileStat;
+  fstat(m_FileDescriptor, &fileStat);
+  m_MappingLength = static_cast<size_t>(fileStat.st_size);
+  m_Mapping = m_MappingLength ? mmap(nullptr, m_MappingLength, PROT_READ, MAP_SHARED, m_FileDescriptor, 0) : nullptr;
+  if (m_Mapping == MAP_FAILED) m_Mapping = nullptr;
+#endif
+  if (!m_Mapping)
+  {
+    std::cerr << "Cannot map " << fileName << std::endl;
+    this->Close();
+    return false;
+  }
+
+  DatasetHeader header;
+  memcpy(&header, m_Mapping, std::min(sizeof(header), m_MappingLength));
+  const uint64_t entryBytes = sizeof(DRRDatasetWriter::FrameEntry);
+  if (m_MappingLength < HeaderLength || header.magic != DatasetMagic || header.version != DatasetVersion ||
+      header.indexOffset == 0 || header.size[0] <= 0 || header.size[1] <= 0 ||
+      header.indexOffset + header.frameCount * entryBytes + header.fiducialCount * 2 * sizeof(double) >
+          m_MappingLength)
+  {
+    std::cerr << fileName << " is not a complete DRR dataset" << std::endl;
+    this->Close();
+    return false;
+  }
+  std::copy(header.size, header.size + 2, m_Size);
+  std::copy(header.spacing, header.spacing + 2, m_Spacing);
+  m_FrameCount = header.frameCount;
+  m_IndexOffset = header.indexOffset;
+  m_Index = static_cast<const char*>(m_Mapping) + header.indexOffset;
+  m_Fiducials = reinterpret_cast<const double*>(m_Index + header.frameCount * entryBytes);
+  m_FiducialCount = header.fiducialCount;
+  return true;
+}
+
+void DRRDatasetReader::Close()
+{
+#ifdef _WIN32
+  if (m_Mapping) UnmapViewOfFile(m_Mapping);
+  if (m_MappingHandle) CloseHandle(m_MappingHandle);
+  if (m_FileHandle != INVALID_HANDLE_VALUE) CloseHandle(m_FileHandle);
+  m_MappingHandle = nullptr;
+  m_FileHandle = INVALID_HANDLE_VALUE;
+#else
+  if (m_Mapping) munmap(m_Mapping, m_MappingLength);
+  if (m_FileDescriptor >= 0) ::close(m_FileDescriptor);
+  m_FileDescriptor = -1;
+#endif
+  m_Mapping = nullptr;
+  m_MappingLength = 0;
+  m_FrameCount = 0;
+  m_Index = nullptr;
+  m_Fiducials = nullptr;
+  m_FiducialCount = 0;
+}
+
+DRRPose DRRDatasetReader::GetPose(size_t index) const
+{
+  DRRPose pose;
+  if (index >= m_FrameCount) return pose;
+  DRRDatasetWriter::FrameEntry entry;
+  memcpy(&entry, m_Index + index * sizeof(entry), sizeof(entry));
+  pose.angle = entry.angle;
+  std::copy(entry.rotation, entry.rotation + 3, pose.rotation);
+  std::copy(entry.translation, entry.translation + 3, pose.translation);
+  return pose;
+}
+
+size_t DRRDatasetReader::GetFiducials(size_t index, const double*& points) const
+{
+  points = nullptr;
+  if (index >= m_FrameCount) return 0;
+  DRRDatasetWriter::FrameEntry entry;
+  memcpy(&entry, m_Index + index * sizeof(entry), sizeof(entry));
+  if (entry.fiducialFirst + entry.fiducialCount > m_FiducialCount) return 0;
+  points = m_Fiducials + 2 * entry.fiducialFirst;
+  return entry.fiducialCount;
+}
+
+const short* DRRDatasetReader::GetFrame(size_t index, std::vector<short>& buffer) const
+{
+  if (index >= m_FrameCount) return nullptr;
+  DRRDatasetWriter::FrameEntry entry;
+  memcpy(&entry, m_Index + index * sizeof(entry), sizeof(entry));
+  const size_t frameLength = static_cast<size_t>(m_Size[0]) * m_Size[1];
+  if (entry.offset + entry.bytes > m_IndexOffset) return nullptr;
+  const char* data = static_cast<const char*>(m_Mapping) + entry.offset;
+  if (entry.compression == DRRDatasetWriter::None)
+  {
+    return entry.bytes == frameLength * sizeof(short) ? reinterpret_cast<const short*>(data) : nullptr;
+  }
+  buffer.resize(frameLength);
+  if (entry.compression != DRRDatasetWriter::Delta ||
+      !DecodeDelta(reinterpret_cast<const unsigned char*>(data), entry.bytes, m_Size[0], m_Size[1], buffer.data()))
+  {
+    return nullptr;
+  }
+  return buffer.data();
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "DRRGenerator.h"
+#include "vtkSlicerDRRGeneratorModuleLogicExport.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 批量渲染结果的数据集文件: 文件头, 若干块帧数据, 文件末尾的索引(每帧的偏移, 字节数, pose和投影标记点).
+// pose同DRRGenerator::GetPose, 角度为弧度, 平移为mm.
+// 帧为DRRGenerator::GetRawOutput的short图像(未做灰度映射和翻转), 未压缩的帧按64字节对齐,
+// 读取时映射整个文件, 可以随机访问任意一帧. 字节序与本机相同.
+// 写入时索引在Close中最后写出, 未正常关闭的文件不能被读取.
+
+// 写入端: Append把帧复制到当前块中, 块满时交给后台I/O线程压缩和写盘, 同时开始填充另一块(双缓冲),
+// 只有写盘整体慢于渲染, 两块都在等待时Append才会阻塞
+class VTK_SLICER_DRRGENERATOR_MODULE_LOGIC_EXPORT DRRDatasetWriter
+{
+ public:
+  enum Compression
+  {
+    None = 0,
+    Delta,  // 行内差分后以zigzag变长整数存储, 无损; 变长后不小于原图的帧仍按原样存储
+  };
+
+  DRRDatasetWriter();
+  ~DRRDatasetWriter();
+
+  void SetCompression(Compression compression) { m_Compression = compression; }
+  // 每块的字节数(未压缩), 决定双缓冲占用的内存和每次写盘的大小
+  void SetChunkBytes(size_t bytes) { m_ChunkBytes = bytes; }
+
+  bool Open(const std::string& fileName, const int size[2], const double spacing[2]);
+  // frame为Size[0] * Size[1]的short图像; fiducials为count个DRR图像坐标(i0,j0,i1,...), 同GetFiducialPosition
+  bool Append(const short* frame, const DRRPose& pose, const double* fiducials = nullptr, size_t count = 0);
+  // 写完剩余的帧和索引, 全部成功时返回true
+  bool Close();
+  size_t GetFrameCount() const { return m_FrameCount; }
+
+ private:
+  DRRDatasetWriter(const DRRDatasetWriter&) = delete;
+  void operator=(const DRRDatasetWriter&) = delete;
+  friend class DRRDatasetReader;
+
+  struct FrameEntry;
+  // 尚未写盘的若干帧
+  struct Chunk
+  {
+    std::vector<short> frames;
+    std::vector<DRRPose> poses;
+    std::vector<double> fiducials;
+    std::vector<uint32_t> fiducialCounts;
+    void Clear();
+  };
+
+  void Submit();
+  void WriterMain();
+  void WriteChunk(Chunk& chunk);
+
+  std::ofstream m_File;
+  std::string m_FileName;
+  int m_Size[2];           // DRR图像的size
+  double m_Spacing[2];     // DRR图像的spacing
+  Compression m_Compression;
+  size_t m_ChunkBytes;
+  size_t m_FrameCount;     // 已Append的帧数
+
+  Chunk m_Chunks[2];       // 双缓冲
+  int m_Filling;           // Append正在填充的块, 另一块属于I/O线程
+  std::thread m_Thread;    // 后台I/O线程
+  std::mutex m_Mutex;      // 保护以下的状态
+  std::condition_variable m_Condition;
+  bool m_Pending;          // 另一块正在等待或正在写盘
+  bool m_Closing;
+  bool m_Failed;
+
+  // 以下只由I/O线程访问
+  uint64_t m_Offset;                   // 下一块在文件中的偏移
+  std::vector<FrameEntry> m_Index;
+  std::vector<double> m_Fiducials;
+  std::vector<char> m_Buffer;          // 一块的写盘数据
+  std::vector<unsigned char> m_Encoded;
+};
+
+// 读取端: 以只读方式映射整个文件, 可以在多个线程中同时读取
+class VTK_SLICER_DRRGENERATOR_MODULE_LOGIC_EXPORT DRRDatasetReader
+{
+ public:
+  DRRDatasetReader();
+  ~DRRDatasetReader();
+
+  bool Open(const std::string& fileName);
+  void Close();
+  bool IsOpen() const { return m_Mapping != nullptr; }
+
+  size_t GetFrameCount() const { return m_FrameCount; }
+  const int* GetSize() const { return m_Size; }
+  const double* GetSpacing() const { return m_Spacing; }
+  DRRPose GetPose(size_t index) const;
+  // 第index帧的投影标记点(i0,j0,i1,...), 返回点数
+  size_t GetFiducials(size_t index, const double*& points) const;
+  // 未压缩的帧直接指向映射的文件, 压缩的帧解码到buffer中; 数据损坏时返回nullptr
+  const short* GetFrame(size_t index, std::vector<short>& buffer) const;
+
+ private:
+  DRRDatasetReader(const DRRDatasetReader&) = delete;
+  void operator=(const DRRDatasetReader&) = delete;
+
+  int m_Size[2];
+  double m_Spacing[2];
+  size_t m_FrameCount;
+  const char* m_Index;       // 映射中的索引
+  const double* m_Fiducials; // 映射中的投影标记点
+  size_t m_FiducialCount;    // 标记点总数
+  uint64_t m_IndexOffset;
+  void* m_Mapping;           // 整个文件的映射地址
+  size_t m_MappingLength;
+#ifdef _WIN32
+  void* m_FileHandle;
+  void* m_MappingHandle;
+#else
+  int m_FileDescriptor;
+#endif
+};
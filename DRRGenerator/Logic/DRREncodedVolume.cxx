@@ -0,0 +1,217 @@
+#include "DRREncodedVolume.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace
+{
+size_t ThreadCount(size_t count)
+{
+  return std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), count));
+}
+
+// 把[0, count)平均分给threadCount个线程, func(begin, end, thread)
+template <typename Func>
+void ParallelFor(size_t count, size_t threadCount, Func func)
+{
+  std::vector<std::thread> pool;
+  for (size_t t = 0; t < threadCount; t++)
+  {
+    pool.emplace_back(func, count * t / threadCount, count * (t + 1) / threadCount, t);
+  }
+  for (auto& thread : pool) thread.join();
+}
+}  // namespace
+
+DRREncodedVolume::DRREncodedVolume()
+    : m_Encoding(None),
+      m_Source(nullptr),
+      m_Dimensions{0, 0, 0},
+      m_BrickCount{0, 0, 0},
+      m_Scale(1.f),
+      m_Offset(0.f),
+      m_MaxError(0.),
+      m_RMSError(0.)
+{
+}
+
+void DRREncodedVolume::Build(const short* data, const int dims[3], Encoding encoding)
+{
+  this->Clear();
+  if (!data || encoding == None) return;
+  std::copy(dims, dims + 3, m_Dimensions);
+  m_Encoding = encoding;
+  m_Source = data;
+  if (encoding == Brick8)
+  {
+    this->BuildBrick8(data);
+  }
+  else
+  {
+    this->BuildPacked12(data);
+  }
+}
+
+void DRREncodedVolume::Clear()
+{
+  m_Encoding = None;
+  m_Source = nullptr;
+  m_Codes.clear();
+  m_Codes.shrink_to_fit();
+  m_Bricks.clear();
+  m_Bricks.shrink_to_fit();
+  m_MaxError = m_RMSError = 0.;
+}
+
+void DRREncodedVolume::BuildBrick8(const short* data)
+{
+  const int brickSize = 1 << BrickShift;
+  for (int i = 0; i < 3; i++) m_BrickCount[i] = (m_Dimensions[i] + brickSize - 1) / brickSize;
+  const size_t sliceLength = static_cast<size_t>(m_Dimensions[0]) * m_Dimensions[1];
+  m_Codes.resize(sliceLength * m_Dimensions[2]);
+  m_Bricks.resize(static_cast<size_t>(m_BrickCount[0]) * m_BrickCount[1] * m_BrickCount[2]);
+
+  // 每个线程负责若干层brick, 误差分别统计后再合并
+  const size_t layerCount = m_BrickCount[2];
+  const size_t threadCount = ThreadCount(layerCount);
+  std::vector<double> maxErrors(threadCount, 0.), sumErrors(threadCount, 0.);
+  ParallelFor(layerCount, threadCount,
+              [&](size_t begin, size_t end, size_t thread)
+              {
+                for (size_t bz = begin; bz < end; bz++)
+                  for (int by = 0; by < m_BrickCount[1]; by++)
+                    for (int bx = 0; bx < m_BrickCount[0]; bx++)
+                    {
+                      const int i0 = bx * brickSize, i1 = std::min(i0 + brickSize, m_Dimensions[0]);
+                      const int j0 = by * brickSize, j1 = std::min(j0 + brickSize, m_Dimensions[1]);
+                      const int k0 = static_cast<int>(bz) * brickSize, k1 = std::min(k0 + brickSize, m_Dimensions[2]);
+                      short minValue = data[i0 + j0 * m_Dimensions[0] + k0 * sliceLength], maxValue = minValue;
+                      for (int k = k0; k < k1; k++)
+                        for (int j = j0; j < j1; j++)
+                        {
+                          const short* line = data + j * m_Dimensions[0] + k * sliceLength;
+                          for (int i = i0; i < i1; i++)
+                          {
+                            minValue = std::min(minValue, line[i]);
+                            maxValue = std::max(maxValue, line[i]);
+                          }
+                        }
+
+                      Brick& brick = m_Bricks[bx + by * m_BrickCount[0] + bz * m_BrickCount[0] * m_BrickCount[1]];
+                      brick.offset = minValue;
+                      brick.scale = static_cast<float>(maxValue - minValue) / 255.f;
+                      const float invScale = brick.scale > 0 ? 1.f / brick.scale : 0.f;
+                      for (int k = k0; k < k1; k++)
+                        for (int j = j0; j < j1; j++)
+                        {
+                          const size_t lineIndex = j * static_cast<size_t>(m_Dimensions[0]) + k * sliceLength;
+                          for (int i = i0; i < i1; i++)
+                          {
+                            const uint8_t code =
+                                static_cast<uint8_t>(std::lround((data[lineIndex + i] - brick.offset) * invScale));
+                            m_Codes[lineIndex + i] = code;
+                            const double error = std::abs(brick.offset + brick.scale * code - data[lineIndex + i]);
+                            maxErrors[thread] = std::max(maxErrors[thread], error);
+                            sumErrors[thread] += error * error;
+                          }
+                        }
+                    }
+              });
+
+  for (size_t t = 0; t < threadCount; t++)
+  {
+    m_MaxError = std::max(m_MaxError, maxErrors[t]);
+    m_RMSError += sumErrors[t];
+  }
+  m_RMSError = std::sqrt(m_RMSError / static_cast<double>(m_Codes.size()));
+}
+
+void DRREncodedVolume::BuildPacked12(const short* data)
+{
+  const size_t voxelCount = static_cast<size_t>(m_Dimensions[0]) * m_Dimensions[1] * m_Dimensions[2];
+  const size_t pairCount = (voxelCount + 1) / 2;
+  // 多出的字节保证解码最后一个体素时不越界
+  m_Codes.assign(pairCount * 3 + 1, 0);
+
+  const size_t threadCount = ThreadCount(pairCount);
+  std::vector<short> minValues(threadCount, data[0]), maxValues(threadCount, data[0]);
+  ParallelFor(voxelCount, threadCount,
+              [&](size_t begin, size_t end, size_t thread)
+              {
+                for (size_t n = begin; n < end; n++)
+                {
+                  minValues[thread] = std::min(minValues[thread], data[n]);
+                  maxValues[thread] = std::max(maxValues[thread], data[n]);
+                }
+              });
+  const short minValue = *std::min_element(minValues.begin(), minValues.end());
+  const short maxValue = *std::max_element(maxValues.begin(), maxValues.end());
+
+  // 范围不超过4096个值时scale为1, 编码无损
+  m_Offset = minValue;
+  m_Scale = std::max(1.f, static_cast<float>(maxValue - minValue) / 4095.f);
+  const float invScale = 1.f / m_Scale;
+
+  std::vector<double> maxErrors(threadCount, 0.), sumErrors(threadCount, 0.);
+  ParallelFor(pairCount, threadCount,
+              [&](size_t begin, size_t end, size_t thread)
+              {
+                for (size_t pair = begin; pair < end; pair++)
+                {
+                  int codes[2]{0, 0};
+                  for (size_t n = 0; n < 2 && 2 * pair + n < voxelCount; n++)
+                  {
+                    const short value = data[2 * pair + n];
+                    codes[n] = std::min(4095, static_cast<int>(std::lround((value - m_Offset) * invScale)));
+                    const double error = std::abs(m_Offset + m_Scale * codes[n] - value);
+                    maxErrors[thread] = std::max(maxErrors[thread], error);
+                    sumErrors[thread] += error * error;
+                  }
+                  uint8_t* packed = &m_Codes[pair * 3];
+                  packed[0] = static_cast<uint8_t>(codes[0] & 0xFF);
+                  packed[1] = static_cast<uint8_t>(((codes[0] >> 8) & 0x0F) | ((codes[1] & 0x0F) << 4));
+                  packed[2] = static_cast<uint8_t>(codes[1] >> 4);
+                }
+              });
+
+  for (size_t t = 0; t < threadCount; t++)
+  {
+    m_MaxError = std::max(m_MaxError, maxErrors[t]);
+    m_RMSError += sumErrors[t];
+  }
+  m_RMSError = std::sqrt(m_RMSError / static_cast<double>(voxelCount));
+}
+
+DRREncodedVolume::Encoding DRREncodedVolume::GetEncoding() const
+{
+  return m_Encoding;
+}
+
+const short* DRREncodedVolume::GetSource() const
+{
+  return m_Source;
+}
+
+double DRREncodedVolume::GetBytesPerVoxel() const
+{
+  switch (m_Encoding)
+  {
+    case Brick8:
+      return 1.0 + static_cast<double>(sizeof(Brick)) / (1 << (3 * BrickShift));
+    case Packed12:
+      return 1.5;
+    default:
+      return static_cast<double>(sizeof(short));
+  }
+}
+
+double DRREncodedVolume::GetMaxError() const
+{
+  return m_MaxError;
+}
+
+double DRREncodedVolume::GetRMSError() const
+{
+  return m_RMSError;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vtkSlicerDRRGeneratorModuleLogicExport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CT体数据的紧凑编码, 减少射线遍历时每个体素需要读取的字节数:
+//  Brick8:   每个8x8x8的brick记录scale和offset, 体素量化为8位, 约1字节/体素
+//  Packed12: 全局scale和offset, 体素量化为12位, 两个体素打包为3字节;
+//            CT值范围不超过4096时是无损的
+// 编码后的体素仍按原始的线性索引存放, 解码在遍历内核中完成.
+class VTK_SLICER_DRRGENERATOR_MODULE_LOGIC_EXPORT DRREncodedVolume
+{
+ public:
+  enum Encoding
+  {
+    None = 0,
+    Brick8,
+    Packed12
+  };
+
+  static const int BrickShift = 3;  // brick边长为 1 << BrickShift
+
+  DRREncodedVolume();
+
+  void Build(const short* data, const int dims[3], Encoding encoding);
+  void Clear();
+
+  Encoding GetEncoding() const;
+  const short* GetSource() const;
+  double GetBytesPerVoxel() const;
+  // 编码引入的最大绝对误差和均方根误差
+  double GetMaxError() const;
+  double GetRMSError() const;
+
+  inline float SampleBrick8(const int cIndex[3], size_t index) const
+  {
+    const Brick& brick = m_Bricks[(cIndex[0] >> BrickShift) + (cIndex[1] >> BrickShift) * m_BrickCount[0] +
+                                  (cIndex[2] >> BrickShift) * m_BrickCount[0] * m_BrickCount[1]];
+    return brick.offset + brick.scale * m_Codes[index];
+  }
+
+  inline float SamplePacked12(size_t index) const
+  {
+    const uint8_t* codes = &m_Codes[(index >> 1) * 3];
+    int code = index & 1 ? (codes[1] >> 4) | (codes[2] << 4) : codes[0] | ((codes[1] & 0x0F) << 8);
+    return m_Offset + m_Scale * code;
+  }
+
+ private:
+  struct Brick
+  {
+    float scale;
+    float offset;
+  };
+
+  void BuildBrick8(const short* data);
+  void BuildPacked12(const short* data);
+
+  Encoding m_Encoding;
+  const short* m_Source;        // 编码所对应的原始数据
+  int m_Dimensions[3];          // CT图像的Size
+  int m_BrickCount[3];          // 各方向上brick的个数
+  std::vector<uint8_t> m_Codes;  // 量化后的体素
+  std::vector<Brick> m_Bricks;  // Brick8: 每个brick的scale和offset
+  float m_Scale, m_Offset;      // Packed12: 全局的scale和offset
+  double m_MaxError, m_RMSError;
+};
@@ -0,0 +1,124 @@
+#include "DRRFrameCache.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include <vtkImageData.h>
+
+namespace
+{
+// FNV-1a, 逐个字段地输入以避开结构体中的填充字节
+class Fnv1a
+{
+ public:
+  template <typename T>
+  void Add(const T& value)
+  {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    for (size_t i = 0; i < sizeof(T); i++)
+    {
+      m_Hash = (m_Hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+  }
+  template <typename T>
+  void Add(const T* values, size_t count)
+  {
+    for (size_t i = 0; i < count; i++) this->Add(values[i]);
+  }
+  uint64_t Get() const { return m_Hash; }
+
+ private:
+  uint64_t m_Hash = 0xcbf29ce484222325ull;
+};
+}  // namespace
+
+bool DRRFrameCache::Key::operator==(const Key& other) const
+{
+  return volume == other.volume && volumeMTime == other.volumeMTime && pose.angle == other.pose.angle &&
+         std::equal(pose.rotation, pose.rotation + 3, other.pose.rotation) &&
+         std::equal(pose.translation, pose.translation + 3, other.pose.translation) && scd == other.scd &&
+         threshold == other.threshold && std::equal(size, size + 3, other.size) &&
+         std::equal(spacing, spacing + 3, other.spacing) && encoding == other.encoding &&
+         superSampling == other.superSampling && fastProjection == other.fastProjection && window == other.window;
+}
+
+DRRFrameCache::DRRFrameCache() : m_Capacity(256u << 20), m_MemorySize(0), m_Hits(0), m_Misses(0), m_LastHit(false) {}
+
+uint64_t DRRFrameCache::Hash(const Key& key)
+{
+  Fnv1a hash;
+  hash.Add(key.volume);
+  hash.Add(key.volumeMTime);
+  hash.Add(key.pose.angle);
+  hash.Add(key.pose.rotation, 3);
+  hash.Add(key.pose.translation, 3);
+  hash.Add(key.scd);
+  hash.Add(key.threshold);
+  hash.Add(key.size, 3);
+  hash.Add(key.spacing, 3);
+  hash.Add(key.encoding);
+  hash.Add(key.superSampling);
+  hash.Add(key.fastProjection);
+  hash.Add(key.window.mode);
+  hash.Add(key.window.percentiles, 2);
+  hash.Add(key.window.level);
+  hash.Add(key.window.width);
+  hash.Add(key.window.transform);
+  return hash.Get();
+}
+
+void DRRFrameCache::SetCapacity(size_t bytes)
+{
+  m_Capacity = bytes;
+  while (m_MemorySize > m_Capacity) this->Evict(std::prev(m_Frames.end()));
+}
+
+vtkSmartPointer<vtkImageData> DRRFrameCache::Find(const Key& key)
+{
+  auto found = m_Index.find(Hash(key));
+  if (found == m_Index.end() || !(found->second->key == key))
+  {
+    m_Misses++;
+    m_LastHit = false;
+    return nullptr;
+  }
+  m_Hits++;
+  m_LastHit = true;
+  m_Frames.splice(m_Frames.begin(), m_Frames, found->second);
+  return found->second->image;
+}
+
+void DRRFrameCache::Insert(const Key& key, vtkImageData* image)
+{
+  const uint64_t hash = Hash(key);
+  // 同一个哈希只保留最新的一帧(包括极少见的哈希冲突)
+  auto found = m_Index.find(hash);
+  if (found != m_Index.end()) this->Evict(found->second);
+
+  const size_t bytes = static_cast<size_t>(image->GetActualMemorySize()) * 1024;
+  if (bytes > m_Capacity) return;
+  while (m_MemorySize + bytes > m_Capacity) this->Evict(std::prev(m_Frames.end()));
+  m_Frames.push_front(Frame{key, hash, image, bytes});
+  m_Index[hash] = m_Frames.begin();
+  m_MemorySize += bytes;
+}
+
+void DRRFrameCache::Evict(std::list<Frame>::iterator frame)
+{
+  m_MemorySize -= frame->bytes;
+  m_Index.erase(frame->hash);
+  m_Frames.erase(frame);
+}
+
+void DRRFrameCache::Clear()
+{
+  m_Frames.clear();
+  m_Index.clear();
+  m_MemorySize = 0;
+}
+
+double DRRFrameCache::GetHitRate() const
+{
+  const size_t lookups = m_Hits + m_Misses;
+  return lookups > 0 ? static_cast<double>(m_Hits) / lookups : 0.0;
+}
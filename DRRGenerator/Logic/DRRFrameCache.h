@@ -0,0 +1,76 @@
+#pragma once
+
+#include "DRRGenerator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+#include <vtkSmartPointer.h>
+
+class vtkImageData;
+
+// 渲染结果的LRU缓存: 以CT和全部渲染参数的哈希为键保存已完成的DRR,
+// 参数与之前的某一帧完全相同时直接返回该帧, 不再调用DRRGenerator::Update.
+// 缓存中的图像与使用它的节点共享, 不能就地修改.
+class DRRFrameCache
+{
+ public:
+  struct Key
+  {
+    uint64_t volume = 0;         // CT的标识(图像的地址或映射文件名的哈希)
+    uint64_t volumeMTime = 0;    // 图像的MTime或映射文件的标识(修改时间, 大小, inode)
+    DRRPose pose;
+    double scd = 0;
+    double threshold = 0;
+    int size[3]{0, 0, 0};
+    double spacing[3]{0., 0., 0.};
+    int encoding = 0;            // 影响结果的DRRGenerator选项
+    int superSampling = 0;
+    bool fastProjection = false;
+    DRROutputWindow window;      // 缓存的是灰度映射后的结果
+
+    bool operator==(const Key& other) const;
+  };
+
+  DRRFrameCache();
+
+  // 缓存的总字节数上限, 0表示不缓存
+  void SetCapacity(size_t bytes);
+  size_t GetCapacity() const { return m_Capacity; }
+
+  // 命中时返回缓存的图像并将其移到最近使用的位置, 否则返回nullptr
+  vtkSmartPointer<vtkImageData> Find(const Key& key);
+  void Insert(const Key& key, vtkImageData* image);
+  void Clear();
+
+  static uint64_t Hash(const Key& key);
+
+  size_t GetHits() const { return m_Hits; }
+  size_t GetMisses() const { return m_Misses; }
+  // 最近一次Find是否命中
+  bool GetLastHit() const { return m_LastHit; }
+  double GetHitRate() const;
+  size_t GetFrameCount() const { return m_Frames.size(); }
+  size_t GetMemorySize() const { return m_MemorySize; }
+
+ private:
+  struct Frame
+  {
+    Key key;
+    uint64_t hash;
+    vtkSmartPointer<vtkImageData> image;
+    size_t bytes;
+  };
+
+  void Evict(std::list<Frame>::iterator frame);
+
+  std::list<Frame> m_Frames;  // 按最近使用的顺序, 最前面的最新
+  std::unordered_map<uint64_t, std::list<Frame>::iterator> m_Index;
+  size_t m_Capacity;
+  size_t m_MemorySize;
+  size_t m_Hits;
+  size_t m_Misses;
+  bool m_LastHit;
+};
@@ -1,6 +1,18 @@
 #include "DRRGenerator.h"
+#include "DRRMappedVolume.h"
+#include "DRRTrace.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <set>
 #include <thread>
 #include <vector>
 
@@ -9,14 +21,104 @@
 #include <vtkImageData.h>
 #include <vtkImageFlip.h>
 #include <vtkNew.h>
-#include <vtkPlane.h>
+
+namespace
+{
+// 当前工作线程绑定的NUMA节点
+thread_local int WorkerNode = 0;
+
+// 当前工作线程在本block中使用不判断边界的内核的射线数
+thread_local int InteriorRays = 0;
+
+// 射线最多跨越这么多列时才使用前缀和, 否则逐层累加更快
+const int PrefixSumMaxRuns = 4;
+
+// 每个short值一个bin
+const int HistogramBins = VTK_SHORT_MAX - VTK_SHORT_MIN + 1;
+
+// 把任意类型的标签值转换为从1开始的通道号, 0表示背景, 相邻体素的标签通常相同, 只在变化时查表
+template <typename T>
+bool MapLabels(const T* data, size_t length, std::vector<int>& values, std::vector<unsigned char>& channels)
+{
+  std::set<int> distinct;
+  for (size_t i = 0; i < length; i++)
+  {
+    if (data[i] != 0 && (i == 0 || data[i] != data[i - 1])) distinct.insert(static_cast<int>(data[i]));
+  }
+  if (distinct.size() > 255) return false;
+  values.assign(distinct.begin(), distinct.end());
+
+  channels.resize(length);
+  int last = 0;
+  unsigned char channel = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    const int value = static_cast<int>(data[i]);
+    if (value != last)
+    {
+      last = value;
+      channel = value == 0 ? 0
+                           : static_cast<unsigned char>(std::lower_bound(values.begin(), values.end(), value) -
+                                                        values.begin() + 1);
+    }
+    channels[i] = channel;
+  }
+  return true;
+}
+
+// data等是否与volume相同, 相同时保留volume及其缓存
+bool SameVolume(const DRRVolume* volume, const short* data, const int dims[3], const double spacing[3],
+                unsigned long mtime, const DRRMappedVolume* mapped)
+{
+  return volume && volume->GetData() == data && volume->GetMTime() == mtime &&
+         volume->GetMappedVolume() == mapped && std::equal(dims, dims + 3, volume->GetDimensions()) &&
+         std::equal(spacing, spacing + 3, volume->GetSpacing());
+}
+}  // namespace
+
+// 只在一次Update之内有意义的缓冲, 结果(图像, 直方图, 通道)仍由各上下文保存
+struct DRRGenerator::Scratch
+{
+  std::vector<RayState> rayStates;                  // 按slab遍历时每条射线的状态
+  std::vector<PartialHistogram> partialHistograms;  // 每个工作线程的局部直方图, 合并后清零
+  std::vector<float> binImage;                      // 每个像素每个能量bin的线积分
+};
+
+std::shared_ptr<DRRGenerator::Scratch> DRRGenerator::NewScratch()
+{
+  return std::make_shared<Scratch>();
+}
 
 DRRGenerator::DRRGenerator()
+    : volumePointer(nullptr),
+      m_MappedVolume(nullptr),
+      m_VolumeEncoding(DRREncodedVolume::None),
+      encodedVolume(std::make_shared<DRREncodedVolume>()),
+      m_NumaPolicy(DRRNuma::Off),
+      m_HugePages(true),
+      m_PermutedVolumes(false),
+      permutedStrides{0, 0, 0},
+      m_Spectral(false),
+      m_SuperSampling(DRRSingleSample),
+      m_FastProjection(false),
+      m_ContentClipping(true),
+      cullTiles(false),
+      culledTiles(0),
+      m_Incremental(false),
+      retracedPixels(0),
+      m_KernelSpecialization(true),
+      interiorRays(0),
+      renderToken(nullptr),
+      histogramRange{0, 0},
+      imagePointer(nullptr)
 {
   this->SetAngle(0);
   this->SetSourceToDetectorDistance(1000);
   this->SetThreshold(0);
   this->SetBlockSize(32);
+  this->SetThreadCount(0);
+  this->SetSlabThickness(0);
+  this->SetReadahead(true);
   double rot[3]{}, trans[3]{}, sp[3]{1., 1., 1.};
   int sz[3]{256, 256, 1};
   this->SetRotation(rot);
@@ -31,21 +133,22 @@ void DRRGenerator::Initialize()
   m_Origin[1] = -m_Spacing[1] * static_cast<double>(m_Size[1] - 1) * 0.5;
   m_Origin[2] = -m_SourceToDetectorDistance;
 
-  m_DRR = vtkSmartPointer<vtkImageData>::New();
-  m_DRR->SetDimensions(m_Size);
-  m_DRR->AllocateScalars(VTK_SHORT, 1);
-  m_DRR->SetSpacing(1.0, 1.0, 1.0);  // ! 在MRMLNode中记录Spacing,故此处设为0
-  imagePointer = static_cast<short*>(m_DRR->GetScalarPointer());
+  // 不能整除时, 最后一行/列的block只计算剩余的部分
+  row = (m_Size[0] + m_BlockSize - 1) / m_BlockSize;
+  col = (m_Size[1] + m_BlockSize - 1) / m_BlockSize;
+}
 
-  row = m_Size[0] / m_BlockSize;
-  col = m_Size[1] / m_BlockSize;
-  if (m_Size[0] % m_BlockSize != 0 || m_Size[1] % m_BlockSize != 0)
+void DRRGenerator::AllocateOutput()
+{
+  // 整幅图像只在Update时分配, size不变时复用
+  if (!m_DRR || !std::equal(m_Size, m_Size + 3, m_DRR->GetDimensions()))
   {
-    std::cerr << "DRR Size "
-              << "(" << m_Size[0] << ", " << m_Size[1] << ")"
-              << " Cannot be Devided by BlockSize"
-              << "(" << m_BlockSize << ")" << std::endl;
+    m_DRR = vtkSmartPointer<vtkImageData>::New();
+    m_DRR->SetDimensions(m_Size);
+    m_DRR->AllocateScalars(VTK_SHORT, 1);
+    m_DRR->SetSpacing(1.0, 1.0, 1.0);  // ! 在MRMLNode中记录Spacing,故此处设为0
   }
+  imagePointer = static_cast<short*>(m_DRR->GetScalarPointer());
 }
 
 void DRRGenerator::Modified()
@@ -89,35 +192,127 @@ void DRRGenerator::Rz(double isocenter[3], double angle, Eigen::Matrix4d& out)
   // clang-format on
 }
 
-short DRRGenerator::Evaluate(Eigen::Vector4d& point)
+short DRRGenerator::Evaluate(Eigen::Vector4d& point, const PixelOutput& output)
+{
+  RayState ray;
+  float d12;
+  if (sampleOffsets.empty())
+  {
+    this->InitRay(point, ray);
+    this->TraceRay(ray, INT_MIN, INT_MAX, output);
+    d12 = ray.d12;
+  }
+  else
+  {
+    // 同一像素的子射线共用一次坐标变换, 并且依次遍历, 它们访问的体素基本相同
+    Eigen::Vector4d center = m_Transform * point;
+    center /= center(3);
+    d12 = 0.0f;
+    for (const Eigen::Vector3d& offset : sampleOffsets)
+    {
+      this->InitRay(Eigen::Vector3d(center.head<3>() + offset), ray);
+      this->TraceRay(ray, INT_MIN, INT_MAX, output);
+      d12 += ray.d12;
+    }
+    d12 /= static_cast<float>(sampleOffsets.size());
+  }
+
+  const short minOutputValue = VTK_SHORT_MIN;
+  const short maxOutputValue = VTK_SHORT_MAX;
+  return d12 < minOutputValue   ? minOutputValue
+         : d12 > maxOutputValue ? maxOutputValue
+                                : static_cast<short>(d12);
+}
+
+DRRProjector DRRGenerator::UpdateAxisProjector()
+{
+  if (!m_FastProjection || m_MappedVolume || m_SlabThickness > 0 || !labelValues.empty() ||
+      !m_Scratch->binImage.empty() || !sampleOffsets.empty() || encodedVolume->GetEncoding() != DRREncodedVolume::None)
+  {
+    return DRRSiddon;
+  }
+
+  // 像素(0, 0)的中心以及相邻像素在LPS中的位移
+  Eigen::Vector4d point;
+  this->ImageToCamera(0, 0, point);
+  Eigen::Vector4d detector = m_Transform * point;
+  detector /= detector(3);
+  Eigen::Vector4d u = m_Transform * Eigen::Vector4d(m_Spacing[0], 0, 0, 0);
+  Eigen::Vector4d v = m_Transform * Eigen::Vector4d(0, m_Spacing[1], 0, 0);
+  if (!axisProjector.Setup(sourceWorld, detector.data(), u.data(), v.data(), m_VolumeSize, m_VolumeSpacing))
+  {
+    return DRRSiddon;
+  }
+  if (axisProjector.GetMaxRuns(m_Size[0], m_Size[1]) > PrefixSumMaxRuns) return DRRShearWarp;
+
+  // 前缀和与阈值和主轴有关, 由DRRVolume缓存
+  axisProjector.SetPrefixSum(m_Volume->GetPrefixSum(axisProjector.GetMainAxis(), m_Threshold));
+  return DRRPrefixSum;
+}
+
+void DRRGenerator::UpdateSampleOffsets()
 {
-  short pixval;
-  int cIndex[3];
+  // 子采样点相对像素中心的偏移(以像素为单位)
+  static const double grid2x2[][2]{{-0.25, -0.25}, {0.25, -0.25}, {-0.25, 0.25}, {0.25, 0.25}};
+  static const double grid3x3[][2]{{-1. / 3, -1. / 3}, {0, -1. / 3}, {1. / 3, -1. / 3},
+                                   {-1. / 3, 0},       {0, 0},       {1. / 3, 0},
+                                   {-1. / 3, 1. / 3},  {0, 1. / 3},  {1. / 3, 1. / 3}};
+  static const double rotatedGrid[][2]{{0.125, -0.375}, {0.375, 0.125}, {-0.125, 0.375}, {-0.375, -0.125}};
 
+  const double(*pattern)[2] = nullptr;
+  size_t count = 0;
+  switch (m_SuperSampling)
+  {
+    case DRRGrid2x2:
+      pattern = grid2x2;
+      count = 4;
+      break;
+    case DRRGrid3x3:
+      pattern = grid3x3;
+      count = 9;
+      break;
+    case DRRRotatedGrid:
+      pattern = rotatedGrid;
+      count = 4;
+      break;
+    default:
+      break;
+  }
+
+  // 相机坐标系下的偏移变换到LPS坐标系, 每条子射线只需一次加法
+  sampleOffsets.clear();
+  for (size_t i = 0; i < count; i++)
+  {
+    Eigen::Vector4d offset(pattern[i][0] * m_Spacing[0], pattern[i][1] * m_Spacing[1], 0, 0);
+    sampleOffsets.emplace_back((m_Transform * offset).head<3>());
+  }
+}
+
+void DRRGenerator::InitRay(Eigen::Vector4d& point, RayState& ray)
+{
+  Eigen::Vector4d drrWorld;
+  drrWorld = m_Transform * point;
+  drrWorld /= drrWorld(3);
+  this->InitRay(Eigen::Vector3d(drrWorld.head<3>()), ray);
+}
+
+void DRRGenerator::InitRay(const Eigen::Vector3d& drrWorld, RayState& ray)
+{
   float firstIntersection[3];
   float alphaX1, alphaXN, alphaXmin, alphaXmax;
   float alphaY1, alphaYN, alphaYmin, alphaYmax;
   float alphaZ1, alphaZN, alphaZmin, alphaZmax;
   float alphaMin, alphaMax;
-  float alphaX, alphaY, alphaZ, alphaCmin, alphaCminPrev;
-  float alphaUx, alphaUy, alphaUz;
+  float alphaX, alphaY, alphaZ;
   float alphaIntersectionUp[3], alphaIntersectionDown[3];
-  float d12, value;
   float firstIntersectionIndex[3];
   int firstIntersectionIndexUp[3], firstIntersectionIndexDown[3];
-  int iU, jU, kU;
-
-  const short minOutputValue = VTK_SHORT_MIN;
-  const short maxOutputValue = VTK_SHORT_MAX;
-
-  Eigen::Vector4d drrWorld;
-  drrWorld = m_Transform * point;
-  drrWorld /= drrWorld(3);
 
   float rayVector[3];
   rayVector[0] = static_cast<float>(drrWorld(0) - sourceWorld[0]);
   rayVector[1] = static_cast<float>(drrWorld(1) - sourceWorld[1]);
   rayVector[2] = static_cast<float>(drrWorld(2) - sourceWorld[2]);
+  ray.length = std::sqrt(rayVector[0] * rayVector[0] + rayVector[1] * rayVector[1] + rayVector[2] * rayVector[2]);
 
   /* Calculate the parametric  values of the first  and  the  last
   intersection points of  the  ray  with the X,  Y, and Z-planes  that
@@ -228,65 +423,130 @@ short DRRGenerator::Evaluate(Eigen::Vector4d& point)
   /* Calculate alpha incremental values when the ray intercepts with x, y, and z-planes */
   if (rayVector[0] != 0)
   {
-    alphaUx = m_VolumeSpacing[0] / std::abs(rayVector[0]);
+    ray.alphaUx = m_VolumeSpacing[0] / std::abs(rayVector[0]);
   }
   else
   {
-    alphaUx = 999;
+    ray.alphaUx = 999;
   }
   if (rayVector[1] != 0)
   {
-    alphaUy = m_VolumeSpacing[1] / std::abs(rayVector[1]);
+    ray.alphaUy = m_VolumeSpacing[1] / std::abs(rayVector[1]);
   }
   else
   {
-    alphaUy = 999;
+    ray.alphaUy = 999;
   }
   if (rayVector[2] != 0)
   {
-    alphaUz = m_VolumeSpacing[2] / std::abs(rayVector[2]);
+    ray.alphaUz = m_VolumeSpacing[2] / std::abs(rayVector[2]);
   }
   else
   {
-    alphaUz = 999;
+    ray.alphaUz = 999;
   }
 
   /* Calculate voxel index incremental values along the ray path. */
   if (sourceWorld[0] < drrWorld(0))
   {
-    iU = 1;
+    ray.iU = 1;
   }
   else
   {
-    iU = -1;
+    ray.iU = -1;
   }
   if (sourceWorld[1] < drrWorld(1))
   {
-    jU = 1;
+    ray.jU = 1;
   }
   else
   {
-    jU = -1;
+    ray.jU = -1;
   }
 
   if (sourceWorld[2] < drrWorld(2))
   {
-    kU = 1;
+    ray.kU = 1;
   }
   else
   {
-    kU = -1;
+    ray.kU = -1;
   }
 
-  d12 = 0.0; /* Initialize the sum of the voxel intensities along the ray path to zero. */
+  ray.d12 = 0.0; /* Initialize the sum of the voxel intensities along the ray path to zero. */
 
   /* Initialize the current ray position. */
-  alphaCmin = std::min(std::min(alphaX, alphaY), alphaZ);
+  ray.alphaCmin = std::min(std::min(alphaX, alphaY), alphaZ);
+  ray.alphaMax = alphaMax;
+  ray.alphaX = alphaX;
+  ray.alphaY = alphaY;
+  ray.alphaZ = alphaZ;
 
   /* Initialize the current voxel index. */
-  cIndex[0] = firstIntersectionIndexDown[0];
-  cIndex[1] = firstIntersectionIndexDown[1];
-  cIndex[2] = firstIntersectionIndexDown[2];
+  ray.cIndex[0] = firstIntersectionIndexDown[0];
+  ray.cIndex[1] = firstIntersectionIndexDown[1];
+  ray.cIndex[2] = firstIntersectionIndexDown[2];
+  ray.slab = 0;
+
+  /* Clip the ray to the bounding box of the voxels above the threshold, padded by one voxel. */
+  float clipMin = alphaMin, clipMax = alphaMax;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    if (rayVector[axis] != 0)
+    {
+      const float clip1 = (clipBox[2 * axis] - sourceWorld[axis]) / rayVector[axis];
+      const float clipN = (clipBox[2 * axis + 1] - sourceWorld[axis]) / rayVector[axis];
+      clipMin = std::max(clipMin, std::min(clip1, clipN));
+      clipMax = std::min(clipMax, std::max(clip1, clipN));
+    }
+    else if (sourceWorld[axis] < clipBox[2 * axis] || sourceWorld[axis] > clipBox[2 * axis + 1])
+    {
+      clipMin = clipMax;
+    }
+  }
+  if (clipMin >= clipMax)
+  {
+    /* The ray misses the content, leave it finished with a zero line integral. */
+    ray.alphaCmin = ray.alphaMax;
+    return;
+  }
+
+  /* Skip the plane crossings before the content. Only voxels at or below the threshold lie there,
+  and the parametric values are accumulated the same way as in the traversal. */
+  float* alphas[3]{&ray.alphaX, &ray.alphaY, &ray.alphaZ};
+  const float alphaU[3]{ray.alphaUx, ray.alphaUy, ray.alphaUz};
+  const int indexU[3]{ray.iU, ray.jU, ray.kU};
+  for (int axis = 0; axis < 3; axis++)
+  {
+    while (*alphas[axis] <= clipMin)
+    {
+      ray.alphaCmin = std::max(ray.alphaCmin, *alphas[axis]);
+      ray.cIndex[axis] += indexU[axis];
+      *alphas[axis] += alphaU[axis];
+    }
+  }
+  ray.alphaMax = clipMax;
+}
+
+template <bool Slabbed, bool Interior, typename Sampler, typename Accumulator>
+bool DRRGenerator::TraceRay(RayState& ray, int kmin, int kmax, const Sampler& sample, const Accumulator& accumulate)
+{
+  // 循环中不变的成员先取到局部变量, accumulate经float指针写入, 编译器不能假定它们不被修改
+  const double threshold = m_Threshold;
+  const int sizeX = m_VolumeSize[0], sizeY = m_VolumeSize[1], sizeZ = m_VolumeSize[2];
+  float alphaX = ray.alphaX, alphaY = ray.alphaY, alphaZ = ray.alphaZ;
+  float alphaCmin = ray.alphaCmin, alphaCminPrev;
+  float d12 = ray.d12, value;
+  int cIndex[3]{ray.cIndex[0], ray.cIndex[1], ray.cIndex[2]};
+  const float alphaUx = ray.alphaUx, alphaUy = ray.alphaUy, alphaUz = ray.alphaUz;
+  const float alphaMax = ray.alphaMax;
+  const int iU = ray.iU, jU = ray.jU, kU = ray.kU;
+  // 体素在原数据中的位置随索引增量更新, 越界时也不会被使用
+  const ptrdiff_t strideY = static_cast<ptrdiff_t>(jU) * sizeX;
+  const ptrdiff_t strideZ = static_cast<ptrdiff_t>(kU) * sizeX * sizeY;
+  ptrdiff_t offset = cIndex[0] + static_cast<ptrdiff_t>(cIndex[1]) * sizeX;
+  offset += static_cast<ptrdiff_t>(cIndex[2]) * sizeX * sizeY;
+  bool finished = true;
 
   while (alphaCmin < alphaMax) /* Check if the ray is still in the CT volume */
   {
@@ -298,6 +558,7 @@ short DRRGenerator::Evaluate(Eigen::Vector4d& point)
       /* Current ray front intercepts with x-plane. Update alphaX. */
       alphaCmin = alphaX;
       cIndex[0] = cIndex[0] + iU;
+      offset += iU;
       alphaX = alphaX + alphaUx;
     }
     else if ((alphaY <= alphaX) && (alphaY <= alphaZ))
@@ -305,35 +566,157 @@ short DRRGenerator::Evaluate(Eigen::Vector4d& point)
       /* Current ray front intercepts with y-plane. Update alphaY. */
       alphaCmin = alphaY;
       cIndex[1] = cIndex[1] + jU;
+      offset += strideY;
       alphaY = alphaY + alphaUy;
     }
     else
     {
+      /* The next z-plane lies outside the current slab, suspend the ray here. */
+      if (Slabbed && (cIndex[2] + kU < kmin || cIndex[2] + kU >= kmax))
+      {
+        finished = false;
+        break;
+      }
       /* Current ray front intercepts with z-plane. Update alphaZ. */
       alphaCmin = alphaZ;
       cIndex[2] = cIndex[2] + kU;
+      offset += strideZ;
       alphaZ = alphaZ + alphaUz;
     }
 
     /* If it is a valid index, get the voxel intensity. */
-    if (cIndex[0] >= 0 && cIndex[1] >= 0 && cIndex[2] >= 0 && cIndex[0] < m_VolumeSize[0] &&
-        cIndex[1] < m_VolumeSize[1] && cIndex[2] < m_VolumeSize[2])
+    if (Interior || (cIndex[0] >= 0 && cIndex[1] >= 0 && cIndex[2] >= 0 && cIndex[0] < sizeX && cIndex[1] < sizeY &&
+                     cIndex[2] < sizeZ))
     {
-      size_t index =
-          cIndex[0] + cIndex[1] * m_VolumeSize[0] + cIndex[2] * m_VolumeSize[1] * m_VolumeSize[0];
-      value = static_cast<float>(volumePointer[index]);
-      if (value > m_Threshold) /* Ignore voxels whose intensities are below the threshold. */
+      const size_t index = static_cast<size_t>(offset);
+      value = sample(cIndex, index);
+      if (value > threshold) /* Ignore voxels whose intensities are below the threshold. */
       {
-        d12 += (alphaCmin - alphaCminPrev) * (value - m_Threshold);
+        d12 += (alphaCmin - alphaCminPrev) * (value - threshold);
+        accumulate(index, value, alphaCmin - alphaCminPrev);
       }
     }
   }
 
-  pixval = d12 < minOutputValue   ? minOutputValue
-           : d12 > maxOutputValue ? maxOutputValue
-                                  : static_cast<short>(d12);
+  ray.alphaX = alphaX;
+  ray.alphaY = alphaY;
+  ray.alphaZ = alphaZ;
+  ray.alphaCmin = alphaCmin;
+  ray.d12 = d12;
+  ray.cIndex[0] = cIndex[0];
+  ray.cIndex[1] = cIndex[1];
+  ray.cIndex[2] = cIndex[2];
+  return finished;
+}
 
-  return pixval;
+template <typename Sampler, typename Accumulator>
+bool DRRGenerator::TraceKernel(RayState& ray, int kmin, int kmax, const Sampler& sample, const Accumulator& accumulate)
+{
+  // 不分slab的射线省去z方向的slab边界判断, 遍历范围一定在CT内的射线省去每个体素的边界判断
+  const bool slabbed = kmin != INT_MIN || kmax != INT_MAX;
+  if (!m_KernelSpecialization) return this->TraceRay<true, false>(ray, kmin, kmax, sample, accumulate);
+  const bool interior = this->RayInside(ray);
+  InteriorRays += interior ? 1 : 0;
+  if (slabbed)
+  {
+    return interior ? this->TraceRay<true, true>(ray, kmin, kmax, sample, accumulate)
+                    : this->TraceRay<true, false>(ray, kmin, kmax, sample, accumulate);
+  }
+  return interior ? this->TraceRay<false, true>(ray, kmin, kmax, sample, accumulate)
+                  : this->TraceRay<false, false>(ray, kmin, kmax, sample, accumulate);
+}
+
+bool DRRGenerator::RayInside(const RayState& ray) const
+{
+  // 遍历中每个轴的索引单调变化, 只需检查当前和结束时的索引. 某轴上穿过的平面中只有最后一步的参数值可以
+  // 不小于alphaMax, 其余都在[alpha, alphaMax)中; float累加的每一步舍入误差不超过2^-24 * max(|alpha|, |alphaMax|),
+  // 按2^-23放宽后, 步长的下界给出穿过平面数的上界
+  const float alphas[3]{ray.alphaX, ray.alphaY, ray.alphaZ};
+  const float alphaU[3]{ray.alphaUx, ray.alphaUy, ray.alphaUz};
+  const int indexU[3]{ray.iU, ray.jU, ray.kU};
+  for (int axis = 0; axis < 3; axis++)
+  {
+    const int first = ray.cIndex[axis];
+    if (first < 0 || first >= m_VolumeSize[axis]) return false;
+    int crossings = 1;
+    if (alphas[axis] < ray.alphaMax)
+    {
+      const double rounding = std::max(std::abs(alphas[axis]), std::abs(ray.alphaMax)) / (1 << 23);
+      const double step = alphaU[axis] - rounding;
+      if (step <= 0.0) return false;
+      const double count = (static_cast<double>(ray.alphaMax) - alphas[axis]) / step;
+      if (count >= m_VolumeSize[axis]) return false;
+      crossings += static_cast<int>(count) + 1;
+    }
+    const int last = first + indexU[axis] * crossings;
+    if (last < 0 || last >= m_VolumeSize[axis]) return false;
+  }
+  return true;
+}
+
+template <typename Sampler>
+bool DRRGenerator::TraceChannels(RayState& ray, int kmin, int kmax, const Sampler& sample, const PixelOutput& output)
+{
+  // 同一次遍历中, 按体素的标签把线积分同时累加到对应的通道
+  const unsigned char* labels = labelChannels.data();
+  const double threshold = m_Threshold;
+  float* channels = output.labels;
+  auto accumulateLabels = [=](size_t index, float value, float length)
+  {
+    if (labels[index] > 0) channels[labels[index] - 1] += length * (value - threshold);
+  };
+
+  // 每个体素查一次表, 所有能量bin的线积分一起累加, 参数增量乘以射线长度得到物理长度
+  typedef Eigen::Array<float, DRRSpectrum::MaxBins, 1> BinArray;
+  const DRRSpectrum& spectrum = m_Spectrum;
+  const float rayLength = ray.length;
+  float* bins = output.bins;
+  auto accumulateBins = [&spectrum, rayLength, bins](size_t, float value, float length)
+  { Eigen::Map<BinArray>(bins) += (length * rayLength) * Eigen::Map<const BinArray>(spectrum.GetRow(value)); };
+
+  if (channels && bins)
+  {
+    return this->TraceKernel(ray, kmin, kmax, sample,
+                             [&](size_t index, float value, float length)
+                             {
+                               accumulateLabels(index, value, length);
+                               accumulateBins(index, value, length);
+                             });
+  }
+  if (channels) return this->TraceKernel(ray, kmin, kmax, sample, accumulateLabels);
+  if (bins) return this->TraceKernel(ray, kmin, kmax, sample, accumulateBins);
+  return this->TraceKernel(ray, kmin, kmax, sample, [](size_t, float, float) {});
+}
+
+bool DRRGenerator::TraceRay(RayState& ray, int kmin, int kmax, const PixelOutput& output)
+{
+  // 每条射线只判断一次编码方式, 解码在遍历内核中完成
+  const DRREncodedVolume* encoded = encodedVolume.get();
+  switch (encoded->GetEncoding())
+  {
+    case DRREncodedVolume::Brick8:
+      return this->TraceChannels(
+          ray, kmin, kmax,
+          [encoded](const int cIndex[3], size_t index) { return encoded->SampleBrick8(cIndex, index); }, output);
+    case DRREncodedVolume::Packed12:
+      return this->TraceChannels(
+          ray, kmin, kmax, [encoded](const int*, size_t index) { return encoded->SamplePacked12(index); }, output);
+    default:
+    {
+      if (permutedVolume)
+      {
+        // 体素在副本中的位置按置换后的步长计算, 传入的index仍是原数据中的位置, 供标签通道使用
+        const short* volume = permutedVolume->data();
+        const size_t sx = permutedStrides[0], sy = permutedStrides[1], sz = permutedStrides[2];
+        auto sample = [=](const int* cIndex, size_t)
+        { return static_cast<float>(volume[cIndex[0] * sx + cIndex[1] * sy + cIndex[2] * sz]); };
+        return this->TraceChannels(ray, kmin, kmax, sample, output);
+      }
+      const short* volume = this->LocalVolume();
+      return this->TraceChannels(
+          ray, kmin, kmax, [volume](const int*, size_t index) { return static_cast<float>(volume[index]); }, output);
+    }
+  }
 }
 
 void DRRGenerator::ComputeTransform()
@@ -405,56 +788,629 @@ void DRRGenerator::ThreadedRequestData(int imin, int imax, int jmin, int jmax)
     for (int i = imin; i < imax; i++)
     {
       this->ImageToCamera(i, j, point);
-      imagePointer[i + j * m_Size[0]] = this->Evaluate(point);
+      imagePointer[i + j * m_Size[0]] = this->Evaluate(point, this->PixelChannels(i + j * m_Size[0]));
     }
 }
 
-void DRRGenerator::SetInputData(vtkImageData* image, double spacing[3])
+bool DRRGenerator::UpdateWarp()
 {
-  volumePointer = static_cast<short*>(image->GetScalarPointer());
-  image->GetDimensions(m_VolumeSize);
-  if (!spacing)
+  // 只有位姿与精确帧不同, 并且不需要额外通道时才能变换
+  if (!m_Incremental || !exactFrame) return false;
+  const ExactFrame& frame = *exactFrame;
+  if (frame.image.empty() || frame.time.GetMTime() < inputTime.GetMTime() ||
+      !labelValues.empty() || m_Spectral || frame.threshold != m_Threshold ||
+      frame.sourceToDetectorDistance != m_SourceToDetectorDistance || memcmp(frame.size, m_Size, sizeof(m_Size)) ||
+      memcmp(frame.spacing, m_Spacing, sizeof(m_Spacing)) || frame.encoding != m_VolumeEncoding ||
+      frame.superSampling != m_SuperSampling || m_Size[0] < 2 || m_Size[1] < 2)
+  {
+    return false;
+  }
+
+  // 当前相机坐标到精确帧相机坐标的变换, 旋转部分只能绕相机Z轴(射束方向), 才能保持射线不变
+  const Eigen::Matrix4d delta = frame.transform.inverse() * m_Transform;
+  const double tolerance = 1e-9;
+  if (std::abs(delta(0, 2)) > tolerance || std::abs(delta(1, 2)) > tolerance || std::abs(delta(2, 0)) > tolerance ||
+      std::abs(delta(2, 1)) > tolerance || delta(2, 2) < 0)
   {
-    spacing[0] = spacing[1] = spacing[2] = 1.0;
+    return false;
   }
-  memcpy(m_VolumeSpacing, spacing, 3 * sizeof(double));
+  // 沿射束方向的平移改变放大率, 在图像角上引起的偏差须小于1/4个像素
+  const double radius = 0.5 * std::hypot(m_Size[0], m_Size[1]);
+  if (std::abs(delta(2, 3)) * radius > 0.25 * m_SourceToDetectorDistance) return false;
+
+  warpMatrix << delta(0, 0), delta(0, 1), delta(0, 3), delta(1, 0), delta(1, 1), delta(1, 3);
+  return true;
+}
+
+void DRRGenerator::WarpTile(int imin, int imax, int jmin, int jmax)
+{
+  if (this->CullTile(imin, imax, jmin, jmax)) return;
+  const short* source = exactFrame->image.data();
+  Eigen::Vector4d point;
+  int retraced = 0;
+  for (int j = jmin; j < jmax; j++)
+    for (int i = imin; i < imax; i++)
+    {
+      this->ImageToCamera(i, j, point);
+      const Eigen::Vector2d warped = warpMatrix * Eigen::Vector3d(point(0), point(1), 1.0);
+      double position[2];
+      const double camPos[3]{warped(0), warped(1), m_Origin[2]};
+      this->CameraToImage(camPos, position);
+      short& pixel = imagePointer[i + j * static_cast<size_t>(m_Size[0])];
+      if (position[0] >= 0 && position[1] >= 0 && position[0] <= m_Size[0] - 1 && position[1] <= m_Size[1] - 1)
+      {
+        // 双线性插值
+        const int i0 = std::min(static_cast<int>(position[0]), m_Size[0] - 2);
+        const int j0 = std::min(static_cast<int>(position[1]), m_Size[1] - 2);
+        const double u = position[0] - i0, v = position[1] - j0;
+        const short* p = source + i0 + j0 * static_cast<size_t>(m_Size[0]);
+        const short* q = p + m_Size[0];
+        const double value = (1 - v) * ((1 - u) * p[0] + u * p[1]) + v * ((1 - u) * q[0] + u * q[1]);
+        pixel = static_cast<short>(std::lround(value));
+      }
+      else
+      {
+        // 新露出的边缘没有可用的结果, 重新遍历
+        pixel = this->Evaluate(point);
+        retraced++;
+      }
+    }
+  retracedPixels += retraced;
+}
+
+void DRRGenerator::SetPose(const DRRPose& pose)
+{
+  this->SetAngle(pose.angle);
+  this->SetRotation(pose.rotation[0], pose.rotation[1], pose.rotation[2]);
+  this->SetTranslation(pose.translation[0], pose.translation[1], pose.translation[2]);
+}
+
+DRRPose DRRGenerator::GetPose()
+{
+  DRRPose pose;
+  pose.angle = m_Angle;
+  this->GetRotation(pose.rotation);
+  this->GetTranslation(pose.translation);
+  return pose;
+}
+
+void DRRGenerator::SetVolume(std::shared_ptr<const DRRVolume> volume)
+{
+  if (volume == m_Volume) return;
+  m_Volume = volume;
+  volumePointer = volume->GetData();
+  m_MappedVolume = volume->GetMappedVolume();
+  memcpy(m_VolumeSize, volume->GetDimensions(), 3 * sizeof(int));
+  memcpy(m_VolumeSpacing, volume->GetSpacing(), 3 * sizeof(double));
   m_Isocenter[0] = m_VolumeSpacing[0] * static_cast<double>(m_VolumeSize[0]) / 2.0;
   m_Isocenter[1] = m_VolumeSpacing[1] * static_cast<double>(m_VolumeSize[1]) / 2.0;
   m_Isocenter[2] = m_VolumeSpacing[2] * static_cast<double>(m_VolumeSize[2]) / 2.0;
+  inputTime.Modified();
+  this->Modified();
+  this->UpdateEncoding();
+}
+
+void DRRGenerator::SetInputData(vtkImageData* image, double spacing[3])
+{
+  double defaultSpacing[3]{1.0, 1.0, 1.0};
+  if (!spacing) spacing = defaultSpacing;
+  if (!SameVolume(m_Volume.get(), static_cast<short*>(image->GetScalarPointer()), image->GetDimensions(), spacing,
+                  image->GetMTime(), nullptr))
+  {
+    this->SetVolume(DRRVolume::New(image, spacing));
+  }
+}
+
+void DRRGenerator::SetInputData(const short* data, const int dims[3], const double spacing[3])
+{
+  if (!SameVolume(m_Volume.get(), data, dims, spacing, 0, nullptr))
+  {
+    this->SetVolume(DRRVolume::New(data, dims, spacing));
+  }
+}
+
+void DRRGenerator::SetInputData(std::shared_ptr<const DRRMappedVolume> volume)
+{
+  // 同名文件被改写后重新映射时地址可能不变, 以文件标识区分
+  const unsigned long stamp = static_cast<unsigned long>(volume->GetFileStamp());
+  if (!SameVolume(m_Volume.get(), volume->GetData(), volume->GetDimensions(), volume->GetSpacing(), stamp,
+                  volume.get()))
+  {
+    this->SetVolume(DRRVolume::New(volume));
+  }
+}
+
+bool DRRGenerator::SetLabelData(vtkImageData* labels)
+{
+  labelValues.clear();
+  labelChannels.clear();
+  channelImage.clear();
+  if (!labels) return true;
+
+  int* dims = labels->GetDimensions();
+  if (dims[0] != m_VolumeSize[0] || dims[1] != m_VolumeSize[1] || dims[2] != m_VolumeSize[2])
+  {
+    std::cerr << "Label map dimensions " << dims[0] << "x" << dims[1] << "x" << dims[2]
+              << " do not match the CT volume" << std::endl;
+    return false;
+  }
+  const size_t length = static_cast<size_t>(dims[0]) * dims[1] * dims[2];
+  bool mapped = false;
+  switch (labels->GetScalarType())
+  {
+    vtkTemplateMacro(mapped = MapLabels(static_cast<const VTK_TT*>(labels->GetScalarPointer()), length,
+                                        labelValues, labelChannels));
+  }
+  if (!mapped)
+  {
+    std::cerr << "Label map must contain at most 255 distinct labels" << std::endl;
+    labelValues.clear();
+    labelChannels.clear();
+    return false;
+  }
+  return true;
+}
+
+DRRGenerator::PixelOutput DRRGenerator::PixelChannels(size_t pixel)
+{
+  PixelOutput output;
+  output.labels = labelValues.empty() ? nullptr : channelImage.data() + pixel * labelValues.size();
+  std::vector<float>& binImage = m_Scratch->binImage;
+  output.bins = binImage.empty() ? nullptr : binImage.data() + pixel * DRRSpectrum::MaxBins;
+  return output;
+}
+
+void DRRGenerator::UpdateEncoding()
+{
+  if (m_Volume) encodedVolume = m_Volume->GetEncodedVolume(m_VolumeEncoding);
+}
+
+void DRRGenerator::UpdateNumaPlacement()
+{
+  volumeReplicas = m_Volume->GetReplicas(m_NumaPolicy, m_HugePages);
+  statistics.numaPolicy = volumeReplicas.empty() ? DRRNuma::Off : m_NumaPolicy;
+  if (!volumeReplicas.empty()) statistics.pageKind = volumeReplicas[0]->GetPageKind();
+}
+
+void DRRGenerator::UpdatePermutedVolume()
+{
+  permutedVolume = nullptr;
+  statistics.contiguousAxis = 0;
+  if (!m_PermutedVolumes || statistics.projector != DRRSiddon || m_MappedVolume || m_SlabThickness > 0 ||
+      !volumeReplicas.empty() || encodedVolume->GetEncoding() != DRREncodedVolume::None)
+  {
+    return;
+  }
+
+  // 射线每前进单位长度穿过的某轴平面数与|r[axis]| / spacing[axis]成正比, 中心射线穿过最多平面的轴连续存放时,
+  // 遍历中大部分相邻的两次访问只差一个元素
+  Eigen::Vector4d point;
+  this->ImageToCamera(m_Size[0] / 2, m_Size[1] / 2, point);
+  Eigen::Vector4d center = m_Transform * point;
+  center /= center(3);
+  int axis = 0;
+  double crossings = -1.0;
+  for (int i = 0; i < 3; i++)
+  {
+    const double axisCrossings = std::abs(center(i) - sourceWorld[i]) / m_VolumeSpacing[i];
+    if (axisCrossings > crossings)
+    {
+      axis = i;
+      crossings = axisCrossings;
+    }
+  }
+  if (axis == 0) return;
+
+  const int maxThreads = m_ThreadCount > 0 ? m_ThreadCount : static_cast<int>(std::thread::hardware_concurrency());
+  permutedVolume = m_Volume->GetPermutedVolume(axis, maxThreads);
+  if (!permutedVolume) return;
+  const int b = (axis + 1) % 3, c = (axis + 2) % 3;
+  permutedStrides[axis] = 1;
+  permutedStrides[b] = static_cast<size_t>(m_VolumeSize[axis]);
+  permutedStrides[c] = static_cast<size_t>(m_VolumeSize[axis]) * m_VolumeSize[b];
+  statistics.contiguousAxis = axis;
+}
+
+void DRRGenerator::UpdateContentBox()
+{
+  // 编码后的体素值最多比原值高出最大误差, 按降低后的阈值计算包围盒
+  double threshold = m_Threshold;
+  if (encodedVolume->GetEncoding() != DRREncodedVolume::None) threshold -= encodedVolume->GetMaxError();
+  const int maxThreads = m_ThreadCount > 0 ? m_ThreadCount : static_cast<int>(std::thread::hardware_concurrency());
+  const std::array<int, 6> box =
+      m_ContentClipping ? m_Volume->GetContentBox(threshold, maxThreads)
+                        : std::array<int, 6>{0, m_VolumeSize[0], 0, m_VolumeSize[1], 0, m_VolumeSize[2]};
+  std::copy(box.begin(), box.end(), statistics.contentBox);
+
+  // 射线在体素入口处对应的索引会超前一个体素, 外扩一个体素保证被跳过的部分都不高于阈值
+  for (int axis = 0; axis < 3; axis++)
+  {
+    const bool empty = box[2 * axis] >= box[2 * axis + 1];
+    clipBox[2 * axis] =
+        empty ? 0.0f : static_cast<float>(std::max(box[2 * axis] - 1, 0) * m_VolumeSpacing[axis]);
+    clipBox[2 * axis + 1] =
+        empty ? 0.0f : static_cast<float>(std::min(box[2 * axis + 1] + 1, m_VolumeSize[axis]) * m_VolumeSpacing[axis]);
+  }
+}
+
+void DRRGenerator::UpdateTileCulling()
+{
+  // 包围盒的8个角点投影到成像平面, 凸包的外接矩形之外的射线都不会经过包围盒
+  const Eigen::Matrix4d lpsToCamera = m_Transform.inverse();
+  cullTiles = m_ContentClipping;
+  contentRect[0] = contentRect[2] = std::numeric_limits<double>::max();
+  contentRect[1] = contentRect[3] = std::numeric_limits<double>::lowest();
+  for (int corner = 0; corner < 8 && cullTiles; corner++)
+  {
+    const Eigen::Vector4d lps(clipBox[corner & 1], clipBox[2 + ((corner >> 1) & 1)], clipBox[4 + (corner >> 2)], 1.0);
+    const Eigen::Vector4d camera = lpsToCamera * lps;
+    // 角点在光源所在平面上或其后方时投影无意义, 不做剔除
+    if (camera(2) > -1e-6)
+    {
+      cullTiles = false;
+      break;
+    }
+    const double scale = m_Origin[2] / camera(2);
+    double imgPos[2];
+    const double camPos[3]{camera(0) * scale, camera(1) * scale, m_Origin[2]};
+    this->CameraToImage(camPos, imgPos);
+    contentRect[0] = std::min(contentRect[0], imgPos[0]);
+    contentRect[1] = std::max(contentRect[1], imgPos[0]);
+    contentRect[2] = std::min(contentRect[2], imgPos[1]);
+    contentRect[3] = std::max(contentRect[3], imgPos[1]);
+  }
+  culledTiles = 0;
+}
+
+bool DRRGenerator::CullTile(int imin, int imax, int jmin, int jmax)
+{
+  // 子射线偏离像素中心不超过半个像素, 再留出半个像素的余量
+  const double margin = 1.0;
+  if (!cullTiles || (imax - 1 + margin >= contentRect[0] && imin - margin <= contentRect[1] &&
+                     jmax - 1 + margin >= contentRect[2] && jmin - margin <= contentRect[3]))
+  {
+    return false;
+  }
+  // 整个block的射线都错过CT内容, 结果为0, 通道图像在Update开始时已清零
+  for (int j = jmin; j < jmax; j++)
+  {
+    std::fill_n(imagePointer + imin + j * static_cast<size_t>(m_Size[0]), imax - imin, static_cast<short>(0));
+  }
+  culledTiles++;
+  return true;
+}
+
+const short* DRRGenerator::LocalVolume()
+{
+  if (volumeReplicas.empty()) return volumePointer;
+  return static_cast<const short*>(volumeReplicas[volumeReplicas.size() == 1 ? 0 : WorkerNode]->GetData());
+}
+
+const DRREncodedVolume& DRRGenerator::GetEncodedVolume()
+{
+  this->UpdateEncoding();
+  return *encodedVolume;
 }
 
 void DRRGenerator::GetFiducialPosition(double point3D[3], double point2D[2])
 {
-  if (modifyTime.GetMTime() > updateTime.GetMTime())
+  this->ProjectPoints(point3D, 1, point2D);
+}
+
+void DRRGenerator::UpdateProjection()
+{
+  if (modifyTime.GetMTime() <= projectionTime.GetMTime()) return;
+  this->ComputeTransform();
+  m_LPSToCamera = m_Transform.inverse().topRows<3>();
+  projectionTime.Modified();
+}
+
+void DRRGenerator::ProjectPoints(const double* points3D, size_t count, double* points2D)
+{
+  // 相机矩阵只在pose变化后重新计算
+  this->UpdateProjection();
+
+  // 相机坐标系下点p与原点的连线交成像平面z = -scd于p * (-scd / p.z),
+  // 再换算到图像坐标, 与Initialize中的origin一致
+  const double originX = -m_Spacing[0] * static_cast<double>(m_Size[0] - 1) * 0.5;
+  const double originY = -m_Spacing[1] * static_cast<double>(m_Size[1] - 1) * 0.5;
+  const double planeZ = -m_SourceToDetectorDistance;
+  const Eigen::Matrix3d rotation = m_LPSToCamera.leftCols<3>();
+  const Eigen::Vector3d translation = m_LPSToCamera.col(3);
+
+  // 分块处理, 块内的矩阵乘法和除法由Eigen向量化
+  const size_t blockSize = 1024;
+  for (size_t first = 0; first < count; first += blockSize)
   {
-    this->ComputeTransform();
-    updateTime.Modified();
+    const Eigen::Index n = static_cast<Eigen::Index>(std::min(blockSize, count - first));
+    Eigen::Map<const Eigen::Matrix3Xd> lps(points3D + 3 * first, 3, n);
+    Eigen::Map<Eigen::Matrix2Xd> image(points2D + 2 * first, 2, n);
+    Eigen::Matrix3Xd camera = (rotation * lps).colwise() + translation;
+    Eigen::ArrayXXd scale = planeZ / camera.row(2).array();
+    image.row(0) = ((camera.row(0).array() * scale - originX) / m_Spacing[0]).matrix();
+    // ! 此时的DRR影像在Y轴是上下颠倒的,因此point2D的Y坐标需要取反
+    image.row(1) = (m_Size[1] - (camera.row(1).array() * scale - originY) / m_Spacing[1]).matrix();
   }
-  Eigen::Matrix4d ctlps2camera = this->m_Transform.inverse();
-  Eigen::Vector4d point3DVec = Eigen::Vector4d::Ones();
-  point3DVec(0) = point3D[0];
-  point3DVec(1) = point3D[1];
-  point3DVec(2) = point3D[2];
-  Eigen::Vector4d point3DCamVec = ctlps2camera * point3DVec;
-  point3DCamVec /= point3DCamVec(3);
-
-  double origin[3], normal[3]{0, 0, 1};
-  this->ImageToCamera(this->m_Size[0] / 2.0, this->m_Size[1] / 2.0, origin);
-  double p1[3], p2[3]{0, 0, 0};
-  p1[0] = point3DCamVec(0);
-  p1[1] = point3DCamVec(1);
-  p1[2] = point3DCamVec(2);
-
-  double fiducialCam[3];
-  double t = 0;
-  vtkPlane::IntersectWithLine(p1, p2, normal, origin, t, fiducialCam);
-  this->CameraToImage(fiducialCam, point2D);
-  // ! 此时的DRR影像在Y轴是上下颠倒的,因此point2D的Y坐标需要取反
-  point2D[1] = this->m_Size[1] - point2D[1];
 }
 
-void DRRGenerator::Update()
+void DRRGenerator::PartialHistogram::Allocate()
+{
+  if (!bins.empty()) return;
+  bins.assign(HistogramBins, 0);
+  minimum = VTK_SHORT_MAX;
+  maximum = VTK_SHORT_MIN;
+}
+
+void DRRGenerator::PartialHistogram::Add(const short* pixels, size_t count)
+{
+  uint32_t* counts = bins.data() - VTK_SHORT_MIN;
+  int low = minimum, high = maximum;
+  for (size_t i = 0; i < count; i++)
+  {
+    const int value = pixels[i];
+    counts[value]++;
+    low = std::min(low, value);
+    high = std::max(high, value);
+  }
+  minimum = low;
+  maximum = high;
+}
+
+bool DRRGenerator::RunTiles(const std::function<void(int, int, int, int)>& func, bool histogram, int jmin,
+                            int jmax)
+{
+  // 固定数量的线程从计数器中依次领取block, 避免为每个block创建一个线程
+  if (jmax < 0) jmax = m_Size[1];
+  const int bandCols = (jmax - jmin + m_BlockSize - 1) / m_BlockSize;
+  const int tileCount = row * bandCols;
+  const int maxThreads = m_ThreadCount > 0 ? m_ThreadCount : static_cast<int>(std::thread::hardware_concurrency());
+  const int threadCount = std::max(1, std::min(maxThreads, tileCount));
+  // 启用NUMA放置时, 线程轮流绑定到各节点, 调用者线程不参与计算以免改变它的亲和性
+  const bool bindThreads = statistics.numaPolicy != DRRNuma::Off;
+  const int nodeCount = DRRNuma::GetNodeCount();
+  statistics.tileCount = tileCount;
+  statistics.threadCount = threadCount;
+  statistics.numaNodeCount = nodeCount;
+  statistics.threadsPerNode.assign(nodeCount, 0);
+  for (int i = 0; i < threadCount; i++) statistics.threadsPerNode[bindThreads ? i % nodeCount : 0]++;
+
+  // 局部直方图在上一次合并时已清零, 只需补足线程数
+  std::vector<PartialHistogram>& partialHistograms = m_Scratch->partialHistograms;
+  if (histogram && partialHistograms.size() < static_cast<size_t>(threadCount))
+  {
+    partialHistograms.resize(threadCount);
+    for (PartialHistogram& partial : partialHistograms) partial.Allocate();
+  }
+
+  std::atomic<int> nextTile{0};
+  std::atomic<bool> stopped{false};
+  auto worker = [&](int index)
+  {
+    if (index > 0 && DRRTrace::IsEnabled()) DRRTrace::SetThreadName("Worker");
+    if (bindThreads)
+    {
+      WorkerNode = index % nodeCount;
+      DRRNuma::BindCurrentThread(WorkerNode);
+    }
+    for (int tile = nextTile++; tile < tileCount; tile = nextTile++)
+    {
+      if (renderToken && renderToken->ShouldStop())
+      {
+        stopped = true;
+        break;
+      }
+      int i = tile / bandCols, j = tile % bandCols;
+      DRRTrace::Scope trace("Tile", "render", i, j);
+      const int tileImin = i * m_BlockSize, tileImax = std::min((i + 1) * m_BlockSize, m_Size[0]);
+      const int tileJmin = jmin + j * m_BlockSize, tileJmax = std::min(tileJmin + m_BlockSize, jmax);
+      func(tileImin, tileImax, tileJmin, tileJmax);
+      interiorRays += InteriorRays;
+      InteriorRays = 0;
+      if (renderToken) renderToken->Complete();
+      if (!histogram) continue;
+      // block刚写完还在缓存中, 统计它不需要再遍历一次整幅图像
+      for (int y = tileJmin; y < tileJmax; y++)
+      {
+        partialHistograms[index].Add(imagePointer + tileImin + y * static_cast<size_t>(m_Size[0]),
+                                     tileImax - tileImin);
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (int i = bindThreads ? 0 : 1; i < threadCount; i++) pool.emplace_back(worker, i);
+  if (!bindThreads) worker(0);
+  for (auto& thread : pool) thread.join();
+  return !stopped;
+}
+
+void DRRGenerator::RenderTile(int imin, int imax, int jmin, int jmax)
 {
+  switch (statistics.projector)
+  {
+    case DRRShearWarp:
+      axisProjector.RenderShearWarp(this->LocalVolume(), m_Threshold, imin, imax, jmin, jmax, m_Size[0],
+                                    imagePointer);
+      break;
+    case DRRPrefixSum:
+      axisProjector.RenderPrefixSum(imin, imax, jmin, jmax, m_Size[0], imagePointer);
+      break;
+    default:
+      if (!this->CullTile(imin, imax, jmin, jmax)) this->ThreadedRequestData(imin, imax, jmin, jmax);
+      break;
+  }
+}
+
+void DRRGenerator::MergeHistograms()
+{
+  // 只清零和累加上次/本次出现过的值的范围
+  if (histogram.empty())
+    histogram.assign(HistogramBins, 0);
+  else if (histogramRange[0] <= histogramRange[1])
+    std::fill(histogram.begin() + (histogramRange[0] - VTK_SHORT_MIN),
+              histogram.begin() + (histogramRange[1] - VTK_SHORT_MIN + 1), 0);
+  int low = VTK_SHORT_MAX, high = VTK_SHORT_MIN;
+  for (PartialHistogram& partial : m_Scratch->partialHistograms)
+  {
+    if (partial.minimum > partial.maximum) continue;
+    for (int value = partial.minimum; value <= partial.maximum; value++)
+    {
+      uint32_t& count = partial.bins[value - VTK_SHORT_MIN];
+      histogram[value - VTK_SHORT_MIN] += count;
+      count = 0;
+    }
+    low = std::min(low, partial.minimum);
+    high = std::max(high, partial.maximum);
+    partial.minimum = VTK_SHORT_MAX;
+    partial.maximum = VTK_SHORT_MIN;
+  }
+  histogramRange[0] = low;
+  histogramRange[1] = high;
+}
+
+bool DRRGenerator::UpdateSlabs()
+{
+  // 默认每个slab约64MB
+  int thickness = m_SlabThickness;
+  if (thickness <= 0)
+  {
+    size_t sliceLength = static_cast<size_t>(m_VolumeSize[0]) * m_VolumeSize[1] * sizeof(short);
+    thickness = static_cast<int>(std::max<size_t>(1, (size_t(64) << 20) / sliceLength));
+  }
+  const int slabCount = (m_VolumeSize[2] + thickness - 1) / thickness;
+
+  // 先初始化所有射线并记录它们进入CT时所在的slab, 超采样时每个像素的子射线连续存放
+  const size_t sampleCount = std::max<size_t>(1, sampleOffsets.size());
+  std::vector<RayState>& rayStates = m_Scratch->rayStates;
+  rayStates.resize(static_cast<size_t>(m_Size[0]) * m_Size[1] * sampleCount);
+  std::atomic<bool> hasAscending{false}, hasDescending{false};
+  DRRTrace::Scope initTrace("InitRays");
+  renderToken->AddTotal(row * col);
+  const bool initialized = this->RunTiles(
+      [&](int imin, int imax, int jmin, int jmax)
+      {
+        if (this->CullTile(imin, imax, jmin, jmax))
+        {
+          // 被剔除的射线标记为已遍历完毕
+          for (int j = jmin; j < jmax; j++)
+            for (int i = imin; i < imax; i++)
+            {
+              RayState* rays = &rayStates[(i + j * static_cast<size_t>(m_Size[0])) * sampleCount];
+              for (size_t s = 0; s < sampleCount; s++)
+              {
+                rays[s].d12 = 0.0f;
+                rays[s].kU = 1;
+                rays[s].slab = -1;
+              }
+            }
+          return;
+        }
+        Eigen::Vector4d point;
+        for (int j = jmin; j < jmax; j++)
+          for (int i = imin; i < imax; i++)
+          {
+            RayState* rays = &rayStates[(i + j * static_cast<size_t>(m_Size[0])) * sampleCount];
+            this->ImageToCamera(i, j, point);
+            if (sampleOffsets.empty())
+            {
+              this->InitRay(point, rays[0]);
+            }
+            else
+            {
+              Eigen::Vector4d center = m_Transform * point;
+              center /= center(3);
+              for (size_t s = 0; s < sampleCount; s++)
+              {
+                this->InitRay(Eigen::Vector3d(center.head<3>() + sampleOffsets[s]), rays[s]);
+              }
+            }
+            for (size_t s = 0; s < sampleCount; s++)
+            {
+              RayState& ray = rays[s];
+              ray.slab = std::min(std::max(ray.cIndex[2], 0) / thickness, slabCount - 1);
+              (ray.kU > 0 ? hasAscending : hasDescending) = true;
+            }
+          }
+      });
+
+  initTrace.End();
+  if (!initialized) return false;
+  renderToken->AddTotal(row * col * slabCount * ((hasAscending ? 1 : 0) + (hasDescending ? 1 : 0)));
+
+  // 沿Z正方向前进的射线在升序遍历中完成, 沿负方向的在降序遍历中完成,
+  // 每次遍历中体数据按slab顺序被访问, 访问完的slab不会再被同一方向的射线访问
+  for (int direction : {1, -1})
+  {
+    if (!(direction > 0 ? hasAscending : hasDescending)) continue;
+    const bool lastPass = direction < 0 || !hasDescending;
+    for (int n = 0; n < slabCount; n++)
+    {
+      const int slab = direction > 0 ? n : slabCount - 1 - n;
+      DRRTrace::Scope trace("Slab", "render", slab, direction > 0 ? 0 : 1);
+      const int zmin = slab * thickness, zmax = std::min(zmin + thickness, m_VolumeSize[2]);
+      if (m_Readahead && m_MappedVolume)
+      {
+        if (n == 0) m_MappedVolume->WillNeed(zmin, zmax);
+        m_MappedVolume->WillNeed(zmin + direction * thickness, zmax + direction * thickness);
+      }
+
+      // 首尾两个slab向外不设边界, 保证射线在其中走完
+      const int kmin = slab == 0 ? INT_MIN : zmin;
+      const int kmax = slab == slabCount - 1 ? INT_MAX : zmax;
+      const bool finished = this->RunTiles(
+          [&](int imin, int imax, int jmin, int jmax)
+          {
+            for (int j = jmin; j < jmax; j++)
+              for (int i = imin; i < imax; i++)
+              {
+                const size_t pixel = i + j * static_cast<size_t>(m_Size[0]);
+                const PixelOutput output = this->PixelChannels(pixel);
+                for (size_t s = 0; s < sampleCount; s++)
+                {
+                  RayState& ray = rayStates[pixel * sampleCount + s];
+                  if (ray.kU != direction || ray.slab != slab) continue;
+                  ray.slab = this->TraceRay(ray, kmin, kmax, output) ? -1 : slab + direction;
+                }
+              }
+          });
+
+      if (m_Readahead && m_MappedVolume && lastPass) m_MappedVolume->DontNeed(zmin, zmax);
+      if (!finished) return false;
+    }
+  }
+
+  const short minOutputValue = VTK_SHORT_MIN;
+  const short maxOutputValue = VTK_SHORT_MAX;
+  std::vector<PartialHistogram>& partialHistograms = m_Scratch->partialHistograms;
+  partialHistograms.resize(std::max<size_t>(1, partialHistograms.size()));
+  partialHistograms[0].Allocate();
+  const size_t pixelCount = rayStates.size() / sampleCount;
+  const size_t rowLength = m_Size[0];
+  for (size_t i = 0; i < pixelCount; i++)
+  {
+    float d12 = 0.0f;
+    for (size_t s = 0; s < sampleCount; s++) d12 += rayStates[i * sampleCount + s].d12;
+    if (sampleCount > 1) d12 /= static_cast<float>(sampleCount);
+    imagePointer[i] = d12 < minOutputValue   ? minOutputValue
+                      : d12 > maxOutputValue ? maxOutputValue
+                                             : static_cast<short>(d12);
+    // 合成的同时按行统计直方图
+    if ((i + 1) % rowLength == 0) partialHistograms[0].Add(imagePointer + i + 1 - rowLength, rowLength);
+  }
+  return true;
+}
+
+void DRRGenerator::Prepare()
+{
+  // 包装的vtkImageData被原地修改后, 其缓存(编码, 包围盒, 前缀和等)已失效, 换用新的DRRVolume
+  if (!m_Volume->IsCurrent())
+  {
+    double isocenter[3];
+    this->GetIsocenter(isocenter);
+    const bool sameSize = std::equal(m_VolumeSize, m_VolumeSize + 3, m_Volume->GetImage()->GetDimensions());
+    this->SetVolume(DRRVolume::New(m_Volume->GetImage(), m_Volume->GetSpacing()));
+    if (sameSize) this->SetIsocenter(isocenter);
+  }
   // 第一次计算时, 设置一些初始参数, 避免重复计算
   if (modifyTime.GetMTime() > updateTime.GetMTime())
   {
@@ -462,29 +1418,319 @@ void DRRGenerator::Update()
     this->ComputeTransform();
     updateTime.Modified();
   }
+  this->UpdateSampleOffsets();
+  this->UpdateEncoding();
+  this->UpdateNumaPlacement();
+  statistics.volumeCopies = static_cast<int>(volumeReplicas.size());
+  if (!labelChannels.empty() && labelChannels.size() != static_cast<size_t>(m_VolumeSize[0]) * m_VolumeSize[1] *
+                                                           m_VolumeSize[2])
+  {
+    std::cerr << "CT volume changed size, label channels are dropped" << std::endl;
+    this->SetLabelData(nullptr);
+  }
+}
 
-  std::vector<std::thread> pool;
-  int imin, imax, jmin, jmax;
-  for (int i = 0; i < row; i++)
-    for (int j = 0; j < col; j++)
+void DRRGenerator::Update()
+{
+  DRRRenderToken token;
+  this->Update(token);
+}
+
+DRRRenderStatus DRRGenerator::Update(DRRRenderToken& token)
+{
+  DRRTrace::Scope trace("Update");
+  if (!m_Volume)
+  {
+    std::cerr << "No input volume" << std::endl;
+    return DRRRenderFailed;
+  }
+  // 开始之前已被取代或超时的渲染直接返回
+  if (token.ShouldStop()) return token.IsCancelled() ? DRRRenderCancelled : DRRRenderTimedOut;
+  auto begin = std::chrono::steady_clock::now();
+  DRRTrace::Scope stageTrace("Prepare");
+  this->Prepare();
+  this->AllocateOutput();
+  if (!m_Scratch) m_Scratch = NewScratch();
+  const size_t pixelCount = static_cast<size_t>(m_Size[0]) * m_Size[1];
+  channelImage.assign(pixelCount * labelValues.size(), 0.0f);
+  const bool spectral = m_Spectral && m_Spectrum.GetBinCount() > 0;
+  std::vector<float>& binImage = m_Scratch->binImage;
+  binImage.assign(spectral ? pixelCount * DRRSpectrum::MaxBins : 0, 0.0f);
+
+  // 内存映射的CT或显式设置了slab厚度时, 按slab顺序遍历体数据
+  // 增量模式下能用二维变换得到结果时不选择快速投影, 边缘像素由Siddon遍历
+  const bool warp = this->UpdateWarp();
+  statistics.projector = warp ? DRRSiddon : this->UpdateAxisProjector();
+  this->UpdatePermutedVolume();
+  if (statistics.projector == DRRSiddon)
+  {
+    this->UpdateContentBox();
+    this->UpdateTileCulling();
+  }
+  stageTrace.Next(warp ? "Warp" : "Render");
+  retracedPixels = 0;
+  interiorRays = 0;
+  renderToken = &token;
+  bool finished;
+  if (warp)
+  {
+    token.AddTotal(row * col);
+    finished = this->RunTiles(
+        [this](int imin, int imax, int jmin, int jmax) { this->WarpTile(imin, imax, jmin, jmax); }, true);
+  }
+  else if (statistics.projector == DRRSiddon && (m_MappedVolume || m_SlabThickness > 0))
+  {
+    finished = this->UpdateSlabs();
+  }
+  else
+  {
+    token.AddTotal(row * col);
+    finished = this->RunTiles(
+        [this](int imin, int imax, int jmin, int jmax) { this->RenderTile(imin, imax, jmin, jmax); }, true);
+  }
+  renderToken = nullptr;
+  this->MergeHistograms();
+  statistics.culledTileCount = statistics.projector == DRRSiddon ? culledTiles.load() : 0;
+  statistics.warped = warp;
+  statistics.retracedPixelCount = retracedPixels;
+  statistics.interiorRayCount = interiorRays;
+  if (!finished)
+  {
+    // 未完成的结果不作为增量模式的源, 也不合成通道
+    spectralImage.clear();
+    statistics.renderTime =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    return token.IsCancelled() ? DRRRenderCancelled : DRRRenderTimedOut;
+  }
+
+  // 增量模式下记录精确渲染的结果, 作为之后二维变换的源; 关闭增量模式后释放
+  if (!m_Incremental)
+  {
+    exactFrame.reset();
+  }
+  else if (!warp)
+  {
+    if (!exactFrame) exactFrame.reset(new ExactFrame);
+    exactFrame->image.assign(imagePointer, imagePointer + pixelCount);
+    exactFrame->transform = m_Transform;
+    exactFrame->threshold = m_Threshold;
+    exactFrame->sourceToDetectorDistance = m_SourceToDetectorDistance;
+    memcpy(exactFrame->size, m_Size, sizeof(m_Size));
+    memcpy(exactFrame->spacing, m_Spacing, sizeof(m_Spacing));
+    exactFrame->encoding = m_VolumeEncoding;
+    exactFrame->superSampling = m_SuperSampling;
+    exactFrame->time.Modified();
+  }
+
+  // 超采样时各通道累加的是所有子射线之和, 取平均
+  stageTrace.Next("Combine");
+  if (sampleOffsets.size() > 1)
+  {
+    const float scale = 1.0f / static_cast<float>(sampleOffsets.size());
+    for (float& value : channelImage) value *= scale;
+    for (float& value : binImage) value *= scale;
+  }
+
+  // 各bin的线积分按源谱和探测器响应合成为有效线积分
+  spectralImage.resize(spectral ? pixelCount : 0);
+  for (size_t i = 0; i < spectralImage.size(); i++)
+  {
+    spectralImage[i] = m_Spectrum.Combine(binImage.data() + i * DRRSpectrum::MaxBins);
+  }
+  statistics.renderTime =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  return DRRRenderCompleted;
+}
+
+bool DRRGenerator::UpdateStreaming(const DRROutputSink& sink, int bandRows)
+{
+  DRRTrace::Scope trace("UpdateStreaming");
+  if (!m_Volume)
+  {
+    std::cerr << "No input volume" << std::endl;
+    return false;
+  }
+  if (!labelValues.empty() || m_Spectral)
+  {
+    std::cerr << "Streaming output does not compute label or spectral channels" << std::endl;
+    return false;
+  }
+  auto begin = std::chrono::steady_clock::now();
+  DRRTrace::Scope stageTrace("Prepare");
+  // 释放整幅图像和各通道, 只保留行带
+  m_DRR = nullptr;
+  imagePointer = nullptr;
+  std::vector<float>().swap(channelImage);
+  std::vector<float>().swap(spectralImage);
+  if (!m_Scratch) m_Scratch = NewScratch();
+  std::vector<float>().swap(m_Scratch->binImage);
+  std::vector<RayState>().swap(m_Scratch->rayStates);
+  this->Prepare();
+  statistics.projector = this->UpdateAxisProjector();
+  this->UpdatePermutedVolume();
+  if (statistics.projector == DRRSiddon)
+  {
+    this->UpdateContentBox();
+    this->UpdateTileCulling();
+  }
+  retracedPixels = 0;
+  interiorRays = 0;
+
+  // 固定窗口与图像内容无关, 可以在渲染前得到查找表
+  const bool mapped = m_OutputWindow.mode == DRRWindowFixed;
+  std::vector<unsigned char> lut;
+  int low = 0;
+  if (mapped) this->GetOutputLookupTable(lut, low);
+  const int last = static_cast<int>(lut.size()) - 1;
+
+  // 输出图像是上下翻转的, 从最后一行开始向上逐个行带渲染; 两个渲染缓冲交替使用
+  const int width = m_Size[0];
+  const int rows = std::max(1, (bandRows + m_BlockSize - 1) / m_BlockSize) * m_BlockSize;
+  const int bandCount = (m_Size[1] + rows - 1) / rows;
+  const size_t bandLength = static_cast<size_t>(width) * rows;
+  std::vector<short> rendered[2]{std::vector<short>(bandLength), std::vector<short>(bandLength)};
+  std::vector<short> rawBand(bandLength);
+  std::vector<unsigned char> mappedBand(mapped ? bandLength : 0);
+  auto bandRange = [&](int band, int& jmin, int& jmax)
+  {
+    jmax = m_Size[1] - band * rows;
+    jmin = std::max(0, jmax - rows);
+  };
+  auto render = [&](int band)
+  {
+    DRRTrace::Scope bandTrace("Band", "render", band);
+    int jmin, jmax;
+    bandRange(band, jmin, jmax);
+    // 各block按整幅图像的坐标写入, 偏移后落在行带缓冲中
+    imagePointer = rendered[band % 2].data() - static_cast<ptrdiff_t>(jmin) * width;
+    this->RunTiles([this](int imin, int imax, int jmin, int jmax) { this->RenderTile(imin, imax, jmin, jmax); },
+                   true, jmin, jmax);
+  };
+
+  stageTrace.Next("Stream");
+  bool completed = true;
+  render(0);
+  for (int band = 0; band < bandCount && completed; band++)
+  {
+    // 后处理和输出这个行带的同时渲染下一个
+    std::thread next;
+    if (band + 1 < bandCount) next = std::thread(render, band + 1);
+    int jmin, jmax;
+    bandRange(band, jmin, jmax);
+    DRROutputBand output;
+    output.firstRow = band * rows;
+    output.rowCount = jmax - jmin;
+    output.width = width;
+    for (int r = 0; r < output.rowCount; r++)
+    {
+      const short* source = rendered[band % 2].data() + static_cast<size_t>(jmax - 1 - r - jmin) * width;
+      short* target = rawBand.data() + static_cast<size_t>(r) * width;
+      std::copy(source, source + width, target);
+      if (!mapped) continue;
+      unsigned char* gray = mappedBand.data() + static_cast<size_t>(r) * width;
+      for (int i = 0; i < width; i++)
+      {
+        const int index = target[i] - low;
+        gray[i] = lut[index < 0 ? 0 : index > last ? last : index];
+      }
+    }
+    output.raw = rawBand.data();
+    output.mapped = mapped ? mappedBand.data() : nullptr;
+    completed = sink(output);
+    if (next.joinable()) next.join();
+  }
+  imagePointer = nullptr;
+
+  this->MergeHistograms();
+  statistics.tileCount = row * col;
+  statistics.culledTileCount = statistics.projector == DRRSiddon ? culledTiles.load() : 0;
+  statistics.warped = false;
+  statistics.retracedPixelCount = 0;
+  statistics.interiorRayCount = interiorRays;
+  statistics.renderTime =
+      std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  return completed;
+}
+
+void DRRGenerator::GetOutputLookupTable(std::vector<unsigned char>& lut, int& low) const
+{
+  // 先确定映射的区间[low, high], 百分位由渲染时统计的直方图得到, 不需要再遍历图像
+  int high;
+  if (m_OutputWindow.mode == DRRWindowFixed)
+  {
+    low = static_cast<int>(std::lround(m_OutputWindow.level - 0.5 * m_OutputWindow.width));
+    high = static_cast<int>(std::lround(m_OutputWindow.level + 0.5 * m_OutputWindow.width));
+    low = std::min(std::max(low, VTK_SHORT_MIN), VTK_SHORT_MAX);
+    high = std::min(std::max(high, VTK_SHORT_MIN), VTK_SHORT_MAX);
+  }
+  else if (histogramRange[0] > histogramRange[1])
+  {
+    low = high = 0;
+  }
+  else if (m_OutputWindow.mode == DRRWindowPercentile)
+  {
+    uint64_t total = 0;
+    for (int value = histogramRange[0]; value <= histogramRange[1]; value++)
     {
-      imin = i * m_BlockSize;
-      imax = (i + 1) * m_BlockSize;
-      jmin = j * m_BlockSize;
-      jmax = (j + 1) * m_BlockSize;
-      pool.push_back(std::thread(&DRRGenerator::ThreadedRequestData, this, imin, imax, jmin, jmax));
+      total += histogram[value - VTK_SHORT_MIN];
     }
+    const double lower = total * 0.01 * m_OutputWindow.percentiles[0];
+    const double upper = total * 0.01 * m_OutputWindow.percentiles[1];
+    low = histogramRange[0];
+    high = histogramRange[1];
+    uint64_t count = 0;
+    for (int value = histogramRange[0]; value <= histogramRange[1]; value++)
+    {
+      const uint64_t previous = count;
+      count += histogram[value - VTK_SHORT_MIN];
+      if (previous < lower && count >= lower) low = value;
+      if (count >= upper)
+      {
+        high = value;
+        break;
+      }
+    }
+  }
+  else
+  {
+    low = histogramRange[0];
+    high = histogramRange[1];
+  }
 
-  for (int i = 0; i < row * col; i++)
+  // 区间为空时全部映射为0
+  if (high <= low)
+  {
+    lut.assign(1, 0);
+    return;
+  }
+  const double extent = high - low;
+  lut.resize(static_cast<size_t>(high - low) + 1);
+  for (size_t k = 0; k < lut.size(); k++)
   {
-    pool[i].join();
+    const double t = static_cast<double>(k) / extent;
+    switch (m_OutputWindow.transform)
+    {
+      case DRRIntensityLog:
+        lut[k] = static_cast<unsigned char>(255.0 * std::log1p(255.0 * t) / std::log(256.0));
+        break;
+      case DRRIntensityExponential:
+        lut[k] = static_cast<unsigned char>(std::pow(256.0, t) - 1.0);
+        break;
+      default:
+        lut[k] = static_cast<unsigned char>(255.0 * static_cast<double>(k) / extent);
+        break;
+    }
   }
 }
 
 vtkSmartPointer<vtkImageData> DRRGenerator::GetOutput()
 {
-  double range[2];
-  this->m_DRR->GetScalarRange(range);
+  DRRTrace::Scope trace("GetOutput");
+  if (!imagePointer) return nullptr;
+  std::vector<unsigned char> lut;
+  int low;
+  this->GetOutputLookupTable(lut, low);
+  const int last = static_cast<int>(lut.size()) - 1;
   size_t drrLength = this->m_Size[0] * this->m_Size[1] * this->m_Size[2];
   vtkSmartPointer<vtkImageData> outputImage = vtkSmartPointer<vtkImageData>::New();
   outputImage->SetDimensions(this->m_Size);
@@ -493,8 +1739,8 @@ vtkSmartPointer<vtkImageData> DRRGenerator::GetOutput()
   uint8_t* outputPtr = static_cast<uint8_t*>(outputImage->GetScalarPointer());
   for (size_t i = 0; i < drrLength; i++)
   {
-    outputPtr[i] = static_cast<uint8_t>(255.0 * (static_cast<double>(imagePointer[i]) - range[0]) /
-                                        (range[1] - range[0]));
+    const int index = imagePointer[i] - low;
+    outputPtr[i] = lut[index < 0 ? 0 : index > last ? last : index];
   }
 
   vtkNew<vtkImageFlip> flipFilter;
@@ -502,4 +1748,37 @@ vtkSmartPointer<vtkImageData> DRRGenerator::GetOutput()
   flipFilter->SetFilteredAxes(1);
   flipFilter->Update();
   return flipFilter->GetOutput();
-}
\ No newline at end of file
+}
+
+vtkSmartPointer<vtkImageData> DRRGenerator::GetLabelOutput()
+{
+  if (labelValues.empty()) return nullptr;
+  const int channelCount = static_cast<int>(labelValues.size());
+  vtkSmartPointer<vtkImageData> outputImage = vtkSmartPointer<vtkImageData>::New();
+  outputImage->SetDimensions(this->m_Size);
+  outputImage->AllocateScalars(VTK_FLOAT, channelCount);
+  outputImage->SetSpacing(1.0, 1.0, 1.0);
+  std::copy(channelImage.begin(), channelImage.end(), static_cast<float*>(outputImage->GetScalarPointer()));
+
+  vtkNew<vtkImageFlip> flipFilter;
+  flipFilter->SetInputData(outputImage);
+  flipFilter->SetFilteredAxes(1);
+  flipFilter->Update();
+  return flipFilter->GetOutput();
+}
+
+vtkSmartPointer<vtkImageData> DRRGenerator::GetSpectralOutput()
+{
+  if (spectralImage.empty()) return nullptr;
+  vtkSmartPointer<vtkImageData> outputImage = vtkSmartPointer<vtkImageData>::New();
+  outputImage->SetDimensions(this->m_Size);
+  outputImage->AllocateScalars(VTK_FLOAT, 1);
+  outputImage->SetSpacing(1.0, 1.0, 1.0);
+  std::copy(spectralImage.begin(), spectralImage.end(), static_cast<float*>(outputImage->GetScalarPointer()));
+
+  vtkNew<vtkImageFlip> flipFilter;
+  flipFilter->SetInputData(outputImage);
+  flipFilter->SetFilteredAxes(1);
+  flipFilter->Update();
+  return flipFilter->GetOutput();
+}
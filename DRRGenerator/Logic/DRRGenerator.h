@@ -1,24 +1,288 @@
 #pragma once
 
+#include "DRRAxisProjector.h"
+#include "DRREncodedVolume.h"
 #include "DRRGeneratorMacro.h"
+#include "DRRNuma.h"
+#include "DRRSpectrum.h"
+#include "DRRVolume.h"
+#include "vtkSlicerDRRGeneratorModuleLogicExport.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
 #include <itkeigen/Eigen/Core>
 #include <vtkSmartPointer.h>
 #include <vtkTimeStamp.h>
 
+class DRRMappedVolume;
 class vtkImageData;
-class DRRGenerator
+
+// 一次投影的位姿, 角度均为弧度
+struct DRRPose
+{
+  double angle = 0.0;                // 相机绕病人Z轴旋转的角度
+  double rotation[3]{0., 0., 0.};     // Volume绕isocenter旋转的角度
+  double translation[3]{0., 0., 0.};  // Volume相对isocenter平移的距离(mm)
+};
+
+// 探测器像素内的子采样方式
+enum DRRSuperSampling
+{
+  DRRSingleSample = 0,  // 每个像素中心一条射线
+  DRRGrid2x2,
+  DRRGrid3x3,
+  DRRRotatedGrid,  // 旋转网格上的4个采样点, 水平和竖直方向各有4个不同的位置
+};
+
+// 计算DRR所用的投影方式
+enum DRRProjector
+{
+  DRRSiddon = 0,  // 逐条射线的Siddon遍历
+  DRRShearWarp,   // 轴对齐几何下逐层累加
+  DRRPrefixSum,   // 轴对齐且射线接近平行时查前缀和
+};
+
+// GetOutput把[下限, 上限]内的原始值映射到0~255, 区间的确定方式
+enum DRRWindowMode
+{
+  DRRWindowFullRange = 0,  // 图像的最小值和最大值
+  DRRWindowPercentile,     // 直方图的百分位, 排除金属等少数极亮的像素
+  DRRWindowFixed,          // 固定的窗位和窗宽(原始DRR值), 不随图像变化
+};
+
+// 区间内的灰度变换
+enum DRRIntensityTransform
+{
+  DRRIntensityLinear = 0,
+  DRRIntensityLog,          // 255 * log(1 + 255t) / log(256), 拉开低值
+  DRRIntensityExponential,  // 255 * (256^t - 1) / 255, 拉开高值
+};
+
+struct DRROutputWindow
+{
+  DRRWindowMode mode = DRRWindowFullRange;
+  double percentiles[2]{0.5, 99.5};  // DRRWindowPercentile的下/上百分位(%)
+  double level = 0.0, width = 0.0;   // DRRWindowFixed的窗位和窗宽
+  DRRIntensityTransform transform = DRRIntensityLinear;
+
+  bool operator==(const DRROutputWindow& other) const
+  {
+    return mode == other.mode && percentiles[0] == other.percentiles[0] &&
+           percentiles[1] == other.percentiles[1] && level == other.level && width == other.width &&
+           transform == other.transform;
+  }
+};
+
+// 流式输出的一个行带, 行序与GetOutput相同(已上下翻转), 数据只在sink调用期间有效
+struct DRROutputBand
+{
+  int firstRow = 0;                       // 在输出图像中的起始行
+  int rowCount = 0;
+  int width = 0;                          // 每行的像素数, 即Size[0]
+  const short* raw = nullptr;             // 未做灰度映射的DRR值
+  const unsigned char* mapped = nullptr;  // 按固定窗口映射后的灰度, 非DRRWindowFixed时为空
+};
+
+// 接收行带的回调, 返回false时停止渲染
+typedef std::function<bool(const DRROutputBand&)> DRROutputSink;
+
+// Update(DRRRenderToken&)的结果
+enum DRRRenderStatus
+{
+  DRRRenderCompleted = 0,
+  DRRRenderCancelled,  // 被Cancel中止, 图像中只有已完成的block是有效的
+  DRRRenderTimedOut,   // 超过了截止时间, 同上
+  DRRRenderFailed,     // 没有输入等原因未能渲染
+};
+
+// 一次渲染的取消标记和进度. 调用者可以在任意线程中Cancel和读取进度, 工作线程在block之间检查标记,
+// 每完成一个block累加计数, 都不加锁; 截止时间和回调需在渲染开始前设置
+class DRRRenderToken
+{
+ public:
+  // 在工作线程中调用, 不应阻塞
+  typedef std::function<void(int completed, int total)> ProgressCallback;
+
+  DRRRenderToken() : m_Cancelled(false), m_HasDeadline(false), m_Completed(0), m_Total(0) {}
+
+  void Cancel() { m_Cancelled.store(true, std::memory_order_relaxed); }
+  void SetDeadline(std::chrono::steady_clock::time_point deadline)
+  {
+    m_Deadline = deadline;
+    m_HasDeadline = true;
+  }
+  // 从现在起最多渲染milliseconds毫秒
+  void SetTimeout(double milliseconds)
+  {
+    const std::chrono::duration<double, std::milli> timeout(milliseconds);
+    this->SetDeadline(std::chrono::steady_clock::now() +
+                      std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout));
+  }
+  void SetProgressCallback(ProgressCallback callback) { m_Callback = std::move(callback); }
+  // 清除取消标记, 截止时间和进度, 以便再次使用; 不能在渲染期间调用
+  void Reset()
+  {
+    m_Cancelled = false;
+    m_HasDeadline = false;
+    m_Completed = 0;
+    m_Total = 0;
+  }
+
+  bool IsCancelled() const { return m_Cancelled.load(std::memory_order_relaxed); }
+  bool IsTimedOut() const { return m_HasDeadline && std::chrono::steady_clock::now() >= m_Deadline; }
+  bool ShouldStop() const { return this->IsCancelled() || this->IsTimedOut(); }
+  // 已完成的和总共的block数(按slab遍历时每个slab的每个block各计一次), 总数在渲染过程中确定
+  int GetCompletedTiles() const { return m_Completed.load(std::memory_order_relaxed); }
+  int GetTotalTiles() const { return m_Total.load(std::memory_order_relaxed); }
+  double GetProgress() const
+  {
+    const int total = this->GetTotalTiles();
+    return total > 0 ? std::min(1.0, static_cast<double>(this->GetCompletedTiles()) / total) : 0.0;
+  }
+
+ private:
+  DRRRenderToken(const DRRRenderToken&) = delete;
+  void operator=(const DRRRenderToken&) = delete;
+  friend class DRRGenerator;
+
+  void AddTotal(int tiles) { m_Total.fetch_add(tiles, std::memory_order_relaxed); }
+  void Complete()
+  {
+    const int completed = m_Completed.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (m_Callback) m_Callback(completed, this->GetTotalTiles());
+  }
+
+  std::atomic<bool> m_Cancelled;
+  bool m_HasDeadline;
+  std::chrono::steady_clock::time_point m_Deadline;
+  std::atomic<int> m_Completed;
+  std::atomic<int> m_Total;
+  ProgressCallback m_Callback;
+};
+
+// 最近一次Update的统计信息
+struct DRRRenderStatistics
 {
+  double renderTime = 0.0;                           // Update耗时(ms)
+  int tileCount = 0;                                 // block的个数
+  int threadCount = 0;                               // 工作线程的个数
+  int numaNodeCount = 1;                             // 系统中NUMA节点的个数
+  DRRNuma::Policy numaPolicy = DRRNuma::Off;         // 实际采用的CT放置策略
+  int volumeCopies = 0;                              // 为NUMA放置创建的CT副本数
+  DRRNuma::PageKind pageKind = DRRNuma::SmallPages;  // CT副本所用的页
+  std::vector<int> threadsPerNode;                   // 绑定到每个节点上的线程数
+  DRRProjector projector = DRRSiddon;                // 实际采用的投影方式
+  int contentBox[6]{0, 0, 0, 0, 0, 0};               // 高于阈值的体素的包围盒(体素索引, 上界不含)
+  int culledTileCount = 0;                           // 与包围盒的投影不相交, 直接填0的block数
+  bool warped = false;                               // 结果由上一次精确渲染经二维变换得到(近似值)
+  int retracedPixelCount = 0;                        // 二维变换无法覆盖, 重新遍历的像素数
+  int contiguousAxis = 0;                            // 遍历所用的CT副本中连续存放的轴
+  int interiorRayCount = 0;                          // 使用不判断边界的遍历内核的射线数(按slab遍历时每段计一次)
+};
+
+// 一次渲染的上下文: 位姿, 探测器, 渲染选项和输出. CT及其派生数据保存在共享的DRRVolume中,
+// 多个DRRGenerator可以在不同线程中同时渲染同一个DRRVolume; 同一个DRRGenerator不能被多个线程同时使用.
+// 上下文本身只保存参数和结果, 渲染用的临时缓冲在第一次Update时分配, 见SetScratch
+class VTK_SLICER_DRRGENERATOR_MODULE_LOGIC_EXPORT DRRGenerator
+{
+ public:
+  // 渲染的临时缓冲, 见SetScratch
+  struct Scratch;
+
  private:
   DRRGenerator(const DRRGenerator&) = delete;
   void operator=(const DRRGenerator&) = delete;
 
+  // Siddon算法中一条射线的遍历状态, 可以在slab边界暂停并在下一个slab继续
+  struct RayState
+  {
+    float alphaX, alphaY, alphaZ;     // 射线下一次穿过X/Y/Z平面时的参数值
+    float alphaUx, alphaUy, alphaUz;  // 相邻两个平面之间的参数增量
+    float alphaCmin, alphaMax;        // 当前位置以及离开CT时的参数值
+    float d12;                        // 已累加的线积分
+    int cIndex[3];                    // 当前体素的索引
+    int iU, jU, kU;                   // 体素索引的步进方向
+    int slab;                         // 射线当前所在的slab, -1表示已遍历完毕
+    float length;                     // 射线从光源到成像平面的长度(mm)
+  };
+
+  // 最近一次精确渲染的结果及其参数, 增量模式以它为二维变换的源
+  struct ExactFrame
+  {
+    std::vector<short> image;
+    Eigen::Matrix4d transform;  // 渲染时的相机坐标到LPS坐标的转换矩阵
+    double threshold;
+    double sourceToDetectorDistance;
+    int size[3];
+    double spacing[3];
+    DRREncodedVolume::Encoding encoding;
+    DRRSuperSampling superSampling;
+    vtkTimeStamp time;
+  };
+
+  // 一个像素除DRR以外的输出, 为空表示不计算(PixelOutput()即全部为空)
+  struct PixelOutput
+  {
+    float* labels;  // 每个标签的线积分
+    float* bins;    // 每个能量bin的线积分, DRRSpectrum::MaxBins个
+  };
+
   void ComputeTransform();
   void Initialize();
-  short Evaluate(Eigen::Vector4d& point);
+  void Prepare();
+  void AllocateOutput();
+  short Evaluate(Eigen::Vector4d& point, const PixelOutput& output = PixelOutput());
+  void InitRay(Eigen::Vector4d& point, RayState& ray);
+  void InitRay(const Eigen::Vector3d& drrWorld, RayState& ray);
+  void UpdateSampleOffsets();
+  DRRProjector UpdateAxisProjector();
+  bool TraceRay(RayState& ray, int kmin, int kmax, const PixelOutput& output = PixelOutput());
+  template <typename Sampler>
+  bool TraceChannels(RayState& ray, int kmin, int kmax, const Sampler& sample, const PixelOutput& output);
+  // 每条射线(按slab遍历时每段)选择一次下面遍历内核的特化版本
+  template <typename Sampler, typename Accumulator>
+  bool TraceKernel(RayState& ray, int kmin, int kmax, const Sampler& sample, const Accumulator& accumulate);
+  // Slabbed为false时忽略kmin/kmax, Interior为true时不判断体素索引是否在CT内
+  template <bool Slabbed, bool Interior, typename Sampler, typename Accumulator>
+  bool TraceRay(RayState& ray, int kmin, int kmax, const Sampler& sample, const Accumulator& accumulate);
+  // 射线从当前状态遍历到结束所经过的体素索引是否一定都在CT内
+  bool RayInside(const RayState& ray) const;
+  // 一个工作线程的局部直方图, 只有[minimum, maximum]范围内的bin非零
+  struct PartialHistogram
+  {
+    std::vector<uint32_t> bins;
+    int minimum, maximum;
+    void Allocate();
+    void Add(const short* pixels, size_t count);
+  };
+
+  PixelOutput PixelChannels(size_t pixel);
+  // histogram为true时, 每个block算完后由同一线程把它的像素计入局部直方图; 只计算jmin <= j < jmax的block,
+  // jmax为-1时到Size[1]为止. renderToken要求停止时不再领取新的block, 返回false
+  bool RunTiles(const std::function<void(int, int, int, int)>& func, bool histogram = false, int jmin = 0,
+                int jmax = -1);
+  void RenderTile(int imin, int imax, int jmin, int jmax);
+  void MergeHistograms();
+  bool UpdateSlabs();
+  void UpdateEncoding();
+  void UpdateNumaPlacement();
+  void UpdatePermutedVolume();
+  void UpdateContentBox();
+  void UpdateTileCulling();
+  bool CullTile(int imin, int imax, int jmin, int jmax);
+  void UpdateProjection();
+  const short* LocalVolume();
   void Rx(double isocenter[3], double angle, Eigen::Matrix4d& out);
   void Ry(double isocenter[3], double angle, Eigen::Matrix4d& out);
   void Rz(double isocenter[3], double angle, Eigen::Matrix4d& out);
   void ThreadedRequestData(int imin, int imax, int jmin, int jmax);
+  bool UpdateWarp();
+  void WarpTile(int imin, int imax, int jmin, int jmax);
 
   void ImageToCamera(int i, int j, Eigen::Vector4d& camPos);
   void ImageToCamera(int i, int j, double camPos[3]);
@@ -39,15 +303,58 @@ class DRRGenerator
   int m_VolumeSize[3];                // CT图像的Size
   double m_VolumeSpacing[3];          // CT图像的Spacing
   int m_BlockSize;                    //  每个线程计算blockSize*blockSize大小的区域
+  int m_ThreadCount;                  // 工作线程数, 0表示使用全部核心
   int row, col;                       // 共有row * col 个block
+  int m_SlabThickness;                // 按slab遍历时每个slab的层数, 0表示自动选择
+  bool m_Readahead;                   // 按slab遍历时是否向操作系统发出预读提示
   double sourceWorld[3];              // 相机原点在LPS下的坐标
-  short* volumePointer;               // CT体数据的数据指针
+  std::shared_ptr<const DRRVolume> m_Volume;  // 共享的CT, 以下几项取自它
+  const short* volumePointer;         // CT体数据的数据指针
+  const DRRMappedVolume* m_MappedVolume;  // 内存映射的CT(由m_Volume持有), 非空时按slab顺序遍历
+  DRREncodedVolume::Encoding m_VolumeEncoding;  // 遍历时使用的CT编码方式
+  std::shared_ptr<const DRREncodedVolume> encodedVolume;  // 编码后的CT
+  DRRNuma::Policy m_NumaPolicy;                 // CT在NUMA节点间的放置策略
+  bool m_HugePages;                             // NUMA副本是否尽量使用大页
+  std::vector<std::shared_ptr<DRRNuma::Buffer>> volumeReplicas;  // 按节点放置的CT
+  bool m_PermutedVolumes;                       // 是否按射线的主方向选用轴置换后的CT副本
+  std::shared_ptr<const std::vector<short>> permutedVolume;  // 本次遍历所用的副本, 为空时使用原数据
+  size_t permutedStrides[3];                    // 副本中沿X/Y/Z前进一个体素的步长
+  DRRRenderStatistics statistics;
+  std::vector<int> labelValues;              // 每个通道对应的标签值
+  std::vector<unsigned char> labelChannels;  // 每个体素所属的通道(从1开始, 0表示不属于任何通道)
+  std::vector<float> channelImage;           // 每个像素每个通道的线积分, 按像素交错存放
+  bool m_Spectral;                           // 是否同时计算多能谱投影
+  DRRSpectrum m_Spectrum;                    // 能量bin及CT值到线衰减系数的表
+  std::vector<float> spectralImage;          // 每个像素合成后的有效线积分
+  DRRSuperSampling m_SuperSampling;          // 每个像素的子采样方式
+  std::vector<Eigen::Vector3d> sampleOffsets;  // 子射线的成像点相对像素中心的偏移(LPS), 单采样时为空
+  bool m_FastProjection;                       // 几何满足条件时是否使用轴对齐的快速投影
+  DRRAxisProjector axisProjector;
+  bool m_ContentClipping;                      // 是否按包围盒裁剪射线并剔除错过包围盒的block
+  float clipBox[6];                            // 包围盒外扩一个体素后的LPS范围(xmin,xmax,ymin,...), 射线只在其中遍历
+  bool cullTiles;                              // 包围盒完全位于光源前方时才能按投影剔除block
+  double contentRect[4];                       // 包围盒在DRR上投影的外接矩形(imin,imax,jmin,jmax), 像素索引
+  std::atomic<int> culledTiles;                // 本次Update中剔除的block数
+  bool m_Incremental;                          // 位姿只在成像平面内变化时, 对上一次精确结果做二维变换
+  std::unique_ptr<ExactFrame> exactFrame;      // 只在增量模式下保存
+  Eigen::Matrix<double, 2, 3> warpMatrix;      // 当前探测器坐标(x, y, 1)到精确帧探测器坐标的变换
+  std::atomic<int> retracedPixels;             // 本次Update中重新遍历的像素数
+  bool m_KernelSpecialization;                 // 是否按射线选用特化的遍历内核
+  std::atomic<int> interiorRays;               // 本次Update中使用不判断边界的内核的射线数
+  DRRRenderToken* renderToken;                 // 本次Update的取消标记和进度, 为空表示不可取消
+  DRROutputWindow m_OutputWindow;              // GetOutput的灰度映射
+  std::shared_ptr<Scratch> m_Scratch;          // 渲染的临时缓冲, 第一次Update时分配
+  std::vector<uint32_t> histogram;             // 最近一次Update结果的直方图, 值v在bin v - VTK_SHORT_MIN
+  int histogramRange[2];                       // 结果的最小值和最大值
   short* imagePointer;                // DRR图像的数据指针
   size_t volumeLength;                // CT体素的个数
   Eigen::Matrix4d m_Transform;        // 相机坐标到LPS坐标的转换矩阵
+  Eigen::Matrix<double, 3, 4> m_LPSToCamera;  // LPS坐标到相机坐标的转换, 投影点时缓存
   vtkSmartPointer<vtkImageData> m_DRR;
   vtkTimeStamp updateTime;
   vtkTimeStamp modifyTime;
+  vtkTimeStamp inputTime;
+  vtkTimeStamp projectionTime;
 
  public:
   DRRGenerator();
@@ -65,6 +372,61 @@ class DRRGenerator
   VelSetMacro(BlockSize, int);
   VelGetMacro(BlockSize, int);
 
+  VelSetMacro(ThreadCount, int);
+  VelGetMacro(ThreadCount, int);
+
+  // 渲染的临时缓冲(按slab遍历时的射线状态, 各工作线程的局部直方图, 各能量bin的线积分), 跨Update复用.
+  // 不设置时第一次Update分配; 在同一线程中轮流渲染的多个上下文可以共用一份, 但不能同时用于两次渲染
+  static std::shared_ptr<Scratch> NewScratch();
+  void SetScratch(std::shared_ptr<Scratch> scratch) { m_Scratch = std::move(scratch); }
+
+  VelSetMacro(SlabThickness, int);
+  VelGetMacro(SlabThickness, int);
+
+  VelSetMacro(Readahead, bool);
+  VelGetMacro(Readahead, bool);
+
+  // 以紧凑编码代替short体数据进行遍历, 减少访存量, 会引入一定的量化误差
+  VelSetMacro(VolumeEncoding, DRREncodedVolume::Encoding);
+  VelGetMacro(VolumeEncoding, DRREncodedVolume::Encoding);
+
+  // 多路服务器上把CT复制或交错到各NUMA节点, 并把工作线程绑定到节点
+  VelSetMacro(NumaPolicy, DRRNuma::Policy);
+  VelGetMacro(NumaPolicy, DRRNuma::Policy);
+
+  VelSetMacro(HugePages, bool);
+  VelGetMacro(HugePages, bool);
+
+  // 原数据只有沿X的遍历是连续访存, 射线主要沿Y或Z前进时改用以该轴为最快变化轴的CT副本(第一次需要时生成,
+  // 每个副本与CT一样大, 由共享的DRRVolume保存). 仅用于未编码的内存中CT, 启用NUMA放置或按slab遍历时不使用
+  VelSetMacro(PermutedVolumes, bool);
+  VelGetMacro(PermutedVolumes, bool);
+
+  // 抗锯齿: 每个像素取多条子射线的平均值
+  VelSetMacro(SuperSampling, DRRSuperSampling);
+  VelGetMacro(SuperSampling, DRRSuperSampling);
+
+  // 正侧位(相机角度为90°的整数倍且CT无旋转)时改用shear-warp或前缀和投影, 其余情况仍使用Siddon.
+  // 仅用于未编码的内存中CT, 且不计算标签/能谱通道, 不超采样
+  VelSetMacro(FastProjection, bool);
+  VelGetMacro(FastProjection, bool);
+
+  // Siddon遍历时射线只在高于阈值的体素的包围盒内前进, 投影完全落在包围盒之外的block直接置0, 结果不变.
+  // 关闭时射线遍历整个CT且不剔除block, 仅用于验证和比较性能
+  VelSetMacro(ContentClipping, bool);
+  VelGetMacro(ContentClipping, bool);
+
+  // 交互时的增量模式: 与上一次精确渲染相比, 位姿只差平行于探测器的平移和绕射束轴的旋转时,
+  // 对其结果做二维变换, 只重新遍历变换后没有覆盖的边缘像素. 平移按isocenter处的放大率换算, 因此结果是近似的,
+  // 交互结束后应关闭增量模式再Update一次. 计算标签/能谱通道时不使用
+  VelSetMacro(Incremental, bool);
+  VelGetMacro(Incremental, bool);
+
+  // 射线的遍历范围(经包围盒裁剪后)一定在CT内时使用不判断边界的遍历内核, 结果与通用内核完全相同.
+  // 关闭时所有射线使用通用内核, 仅用于验证和比较性能
+  VelSetMacro(KernelSpecialization, bool);
+  VelGetMacro(KernelSpecialization, bool);
+
   VelSetVector3Macro(Isocenter, double);
   VelGetVector3Macro(Isocenter, double);
 
@@ -85,9 +447,51 @@ class DRRGenerator
 
   VelGetMacro(Transform, Eigen::Matrix4d);
 
+  void SetPose(const DRRPose& pose);
+  DRRPose GetPose();
+
+  // 与其他DRRGenerator共享同一份CT
+  void SetVolume(std::shared_ptr<const DRRVolume> volume);
+  std::shared_ptr<const DRRVolume> GetVolume() const { return m_Volume; }
+  // 以下几种输入在CT变化时创建新的DRRVolume
   void SetInputData(vtkImageData* image, double spacing[3] = nullptr);
+  void SetInputData(const short* data, const int dims[3], const double spacing[3]);
+  // 使用内存映射的CT作为输入, 射线按slab顺序访问体数据. 持有volume的引用, 见DRRVolume::New
+  void SetInputData(std::shared_ptr<const DRRMappedVolume> volume);
   vtkSmartPointer<vtkImageData> GetOutput();
+  // 与CT对齐的标签图, 渲染时每个非零标签额外输出一个通道(最多255个), nullptr表示取消
+  bool SetLabelData(vtkImageData* labels);
+  const std::vector<int>& GetLabelValues() const { return labelValues; }
+  // 各标签的线积分(float, 通道顺序同GetLabelValues), 未设置标签图时返回nullptr
+  vtkSmartPointer<vtkImageData> GetLabelOutput();
+  // 多能谱投影: 低于Threshold的体素视为空气, 结果为各bin按能谱合成后的有效线积分(float)
+  VelSetMacro(Spectral, bool);
+  VelGetMacro(Spectral, bool);
+  DRRSpectrum& GetSpectrum() { return m_Spectrum; }
+  vtkSmartPointer<vtkImageData> GetSpectralOutput();
+  // 灰度映射只影响GetOutput, 改变它不需要重新Update
+  void SetOutputWindow(const DRROutputWindow& window) { m_OutputWindow = window; }
+  const DRROutputWindow& GetOutputWindow() const { return m_OutputWindow; }
+  // 最近一次Update在渲染过程中统计的直方图, 每个short值一个bin(下标为值 - VTK_SHORT_MIN)
+  const std::vector<uint32_t>& GetHistogram() const { return histogram; }
+  // 按当前灰度映射得到的查找表: 值v映射为lut[clamp(v - low, 0, lut.size() - 1)]
+  void GetOutputLookupTable(std::vector<unsigned char>& lut, int& low) const;
+  // Update得到的short类型DRR(未做灰度映射和翻转), 大小为Size[0] * Size[1]; UpdateStreaming之后为空
+  const short* GetRawOutput() const { return imagePointer; }
+  // 当前编码的误差和每个体素的字节数
+  const DRREncodedVolume& GetEncodedVolume();
+  const DRRRenderStatistics& GetStatistics() const { return statistics; }
   void GetFiducialPosition(double point3D[3], double point2D[2]);
+  // 批量投影: points3D为count个LPS坐标(x0,y0,z0,x1,...), points2D输出count个DRR图像坐标(i0,j0,i1,...)
+  void ProjectPoints(const double* points3D, size_t count, double* points2D);
 
   void Update();
+  // 可取消的渲染: 工作线程在block之间检查token, 取消或超时后不再领取新的block, 立即返回.
+  // 未完成时图像中只有已完成的block有效, 也不作为增量模式的源
+  DRRRenderStatus Update(DRRRenderToken& token);
+  // 流式输出: 按输出图像的行序逐个渲染约bandRows行(取BlockSize的整数倍, 0为一个block)的行带,
+  // 后处理后交给sink, 同时渲染下一个行带. 不分配整幅图像, 峰值内存只有几个行带, 适用于很大的探测器.
+  // 直方图照常统计, 结束后可由GetOutputLookupTable得到自动窗口. 不计算标签/能谱通道, 不使用增量模式和slab遍历,
+  // GetOutput和GetRawOutput之后返回空. sink中途返回false或参数不支持时返回false
+  bool UpdateStreaming(const DRROutputSink& sink, int bandRows = 0);
 };
\ No newline at end of file
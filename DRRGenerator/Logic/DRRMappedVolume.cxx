@@ -0,0 +1,546 @@
+#include "DRRMappedVolume.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+std::string Trim(const std::string& str)
+{
+  size_t begin = str.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos) return "";
+  size_t end = str.find_last_not_of(" \t\r\n");
+  return str.substr(begin, end - begin + 1);
+}
+
+std::string ToLower(std::string str)
+{
+  std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return std::tolower(c); });
+  return str;
+}
+
+std::string Directory(const std::string& fileName)
+{
+  size_t pos = fileName.find_last_of("/\\");
+  return pos == std::string::npos ? "" : fileName.substr(0, pos + 1);
+}
+
+std::string Extension(const std::string& fileName)
+{
+  size_t pos = fileName.find_last_of('.');
+  return pos == std::string::npos ? "" : ToLower(fileName.substr(pos + 1));
+}
+
+// 把"(1,0,0) (0,1,0)"或"1 0 0"之类的字符串解析为数字序列
+std::vector<double> ParseNumbers(const std::string& str)
+{
+  std::string cleaned = str;
+  for (char& c : cleaned)
+    if (c == '(' || c == ')' || c == ',') c = ' ';
+  std::vector<double> numbers;
+  std::istringstream stream(cleaned);
+  std::string token;
+  while (stream >> token)
+  {
+    // NRRD中用"none"表示没有该值
+    numbers.push_back(token == "none" || token == "nan" ? 0.0 : std::atof(token.c_str()));
+  }
+  return numbers;
+}
+
+bool IsLittleEndian()
+{
+  const uint16_t probe = 1;
+  return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+}
+
+// 文件的修改时间, 大小和inode(Windows上只有前两项)组合成的标识, 文件不存在时为0
+uint64_t FileStamp(const std::string& fileName)
+{
+  uint64_t fields[4]{0, 0, 0, 0};
+#ifdef _WIN32
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+  if (!GetFileAttributesExA(fileName.c_str(), GetFileExInfoStandard, &attributes)) return 0;
+  fields[0] = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) |
+              attributes.ftLastWriteTime.dwLowDateTime;
+  fields[1] = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+#else
+  struct stat fileStat;
+  if (stat(fileName.c_str(), &fileStat) != 0) return 0;
+#ifdef __APPLE__
+  const struct timespec& modified = fileStat.st_mtimespec;
+#else
+  const struct timespec& modified = fileStat.st_mtim;
+#endif
+  fields[0] = static_cast<uint64_t>(modified.tv_sec) * 1000000000u + static_cast<uint64_t>(modified.tv_nsec);
+  fields[1] = static_cast<uint64_t>(fileStat.st_size);
+  fields[2] = static_cast<uint64_t>(fileStat.st_ino);
+  fields[3] = static_cast<uint64_t>(fileStat.st_dev);
+#endif
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (uint64_t field : fields)
+    for (int i = 0; i < 8; i++)
+    {
+      hash ^= (field >> (8 * i)) & 0xff;
+      hash *= 0x100000001b3ull;
+    }
+  return hash;
+}
+
+uint64_t FileStamp(const std::string& headerFile, const std::string& dataFile)
+{
+  const uint64_t stamp = FileStamp(dataFile);
+  return headerFile == dataFile ? stamp : stamp ^ (FileStamp(headerFile) * 0x100000001b3ull);
+}
+}  // namespace
+
+DRRMappedVolume::DRRMappedVolume()
+    : m_Dimensions{0, 0, 0},
+      m_Spacing{1., 1., 1.},
+      m_Origin{0., 0., 0.},
+      m_FileStamp(0),
+      m_Mapping(nullptr),
+      m_MappingLength(0),
+      m_Data(nullptr),
+#ifdef _WIN32
+      m_FileHandle(INVALID_HANDLE_VALUE),
+      m_MappingHandle(nullptr)
+#else
+      m_FileDescriptor(-1)
+#endif
+{
+}
+
+DRRMappedVolume::~DRRMappedVolume()
+{
+  this->Close();
+}
+
+bool DRRMappedVolume::Open(const std::string& fileName)
+{
+  this->Close();
+  std::string dataFile;
+  size_t offset = 0;
+  std::string extension = Extension(fileName);
+  bool ok = false;
+  if (extension == "nrrd" || extension == "nhdr")
+  {
+    ok = this->ReadNrrdHeader(fileName, dataFile, offset);
+  }
+  else if (extension == "mha" || extension == "mhd")
+  {
+    ok = this->ReadMetaHeader(fileName, dataFile, offset);
+  }
+  else
+  {
+    std::cerr << "Unsupported volume file " << fileName << ", use OpenRaw for headerless data" << std::endl;
+  }
+  if (!ok) return false;
+
+  if (offset % sizeof(short) != 0)
+  {
+    std::cerr << "Voxel data in " << fileName << " starts at odd offset " << offset
+              << ", save the volume with a detached header (.nhdr/.mhd) to map it" << std::endl;
+    return false;
+  }
+  m_FileName = fileName;
+  return this->Map(dataFile, offset);
+}
+
+bool DRRMappedVolume::OpenRaw(const std::string& fileName, const int dimensions[3], const double spacing[3],
+                              size_t headerSize)
+{
+  this->Close();
+  for (int i = 0; i < 3; i++)
+  {
+    m_Dimensions[i] = dimensions[i];
+    m_Spacing[i] = spacing[i];
+    m_Origin[i] = 0.0;
+  }
+  if (headerSize % sizeof(short) != 0)
+  {
+    std::cerr << "Header size " << headerSize << " of " << fileName << " is not aligned to short" << std::endl;
+    return false;
+  }
+  m_FileName = fileName;
+  return this->Map(fileName, headerSize);
+}
+
+bool DRRMappedVolume::ReadNrrdHeader(const std::string& fileName, std::string& dataFile, size_t& offset)
+{
+  std::ifstream file(fileName, std::ios::binary);
+  std::string line;
+  if (!file || !std::getline(file, line) || line.compare(0, 4, "NRRD") != 0)
+  {
+    std::cerr << fileName << " is not a NRRD file" << std::endl;
+    return false;
+  }
+
+  std::string type, encoding = "raw", endian = "little";
+  int dimension = 0;
+  size_t byteSkip = 0;
+  bool hasSpacing = false;
+  while (std::getline(file, line))
+  {
+    line = Trim(line);
+    if (line.empty()) break;  // 空行之后是数据
+    if (line[0] == '#') continue;
+    size_t pos = line.find(':');
+    if (pos == std::string::npos) continue;
+    std::string key = ToLower(Trim(line.substr(0, pos)));
+    std::string value = Trim(line.substr(pos + 1));
+    if (!value.empty() && value[0] == '=') value = Trim(value.substr(1));  // key:=value
+
+    if (key == "type")
+    {
+      type = ToLower(value);
+    }
+    else if (key == "dimension")
+    {
+      dimension = std::atoi(value.c_str());
+    }
+    else if (key == "sizes")
+    {
+      std::vector<double> sizes = ParseNumbers(value);
+      for (size_t i = 0; i < 3 && i < sizes.size(); i++) m_Dimensions[i] = static_cast<int>(sizes[i]);
+    }
+    else if (key == "spacings")
+    {
+      std::vector<double> spacings = ParseNumbers(value);
+      for (size_t i = 0; i < 3 && i < spacings.size(); i++) m_Spacing[i] = spacings[i];
+      hasSpacing = true;
+    }
+    else if (key == "space directions" && !hasSpacing)
+    {
+      // 每个轴的方向向量的模即为该轴的spacing
+      std::vector<double> directions = ParseNumbers(value);
+      for (size_t i = 0; i < 3 && 3 * i + 2 < directions.size(); i++)
+      {
+        m_Spacing[i] = std::sqrt(directions[3 * i] * directions[3 * i] +
+                                 directions[3 * i + 1] * directions[3 * i + 1] +
+                                 directions[3 * i + 2] * directions[3 * i + 2]);
+      }
+    }
+    else if (key == "space origin")
+    {
+      std::vector<double> origin = ParseNumbers(value);
+      for (size_t i = 0; i < 3 && i < origin.size(); i++) m_Origin[i] = origin[i];
+    }
+    else if (key == "encoding")
+    {
+      encoding = ToLower(value);
+    }
+    else if (key == "endian")
+    {
+      endian = ToLower(value);
+    }
+    else if (key == "byte skip")
+    {
+      byteSkip = static_cast<size_t>(std::max(0, std::atoi(value.c_str())));
+    }
+    else if (key == "data file" || key == "datafile")
+    {
+      dataFile = value[0] == '/' ? value : Directory(fileName) + value;
+    }
+  }
+
+  if (type != "short" && type != "int16" && type != "int16_t" && type != "signed short" &&
+      type != "short int" && type != "signed short int")
+  {
+    std::cerr << fileName << ": only short voxels can be mapped, got \"" << type << "\"" << std::endl;
+    return false;
+  }
+  if (dimension != 3)
+  {
+    std::cerr << fileName << ": expected a 3D volume, got dimension " << dimension << std::endl;
+    return false;
+  }
+  if (encoding != "raw")
+  {
+    std::cerr << fileName << ": encoding \"" << encoding << "\" cannot be mapped, use raw" << std::endl;
+    return false;
+  }
+  if ((endian == "little") != IsLittleEndian())
+  {
+    std::cerr << fileName << ": byte order does not match this machine" << std::endl;
+    return false;
+  }
+
+  if (dataFile.empty())
+  {
+    dataFile = fileName;
+    offset = static_cast<size_t>(file.tellg()) + byteSkip;
+  }
+  else
+  {
+    offset = byteSkip;
+  }
+  return true;
+}
+
+bool DRRMappedVolume::ReadMetaHeader(const std::string& fileName, std::string& dataFile, size_t& offset)
+{
+  std::ifstream file(fileName, std::ios::binary);
+  if (!file)
+  {
+    std::cerr << "Cannot open " << fileName << std::endl;
+    return false;
+  }
+
+  std::string line, type;
+  int dimension = 0;
+  size_t headerSize = 0;
+  bool compressed = false, bigEndian = false;
+  while (std::getline(file, line))
+  {
+    size_t pos = line.find('=');
+    if (pos == std::string::npos) continue;
+    std::string key = Trim(line.substr(0, pos));
+    std::string value = Trim(line.substr(pos + 1));
+
+    if (key == "NDims")
+    {
+      dimension = std::atoi(value.c_str());
+    }
+    else if (key == "DimSize")
+    {
+      std::vector<double> sizes = ParseNumbers(value);
+      for (size_t i = 0; i < 3 && i < sizes.size(); i++) m_Dimensions[i] = static_cast<int>(sizes[i]);
+    }
+    else if (key == "ElementSpacing" || key == "ElementSize")
+    {
+      std::vector<double> spacings = ParseNumbers(value);
+      for (size_t i = 0; i < 3 && i < spacings.size(); i++) m_Spacing[i] = spacings[i];
+    }
+    else if (key == "Offset" || key == "Origin" || key == "Position")
+    {
+      std::vector<double> origin = ParseNumbers(value);
+      for (size_t i = 0; i < 3 && i < origin.size(); i++) m_Origin[i] = origin[i];
+    }
+    else if (key == "ElementType")
+    {
+      type = value;
+    }
+    else if (key == "CompressedData")
+    {
+      compressed = ToLower(value) == "true";
+    }
+    else if (key == "BinaryDataByteOrderMSB" || key == "ElementByteOrderMSB")
+    {
+      bigEndian = ToLower(value) == "true";
+    }
+    else if (key == "HeaderSize")
+    {
+      headerSize = static_cast<size_t>(std::max(0, std::atoi(value.c_str())));
+    }
+    else if (key == "ElementDataFile")
+    {
+      // ElementDataFile必须是文件头的最后一项, LOCAL表示数据紧跟在文件头之后
+      if (value == "LOCAL")
+      {
+        dataFile = fileName;
+        offset = static_cast<size_t>(file.tellg());
+      }
+      else
+      {
+        dataFile = value[0] == '/' ? value : Directory(fileName) + value;
+        offset = headerSize;
+      }
+      break;
+    }
+  }
+
+  if (type != "MET_SHORT")
+  {
+    std::cerr << fileName << ": only MET_SHORT voxels can be mapped, got \"" << type << "\"" << std::endl;
+    return false;
+  }
+  if (dimension != 3 || dataFile.empty())
+  {
+    std::cerr << fileName << ": expected a 3D volume with ElementDataFile" << std::endl;
+    return false;
+  }
+  if (compressed)
+  {
+    std::cerr << fileName << ": compressed data cannot be mapped" << std::endl;
+    return false;
+  }
+  if (bigEndian == IsLittleEndian())
+  {
+    std::cerr << fileName << ": byte order does not match this machine" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool DRRMappedVolume::Map(const std::string& dataFile, size_t offset)
+{
+  size_t dataLength = static_cast<size_t>(m_Dimensions[0]) * m_Dimensions[1] * m_Dimensions[2] * sizeof(short);
+  if (dataLength == 0)
+  {
+    std::cerr << dataFile << ": empty volume" << std::endl;
+    return false;
+  }
+
+#ifdef _WIN32
+  HANDLE fileHandle = CreateFileA(dataFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (fileHandle == INVALID_HANDLE_VALUE)
+  {
+    std::cerr << "Cannot open " << dataFile << std::endl;
+    return false;
+  }
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(fileHandle, &fileSize);
+  m_FileHandle = fileHandle;
+  m_MappingLength = static_cast<size_t>(fileSize.QuadPart);
+  if (m_MappingLength < offset + dataLength)
+  {
+    std::cerr << dataFile << " is too small for a " << m_Dimensions[0] << "x" << m_Dimensions[1] << "x"
+              << m_Dimensions[2] << " volume" << std::endl;
+    this->Close();
+    return false;
+  }
+  m_MappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  m_Mapping = m_MappingHandle ? MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+  m_FileDescriptor = ::open(dataFile.c_str(), O_RDONLY);
+  if (m_FileDescriptor < 0)
+  {
+    std::cerr << "Cannot open " << dataFile << std::endl;
+    return false;
+  }
+  struct stat fileStat;
+  fstat(m_FileDescriptor, &fileStat);
+  m_MappingLength = static_cast<size_t>(fileStat.st_size);
+  if (m_MappingLength < offset + dataLength)
+  {
+    std::cerr << dataFile << " is too small for a " << m_Dimensions[0] << "x" << m_Dimensions[1] << "x"
+              << m_Dimensions[2] << " volume" << std::endl;
+    this->Close();
+    return false;
+  }
+  m_Mapping = mmap(nullptr, m_MappingLength, PROT_READ, MAP_SHARED, m_FileDescriptor, 0);
+  if (m_Mapping == MAP_FAILED) m_Mapping = nullptr;
+#endif
+
+  if (!m_Mapping)
+  {
+    std::cerr << "Cannot map " << dataFile << std::endl;
+    this->Close();
+    return false;
+  }
+  m_Data = reinterpret_cast<const short*>(static_cast<const char*>(m_Mapping) + offset);
+  m_DataFile = dataFile;
+  m_FileStamp = FileStamp(m_FileName, m_DataFile);
+  return true;
+}
+
+void DRRMappedVolume::Close()
+{
+#ifdef _WIN32
+  if (m_Mapping) UnmapViewOfFile(m_Mapping);
+  if (m_MappingHandle) CloseHandle(m_MappingHandle);
+  if (m_FileHandle != INVALID_HANDLE_VALUE) CloseHandle(m_FileHandle);
+  m_MappingHandle = nullptr;
+  m_FileHandle = INVALID_HANDLE_VALUE;
+#else
+  if (m_Mapping) munmap(m_Mapping, m_MappingLength);
+  if (m_FileDescriptor >= 0) ::close(m_FileDescriptor);
+  m_FileDescriptor = -1;
+#endif
+  m_Mapping = nullptr;
+  m_MappingLength = 0;
+  m_Data = nullptr;
+  m_FileStamp = 0;
+}
+
+bool DRRMappedVolume::IsOpen() const
+{
+  return m_Data != nullptr;
+}
+
+const short* DRRMappedVolume::GetData() const
+{
+  return m_Data;
+}
+
+const int* DRRMappedVolume::GetDimensions() const
+{
+  return m_Dimensions;
+}
+
+const double* DRRMappedVolume::GetSpacing() const
+{
+  return m_Spacing;
+}
+
+const double* DRRMappedVolume::GetOrigin() const
+{
+  return m_Origin;
+}
+
+const std::string& DRRMappedVolume::GetFileName() const
+{
+  return m_FileName;
+}
+
+uint64_t DRRMappedVolume::GetFileStamp() const
+{
+  return m_FileStamp;
+}
+
+bool DRRMappedVolume::IsCurrent() const
+{
+  return this->IsOpen() && FileStamp(m_FileName, m_DataFile) == m_FileStamp;
+}
+
+void DRRMappedVolume::WillNeed(int zmin, int zmax) const
+{
+  this->Advise(zmin, zmax, true);
+}
+
+void DRRMappedVolume::DontNeed(int zmin, int zmax) const
+{
+  this->Advise(zmin, zmax, false);
+}
+
+void DRRMappedVolume::Advise(int zmin, int zmax, bool willNeed) const
+{
+#ifndef _WIN32
+  zmin = std::max(zmin, 0);
+  zmax = std::min(zmax, m_Dimensions[2]);
+  if (!m_Data || zmin >= zmax) return;
+
+  // madvise要求起始地址按页对齐, 向外扩展到整页
+  const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t sliceLength = static_cast<size_t>(m_Dimensions[0]) * m_Dimensions[1] * sizeof(short);
+  const char* base = static_cast<const char*>(m_Mapping);
+  size_t begin = static_cast<size_t>(reinterpret_cast<const char*>(m_Data) - base) + zmin * sliceLength;
+  size_t end = begin + (zmax - zmin) * sliceLength;
+  begin -= begin % pageSize;
+  end = std::min(end, m_MappingLength);
+  madvise(const_cast<char*>(base) + begin, end - begin, willNeed ? MADV_WILLNEED : MADV_DONTNEED);
+#else
+  (void)zmin;
+  (void)zmax;
+  (void)willNeed;
+#endif
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 以只读内存映射的方式打开磁盘上的CT体数据(raw/NRRD/MHA), 体数据不会整体读入内存,
+// 而是在射线访问时由操作系统按页调入, 从而可以处理大于物理内存的CT.
+// 仅支持未压缩, 小端, short类型的体数据.
+class DRRMappedVolume
+{
+ private:
+  DRRMappedVolume(const DRRMappedVolume&) = delete;
+  void operator=(const DRRMappedVolume&) = delete;
+
+  bool ReadNrrdHeader(const std::string& fileName, std::string& dataFile, size_t& offset);
+  bool ReadMetaHeader(const std::string& fileName, std::string& dataFile, size_t& offset);
+  bool Map(const std::string& dataFile, size_t offset);
+  void Advise(int zmin, int zmax, bool willNeed) const;
+
+  int m_Dimensions[3];     // CT图像的Size
+  double m_Spacing[3];     // CT图像的Spacing
+  double m_Origin[3];      // CT图像的Origin(LPS)
+  std::string m_FileName;  // 头文件路径
+  std::string m_DataFile;  // 数据文件路径, 与头文件相同或为分离的数据文件
+  uint64_t m_FileStamp;    // 映射时头文件和数据文件的标识(修改时间, 大小, inode)
+  void* m_Mapping;         // 整个数据文件的映射地址
+  size_t m_MappingLength;  // 映射的字节数
+  const short* m_Data;     // 体素数据的起始地址(跳过文件头)
+#ifdef _WIN32
+  void* m_FileHandle;
+  void* m_MappingHandle;
+#else
+  int m_FileDescriptor;
+#endif
+
+ public:
+  DRRMappedVolume();
+  ~DRRMappedVolume();
+
+  // 根据扩展名(.nrrd/.nhdr/.mha/.mhd)解析文件头并映射数据
+  bool Open(const std::string& fileName);
+  // 映射没有文件头的raw文件, headerSize为数据前需要跳过的字节数
+  bool OpenRaw(const std::string& fileName, const int dimensions[3], const double spacing[3],
+               size_t headerSize = 0);
+  void Close();
+  bool IsOpen() const;
+
+  const short* GetData() const;
+  const int* GetDimensions() const;
+  const double* GetSpacing() const;
+  const double* GetOrigin() const;
+  const std::string& GetFileName() const;
+  // 映射时文件的标识, 同一文件名被改写或替换后标识不同; 用于区分先后映射的同名文件
+  uint64_t GetFileStamp() const;
+  // 磁盘上的文件是否仍与映射时相同; 被替换的文件原映射仍指向旧数据, 需要重新Open
+  bool IsCurrent() const;
+
+  // 预读提示: 告知操作系统即将访问第[zmin, zmax)层
+  void WillNeed(int zmin, int zmax) const;
+  // 释放提示: 第[zmin, zmax)层已访问完毕, 对应页可以被回收
+  void DontNeed(int zmin, int zmax) const;
+};
@@ -0,0 +1,195 @@
+#include "DRRNuma.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+const size_t HugePageSize = size_t(2) << 20;
+
+// 系统的页大小, arm64和ppc64le的内核可能使用16K或64K的页
+size_t SmallPageSize()
+{
+#ifdef __linux__
+  return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+  return 4096;
+#endif
+}
+
+// 解析"0-3,8-11"形式的CPU/节点列表
+std::vector<int> ParseList(const std::string& list)
+{
+  std::vector<int> values;
+  std::stringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ','))
+  {
+    if (range.find_first_of("0123456789") == std::string::npos) continue;
+    size_t dash = range.find('-');
+    int first = std::atoi(range.c_str());
+    int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+    for (int i = first; i <= last; i++) values.push_back(i);
+  }
+  return values;
+}
+
+std::vector<std::vector<int>> ReadTopology()
+{
+  std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+  std::ifstream online("/sys/devices/system/node/online");
+  std::string list;
+  if (online && std::getline(online, list))
+  {
+    for (int node : ParseList(list))
+    {
+      std::ifstream cpuFile("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      std::string cpus;
+      if (cpuFile && std::getline(cpuFile, cpus) && !ParseList(cpus).empty())
+      {
+        nodes.push_back(ParseList(cpus));
+      }
+    }
+  }
+#endif
+  if (nodes.empty()) nodes.push_back({});  // 单节点, 不限制CPU
+  return nodes;
+}
+
+std::shared_ptr<DRRNuma::Buffer> Allocate(size_t length, bool hugePages)
+{
+#ifdef __linux__
+  if (hugePages)
+  {
+    size_t hugeLength = (length + HugePageSize - 1) / HugePageSize * HugePageSize;
+    void* data = mmap(nullptr, hugeLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data != MAP_FAILED) return std::make_shared<DRRNuma::Buffer>(data, hugeLength, DRRNuma::HugeTLBPages);
+
+    // 没有预留的大页时退回到透明大页
+    data = mmap(nullptr, hugeLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) return nullptr;
+    bool transparent = madvise(data, hugeLength, MADV_HUGEPAGE) == 0;
+    return std::make_shared<DRRNuma::Buffer>(data, hugeLength,
+                                             transparent ? DRRNuma::TransparentHugePages : DRRNuma::SmallPages);
+  }
+  void* data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return data == MAP_FAILED ? nullptr : std::make_shared<DRRNuma::Buffer>(data, length, DRRNuma::SmallPages);
+#else
+  (void)hugePages;
+  return std::make_shared<DRRNuma::Buffer>(::operator new(length), length, DRRNuma::SmallPages);
+#endif
+}
+
+// 在绑定到node的若干线程中执行func(thread, threadCount)
+template <typename Func>
+void RunOnNode(int node, Func func)
+{
+  const std::vector<int>& cpus = DRRNuma::GetNodeCPUs()[node];
+  const int threadCount = std::max(1, std::min(8, static_cast<int>(cpus.size())));
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threadCount; t++)
+  {
+    pool.emplace_back(
+        [=]()
+        {
+          DRRNuma::BindCurrentThread(node);
+          func(t, threadCount);
+        });
+  }
+  for (auto& thread : pool) thread.join();
+}
+}  // namespace
+
+DRRNuma::Buffer::Buffer(void* data, size_t length, PageKind pages) : m_Data(data), m_Length(length), m_Pages(pages)
+{
+}
+
+DRRNuma::Buffer::~Buffer()
+{
+#ifdef __linux__
+  munmap(m_Data, m_Length);
+#else
+  ::operator delete(m_Data);
+#endif
+}
+
+int DRRNuma::GetNodeCount()
+{
+  return static_cast<int>(GetNodeCPUs().size());
+}
+
+const std::vector<std::vector<int>>& DRRNuma::GetNodeCPUs()
+{
+  static const std::vector<std::vector<int>> topology = ReadTopology();
+  return topology;
+}
+
+bool DRRNuma::BindCurrentThread(int node)
+{
+#ifdef __linux__
+  const std::vector<std::vector<int>>& nodes = GetNodeCPUs();
+  if (node < 0 || node >= static_cast<int>(nodes.size()) || nodes[node].empty()) return false;
+  cpu_set_t cpuSet;
+  CPU_ZERO(&cpuSet);
+  for (int cpu : nodes[node])
+    if (cpu < CPU_SETSIZE) CPU_SET(cpu, &cpuSet);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#else
+  (void)node;
+  return false;
+#endif
+}
+
+std::shared_ptr<DRRNuma::Buffer> DRRNuma::CopyToNode(const void* source, size_t length, int node, bool hugePages)
+{
+  std::shared_ptr<Buffer> buffer = Allocate(length, hugePages);
+  if (!buffer) return nullptr;
+  // 由绑定在node上的线程首次写入, 页面即分配在node本地
+  char* data = static_cast<char*>(const_cast<void*>(buffer->GetData()));
+  RunOnNode(node,
+            [&](int thread, int threadCount)
+            {
+              size_t begin = length * thread / threadCount, end = length * (thread + 1) / threadCount;
+              memcpy(data + begin, static_cast<const char*>(source) + begin, end - begin);
+            });
+  return buffer;
+}
+
+std::shared_ptr<DRRNuma::Buffer> DRRNuma::CopyInterleaved(const void* source, size_t length, bool hugePages)
+{
+  std::shared_ptr<Buffer> buffer = Allocate(length, hugePages);
+  if (!buffer) return nullptr;
+  char* data = static_cast<char*>(const_cast<void*>(buffer->GetData()));
+  // 按实际的页交错, 否则一页中的几段都由节点0首次写入, 整个副本都在节点0上
+  const size_t pageSize = buffer->GetPageKind() == SmallPages ? SmallPageSize() : HugePageSize;
+  const size_t pageCount = (length + pageSize - 1) / pageSize;
+  const int nodeCount = GetNodeCount();
+  // 第p页由节点p % nodeCount上的线程首次写入
+  for (int node = 0; node < nodeCount; node++)
+  {
+    RunOnNode(node,
+              [&](int thread, int threadCount)
+              {
+                for (size_t page = node + static_cast<size_t>(thread) * nodeCount; page < pageCount;
+                     page += static_cast<size_t>(threadCount) * nodeCount)
+                {
+                  size_t begin = page * pageSize, end = std::min(length, begin + pageSize);
+                  memcpy(data + begin, static_cast<const char*>(source) + begin, end - begin);
+                }
+              });
+  }
+  return buffer;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// NUMA拓扑查询, 线程绑定以及按节点分配内存.
+// 不依赖libnuma: 拓扑从/sys/devices/system/node读取, 内存通过绑定到目标节点的线程
+// 首次写入(first touch)来放置. 非Linux平台上视为只有一个节点.
+class DRRNuma
+{
+ public:
+  enum Policy
+  {
+    Off = 0,     // 不做任何处理, CT留在首次写入它的节点上
+    Replicate,   // 每个节点一份CT副本, 线程读取本节点的副本
+    Interleave,  // 一份CT, 按页轮流放置在各节点上
+  };
+
+  enum PageKind
+  {
+    SmallPages = 0,
+    TransparentHugePages,  // madvise(MADV_HUGEPAGE)
+    HugeTLBPages,          // mmap(MAP_HUGETLB), 需要系统预留大页
+  };
+
+  // 按节点放置的一块内存, 析构时释放
+  class Buffer
+  {
+   public:
+    Buffer(void* data, size_t length, PageKind pages);
+    ~Buffer();
+    const void* GetData() const { return m_Data; }
+    PageKind GetPageKind() const { return m_Pages; }
+
+   private:
+    Buffer(const Buffer&) = delete;
+    void operator=(const Buffer&) = delete;
+    void* m_Data;
+    size_t m_Length;
+    PageKind m_Pages;
+  };
+
+  // 节点个数以及每个节点上的CPU
+  static int GetNodeCount();
+  static const std::vector<std::vector<int>>& GetNodeCPUs();
+  // 把当前线程绑定到node的CPU上
+  static bool BindCurrentThread(int node);
+  // 把source复制到node本地的内存中
+  static std::shared_ptr<Buffer> CopyToNode(const void* source, size_t length, int node, bool hugePages);
+  // 把source复制到按页在所有节点间交错放置的内存中
+  static std::shared_ptr<Buffer> CopyInterleaved(const void* source, size_t length, bool hugePages);
+};
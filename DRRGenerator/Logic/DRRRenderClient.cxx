@@ -0,0 +1,145 @@
+#include "DRRRenderClient.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+DRRRenderClient::DRRRenderClient() : m_Socket(-1), m_Frames(nullptr), m_FramesLength(0)
+{
+  memset(&m_Hello, 0, sizeof(m_Hello));
+}
+
+DRRRenderClient::~DRRRenderClient()
+{
+  this->Close();
+}
+
+const short* DRRRenderClient::GetFrame(uint32_t slot) const
+{
+  if (!m_Frames || slot >= m_Hello.slotCount) return nullptr;
+  return reinterpret_cast<const short*>(m_Frames + slot * m_Hello.slotBytes);
+}
+
+#ifndef _WIN32
+bool DRRRenderClient::Connect(const std::string& socketPath)
+{
+  this->Close();
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+  {
+    std::cerr << "Invalid socket path " << socketPath << std::endl;
+    return false;
+  }
+  strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+  m_Socket = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_Socket < 0 || connect(m_Socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+  {
+    std::cerr << "Cannot connect to " << socketPath << ": " << strerror(errno) << std::endl;
+    this->Close();
+    return false;
+  }
+  if (!this->ReceiveAll(&m_Hello, sizeof(m_Hello)) || m_Hello.magic != DRRRenderProtocol::Magic ||
+      m_Hello.version != DRRRenderProtocol::Version)
+  {
+    std::cerr << "Unexpected handshake from " << socketPath << std::endl;
+    this->Close();
+    return false;
+  }
+
+  m_Hello.sharedMemory[sizeof(m_Hello.sharedMemory) - 1] = '\0';
+  int fd = shm_open(m_Hello.sharedMemory, O_RDONLY, 0);
+  m_FramesLength = static_cast<size_t>(m_Hello.slotCount) * m_Hello.slotBytes;
+  void* mapping = fd >= 0 ? mmap(nullptr, m_FramesLength, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  if (fd >= 0) close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    std::cerr << "Cannot map shared memory " << m_Hello.sharedMemory << ": " << strerror(errno) << std::endl;
+    this->Close();
+    return false;
+  }
+  m_Frames = static_cast<const char*>(mapping);
+  return true;
+}
+
+void DRRRenderClient::Close()
+{
+  if (m_Frames) munmap(const_cast<char*>(m_Frames), m_FramesLength);
+  if (m_Socket >= 0) close(m_Socket);
+  m_Frames = nullptr;
+  m_FramesLength = 0;
+  m_Socket = -1;
+}
+
+bool DRRRenderClient::Send(DRRRenderRequest request)
+{
+  if (m_Socket < 0) return false;
+  request.magic = DRRRenderProtocol::Magic;
+  const char* data = reinterpret_cast<const char*>(&request);
+  size_t length = sizeof(request);
+  while (length > 0)
+  {
+    const ssize_t sent = send(m_Socket, data, length, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) continue;
+    if (sent <= 0) return false;
+    data += sent;
+    length -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+bool DRRRenderClient::Receive(DRRRenderReply& reply)
+{
+  return m_Socket >= 0 && this->ReceiveAll(&reply, sizeof(reply)) && reply.magic == DRRRenderProtocol::Magic;
+}
+
+bool DRRRenderClient::ReceiveAll(void* data, size_t length)
+{
+  char* bytes = static_cast<char*>(data);
+  while (length > 0)
+  {
+    const ssize_t received = recv(m_Socket, bytes, length, 0);
+    if (received < 0 && errno == EINTR) continue;
+    if (received <= 0) return false;
+    bytes += received;
+    length -= static_cast<size_t>(received);
+  }
+  return true;
+}
+#else
+bool DRRRenderClient::Connect(const std::string&)
+{
+  std::cerr << "The render client requires Unix-domain sockets" << std::endl;
+  return false;
+}
+
+void DRRRenderClient::Close()
+{
+}
+
+bool DRRRenderClient::Send(DRRRenderRequest)
+{
+  return false;
+}
+
+bool DRRRenderClient::Receive(DRRRenderReply&)
+{
+  return false;
+}
+
+bool DRRRenderClient::ReceiveAll(void*, size_t)
+{
+  return false;
+}
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "DRRRenderProtocol.h"
+
+#include <cstddef>
+#include <string>
+
+// DRRRenderServer的客户端(仅Linux/POSIX), 供Slicer之外的程序使用.
+// Send与Receive可以交错调用: 先连续发送多个请求(使用不同的slot), 再逐个接收回复, 服务端会把它们攒成一批渲染
+class DRRRenderClient
+{
+ public:
+  DRRRenderClient();
+  ~DRRRenderClient();
+
+  // 连接服务端并映射该连接的共享内存
+  bool Connect(const std::string& socketPath);
+  void Close();
+  bool IsConnected() const { return m_Socket >= 0; }
+  const DRRServerHello& GetHello() const { return m_Hello; }
+
+  // 发送一个请求, magic由本函数填写
+  bool Send(DRRRenderRequest request);
+  // 阻塞直到收到下一个回复
+  bool Receive(DRRRenderReply& reply);
+  // 共享内存中的第slot帧, 内容在收到对应请求的回复之后有效
+  const short* GetFrame(uint32_t slot) const;
+
+ private:
+  DRRRenderClient(const DRRRenderClient&) = delete;
+  void operator=(const DRRRenderClient&) = delete;
+
+  bool ReceiveAll(void* data, size_t length);
+
+  int m_Socket;             // 与服务端的连接
+  DRRServerHello m_Hello;   // 服务端发来的连接信息
+  const char* m_Frames;     // 共享内存的映射地址
+  size_t m_FramesLength;    // 共享内存的字节数
+};
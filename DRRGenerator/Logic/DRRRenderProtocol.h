@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+// DRRRenderServer与客户端之间的二进制协议(Unix域套接字, 本机字节序, 定长消息):
+// 1. 连接建立后服务端先发送一个DRRServerHello, 其中给出该连接专用的共享内存的名字和帧数;
+// 2. 客户端发送任意多个DRRRenderRequest, 不必等待回复;
+// 3. 服务端对每个请求回复一个DRRRenderReply, 回复顺序与请求顺序无关, 以id对应.
+// 结果图像不经过套接字, 而是写入共享内存中由请求指定的帧(slot), 内容同DRRGenerator::GetRawOutput.
+// 客户端负责分配slot: 一个slot在收到对应的回复之前不应被再次请求, 收到回复之后可以一直读到再次请求为止.
+namespace DRRRenderProtocol
+{
+const uint32_t Magic = 0x44525253;  // "DRRS"
+const uint32_t Version = 1;
+const int SharedMemoryNameLength = 64;
+
+enum Status : int32_t
+{
+  Ok = 0,
+  BadRequest,     // magic不符或参数无效
+  BadVolume,      // volume超出服务端加载的CT个数
+  BadSlot,        // slot超出共享内存的帧数
+  FrameTooLarge,  // Size[0] * Size[1]的short图像放不进一帧
+};
+}  // namespace DRRRenderProtocol
+
+struct DRRServerHello
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t volumeCount;  // 服务端加载的CT个数, 请求中以0 ~ volumeCount - 1指定
+  uint32_t slotCount;    // 共享内存中的帧数
+  uint64_t slotBytes;    // 每帧的字节数
+  char sharedMemory[DRRRenderProtocol::SharedMemoryNameLength];  // 共享内存的名字(shm_open)
+};
+
+struct DRRRenderRequest
+{
+  uint32_t magic;
+  uint32_t id;      // 由客户端指定, 在回复中原样返回
+  uint32_t volume;  // 使用第几个CT
+  uint32_t slot;    // 结果写入共享内存中的第几帧
+  double angle;           // 相机绕病人Z轴旋转的角度(弧度)
+  double rotation[3];     // Volume绕isocenter旋转的角度(弧度)
+  double translation[3];  // Volume相对isocenter平移的距离(mm)
+  double sourceToDetectorDistance;
+  double threshold;
+  int32_t size[2];    // DRR图像的size
+  double spacing[2];  // DRR图像的spacing
+};
+
+struct DRRRenderReply
+{
+  uint32_t magic;
+  uint32_t id;
+  int32_t status;  // DRRRenderProtocol::Status
+  uint32_t slot;
+  int32_t size[2];
+  double queueTime;   // 请求在服务端排队等待的时间(ms)
+  double renderTime;  // 渲染耗时(ms)
+};
@@ -0,0 +1,561 @@
+#include "DRRRenderServer.h"
+#include "DRRGenerator.h"
+#include "DRRMappedVolume.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <tuple>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+const size_t DefaultSlotBytes = 1024 * 1024 * sizeof(short);  // 1024x1024的DRR
+
+double Milliseconds(std::chrono::steady_clock::duration duration)
+{
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+#ifndef _WIN32
+// 非阻塞套接字上发送全部数据, 对端已关闭时返回false
+bool SendAll(int socket, const char* data, size_t length)
+{
+  while (length > 0)
+  {
+    const ssize_t sent = send(socket, data, length, MSG_NOSIGNAL);
+    if (sent > 0)
+    {
+      data += sent;
+      length -= static_cast<size_t>(sent);
+    }
+    else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      pollfd writable{socket, POLLOUT, 0};
+      if (poll(&writable, 1, 1000) <= 0) return false;
+    }
+    else if (sent < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SetNonBlocking(int socket)
+{
+  const int flags = fcntl(socket, F_GETFL, 0);
+  return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+#endif
+}  // namespace
+
+// 一个客户端连接及其专用的共享内存, 由收发线程和尚未完成的请求共同持有, 最后一个持有者释放它
+struct DRRRenderServer::Connection
+{
+  int socket = -1;
+  std::string sharedMemory;  // 共享内存的名字
+  char* frames = nullptr;    // 共享内存的映射地址
+  size_t length = 0;         // 共享内存的字节数
+  size_t slotBytes = 0;
+  std::string input;       // 已收到但还不够一个请求的字节
+  std::mutex writeMutex;   // 收发线程和分批线程都会发送回复
+  bool broken = false;     // 曾有回复未能完整发出, 之后的回复与客户端不再对齐; 由writeMutex保护
+
+  char* GetFrame(uint32_t slot) { return frames + slot * slotBytes; }
+
+  // 发送回复; 失败时关闭连接的读写两端, 收发线程随后在poll中看到挂断并丢弃该连接
+  bool Send(const std::string& data)
+  {
+    std::lock_guard<std::mutex> lock(writeMutex);
+#ifndef _WIN32
+    if (!broken && !SendAll(socket, data.data(), data.size()))
+    {
+      broken = true;
+      shutdown(socket, SHUT_RDWR);
+    }
+#endif
+    return !broken;
+  }
+
+  ~Connection()
+  {
+#ifndef _WIN32
+    if (frames) munmap(frames, length);
+    if (!sharedMemory.empty()) shm_unlink(sharedMemory.c_str());
+    if (socket >= 0) close(socket);
+#endif
+  }
+};
+
+DRRRenderServer::DRRRenderServer()
+    : m_ListenSocket(-1),
+      m_WorkerCount(0),
+      m_ThreadCount(1),
+      m_MaxBatchSize(32),
+      m_BatchWindow(1.0),
+      m_SlotCount(8),
+      m_SlotBytes(DefaultSlotBytes),
+      m_ReportInterval(10.0),
+      m_Stopping(false),
+      m_BatchSerial(0),
+      m_BusyWorkers(0),
+      m_ErrorCount(0),
+      m_BatchCount(0),
+      m_StatisticsBegin(std::chrono::steady_clock::now())
+{
+}
+
+DRRRenderServer::~DRRRenderServer()
+{
+#ifndef _WIN32
+  if (m_ListenSocket >= 0)
+  {
+    close(m_ListenSocket);
+    unlink(m_SocketPath.c_str());
+  }
+#endif
+}
+
+bool DRRRenderServer::AddVolume(const std::string& fileName)
+{
+  // 通过内存映射解析文件头, 数据读入内存后即可关闭文件, 渲染时走内存中CT的路径
+  DRRMappedVolume mapped;
+  if (!mapped.Open(fileName)) return false;
+  const int* dims = mapped.GetDimensions();
+  auto data = std::make_shared<std::vector<short>>(mapped.GetData(),
+                                                   mapped.GetData() + static_cast<size_t>(dims[0]) * dims[1] * dims[2]);
+  this->AddVolume(DRRVolume::New(data->data(), dims, mapped.GetSpacing()));
+  m_VolumeData.push_back(data);
+  return true;
+}
+
+void DRRRenderServer::AddVolume(std::shared_ptr<const DRRVolume> volume)
+{
+  m_Volumes.push_back(volume);
+}
+
+bool DRRRenderServer::Validate(const Pending& pending, DRRRenderReply& reply) const
+{
+  const DRRRenderRequest& request = pending.request;
+  reply = DRRRenderReply();
+  reply.magic = DRRRenderProtocol::Magic;
+  reply.id = request.id;
+  reply.slot = request.slot;
+  reply.size[0] = request.size[0];
+  reply.size[1] = request.size[1];
+  if (request.magic != DRRRenderProtocol::Magic || request.size[0] <= 0 || request.size[1] <= 0 ||
+      !(request.spacing[0] > 0) || !(request.spacing[1] > 0) || !(request.sourceToDetectorDistance > 0))
+  {
+    reply.status = DRRRenderProtocol::BadRequest;
+  }
+  else if (request.volume >= m_Volumes.size())
+  {
+    reply.status = DRRRenderProtocol::BadVolume;
+  }
+  else if (request.slot >= static_cast<uint32_t>(m_SlotCount))
+  {
+    reply.status = DRRRenderProtocol::BadSlot;
+  }
+  else if (static_cast<uint64_t>(request.size[0]) * static_cast<uint64_t>(request.size[1]) * sizeof(short) >
+           m_SlotBytes)
+  {
+    reply.status = DRRRenderProtocol::FrameTooLarge;
+  }
+  else
+  {
+    reply.status = DRRRenderProtocol::Ok;
+  }
+  return reply.status == DRRRenderProtocol::Ok;
+}
+
+void DRRRenderServer::BatchMain(int workerCount)
+{
+  const auto window = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double, std::milli>(m_BatchWindow));
+  const size_t maxBatchSize = static_cast<size_t>(std::max(1, m_MaxBatchSize));
+  std::vector<Pending> batch;
+  while (true)
+  {
+    {
+      // Stop可能来自信号处理函数, 无法唤醒条件变量, 因此定时检查
+      std::unique_lock<std::mutex> lock(m_QueueMutex);
+      while (m_Queue.empty() && !m_Stopping) m_QueueCondition.wait_for(lock, std::chrono::milliseconds(100));
+      if (m_Stopping) break;
+      // 攒批: 直到请求数达到上限, 或者第一个请求已等待了BatchWindow
+      m_QueueCondition.wait_until(lock, m_Queue.front().received + window,
+                                  [&] { return m_Queue.size() >= maxBatchSize || m_Stopping; });
+      const size_t count = std::min(m_Queue.size(), maxBatchSize);
+      batch.assign(std::make_move_iterator(m_Queue.begin()), std::make_move_iterator(m_Queue.begin() + count));
+      m_Queue.erase(m_Queue.begin(), m_Queue.begin() + count);
+    }
+
+    // 相同CT和几何参数的请求排在一起, 分到同一个worker时DRRGenerator不需要重新初始化
+    std::stable_sort(batch.begin(), batch.end(),
+                     [](const Pending& a, const Pending& b)
+                     {
+                       const DRRRenderRequest &x = a.request, &y = b.request;
+                       return std::tie(x.volume, x.size[0], x.size[1], x.spacing[0], x.spacing[1],
+                                       x.sourceToDetectorDistance, x.threshold) <
+                              std::tie(y.volume, y.size[0], y.size[1], y.spacing[0], y.spacing[1],
+                                       y.sourceToDetectorDistance, y.threshold);
+                     });
+    {
+      std::unique_lock<std::mutex> lock(m_BatchMutex);
+      m_Batch.swap(batch);
+      m_BatchSerial++;
+      m_BusyWorkers = workerCount;
+      m_BatchStart.notify_all();
+      m_BatchDone.wait(lock, [this] { return m_BusyWorkers == 0; });
+      batch.swap(m_Batch);
+    }
+    this->Reply(batch);
+    batch.clear();
+  }
+}
+
+void DRRRenderServer::WorkerMain(int index, int workerCount)
+{
+  // 每个CT一个渲染上下文, 只保存参数和结果; 它们在本线程中轮流渲染, 共用一份临时缓冲
+  std::vector<std::unique_ptr<DRRGenerator>> contexts(m_Volumes.size());
+  const std::shared_ptr<DRRGenerator::Scratch> scratch = DRRGenerator::NewScratch();
+  for (size_t volume = 0; volume < m_Volumes.size(); volume++)
+  {
+    contexts[volume].reset(new DRRGenerator);
+    contexts[volume]->SetVolume(m_Volumes[volume]);
+    contexts[volume]->SetThreadCount(m_ThreadCount);
+    contexts[volume]->SetScratch(scratch);
+  }
+  uint64_t serial = 0;
+  while (true)
+  {
+    size_t first, last;
+    {
+      std::unique_lock<std::mutex> lock(m_BatchMutex);
+      m_BatchStart.wait(lock, [&] { return m_BatchSerial != serial || m_Stopping; });
+      if (m_BatchSerial == serial) break;
+      serial = m_BatchSerial;
+      first = m_Batch.size() * index / workerCount;
+      last = m_Batch.size() * (index + 1) / workerCount;
+    }
+    // 分批线程在所有worker完成之前不会改动m_Batch
+    for (size_t i = first; i < last; i++) this->Render(m_Batch[i], contexts);
+    std::lock_guard<std::mutex> lock(m_BatchMutex);
+    if (--m_BusyWorkers == 0) m_BatchDone.notify_one();
+  }
+}
+
+void DRRRenderServer::Render(Pending& pending, std::vector<std::unique_ptr<DRRGenerator>>& contexts)
+{
+  const DRRRenderRequest& request = pending.request;
+  std::unique_ptr<DRRGenerator>& generator = contexts[request.volume];
+
+  auto begin = std::chrono::steady_clock::now();
+  generator->SetSourceToDetectorDistance(request.sourceToDetectorDistance);
+  generator->SetThreshold(request.threshold);
+  generator->SetSize(request.size[0], request.size[1], 1);
+  generator->SetSpacing(request.spacing[0], request.spacing[1], 1.0);
+  DRRPose pose;
+  pose.angle = request.angle;
+  std::copy(request.rotation, request.rotation + 3, pose.rotation);
+  std::copy(request.translation, request.translation + 3, pose.translation);
+  generator->SetPose(pose);
+  generator->Update();
+  memcpy(pending.connection->GetFrame(request.slot), generator->GetRawOutput(),
+         static_cast<size_t>(request.size[0]) * request.size[1] * sizeof(short));
+
+  pending.reply.queueTime = Milliseconds(begin - pending.received);
+  pending.reply.renderTime = Milliseconds(std::chrono::steady_clock::now() - begin);
+}
+
+DRRRenderServer::Statistics DRRRenderServer::TakeStatistics()
+{
+  std::vector<double> latencies;
+  Statistics result;
+  auto now = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lock(m_StatisticsMutex);
+    latencies.swap(m_Latencies);
+    result.errorCount = m_ErrorCount;
+    result.batchCount = m_BatchCount;
+    result.throughput = latencies.size() / std::max(1e-9, Milliseconds(now - m_StatisticsBegin) / 1000.0);
+    m_ErrorCount = 0;
+    m_BatchCount = 0;
+    m_StatisticsBegin = now;
+  }
+  result.requestCount = latencies.size();
+  if (latencies.empty()) return result;
+
+  auto percentile = [&](double fraction)
+  {
+    const size_t rank = static_cast<size_t>(std::ceil(fraction * latencies.size()));
+    auto nth = latencies.begin() + (std::max<size_t>(rank, 1) - 1);
+    std::nth_element(latencies.begin(), nth, latencies.end());
+    return *nth;
+  };
+  result.p50 = percentile(0.5);
+  result.p99 = percentile(0.99);
+  return result;
+}
+
+void DRRRenderServer::Report()
+{
+  const Statistics statistics = this->TakeStatistics();
+  if (statistics.requestCount == 0 && statistics.errorCount == 0) return;
+  std::cout << "Served " << statistics.requestCount << " requests in " << statistics.batchCount << " batches, p50 "
+            << statistics.p50 << " ms, p99 " << statistics.p99 << " ms, " << statistics.throughput << " requests/s";
+  if (statistics.errorCount > 0) std::cout << ", " << statistics.errorCount << " rejected";
+  std::cout << std::endl;
+}
+
+#ifndef _WIN32
+bool DRRRenderServer::Listen(const std::string& socketPath)
+{
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+  {
+    std::cerr << "Invalid socket path " << socketPath << std::endl;
+    return false;
+  }
+  strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    std::cerr << "Cannot create socket: " << strerror(errno) << std::endl;
+    return false;
+  }
+  unlink(socketPath.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, 64) != 0 ||
+      !SetNonBlocking(fd))
+  {
+    std::cerr << "Cannot listen on " << socketPath << ": " << strerror(errno) << std::endl;
+    close(fd);
+    return false;
+  }
+  if (m_ListenSocket >= 0)
+  {
+    close(m_ListenSocket);
+    unlink(m_SocketPath.c_str());
+  }
+  m_ListenSocket = fd;
+  m_SocketPath = socketPath;
+  return true;
+}
+
+void DRRRenderServer::Run()
+{
+  if (m_ListenSocket < 0)
+  {
+    std::cerr << "Render server is not listening" << std::endl;
+    return;
+  }
+  // worker之间按核心数平分线程
+  const int hardwareThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int workerCount = m_WorkerCount > 0 ? m_WorkerCount : hardwareThreads;
+  m_ThreadCount = std::max(1, hardwareThreads / workerCount);
+  m_Stopping = false;
+  this->TakeStatistics();
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < workerCount; i++) workers.emplace_back(&DRRRenderServer::WorkerMain, this, i, workerCount);
+  std::thread batcher(&DRRRenderServer::BatchMain, this, workerCount);
+  if (m_ReportInterval > 0)
+  {
+    std::cout << "Serving " << m_Volumes.size() << " volumes on " << m_SocketPath << " with " << workerCount
+              << " workers" << std::endl;
+  }
+
+  std::vector<std::shared_ptr<Connection>> connections;
+  auto lastReport = std::chrono::steady_clock::now();
+  while (!m_Stopping)
+  {
+    std::vector<pollfd> descriptors{{m_ListenSocket, POLLIN, 0}};
+    for (const auto& connection : connections) descriptors.push_back({connection->socket, POLLIN, 0});
+    const int ready = poll(descriptors.data(), descriptors.size(), 100);
+    if (ready < 0 && errno != EINTR)
+    {
+      std::cerr << "poll failed: " << strerror(errno) << std::endl;
+      break;
+    }
+    if (ready > 0)
+    {
+      // 先处理已有的连接再接受新连接, 使descriptors与connections的下标保持对应
+      for (size_t i = connections.size(); i-- > 0;)
+      {
+        if ((descriptors[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) && !this->Receive(connections[i]))
+        {
+          connections.erase(connections.begin() + i);
+        }
+      }
+      if (descriptors[0].revents & POLLIN)
+      {
+        std::shared_ptr<Connection> connection = this->Accept();
+        if (connection) connections.push_back(connection);
+      }
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (m_ReportInterval > 0 && Milliseconds(now - lastReport) >= m_ReportInterval * 1000.0)
+    {
+      this->Report();
+      lastReport = now;
+    }
+  }
+
+  m_Stopping = true;
+  m_QueueCondition.notify_all();
+  batcher.join();
+  {
+    std::lock_guard<std::mutex> lock(m_BatchMutex);
+    m_BatchStart.notify_all();
+  }
+  for (auto& worker : workers) worker.join();
+  if (m_ReportInterval > 0) this->Report();
+  std::lock_guard<std::mutex> lock(m_QueueMutex);
+  m_Queue.clear();
+}
+
+std::shared_ptr<DRRRenderServer::Connection> DRRRenderServer::Accept()
+{
+  int fd = accept(m_ListenSocket, nullptr, nullptr);
+  if (fd < 0) return nullptr;
+  auto connection = std::make_shared<Connection>();
+  connection->socket = fd;
+  if (!SetNonBlocking(fd)) return nullptr;
+
+  // 每个连接一块共享内存, 客户端按Hello中的名字映射
+  static std::atomic<int> counter{0};
+  connection->sharedMemory =
+      "/drr-server-" + std::to_string(static_cast<long>(getpid())) + "-" + std::to_string(counter++);
+  connection->slotBytes = (m_SlotBytes + 63) / 64 * 64;
+  connection->length = connection->slotBytes * static_cast<size_t>(std::max(1, m_SlotCount));
+  int shm = shm_open(connection->sharedMemory.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (shm < 0)
+  {
+    std::cerr << "Cannot create shared memory " << connection->sharedMemory << ": " << strerror(errno) << std::endl;
+    connection->sharedMemory.clear();
+    return nullptr;
+  }
+  void* mapping = ftruncate(shm, static_cast<off_t>(connection->length)) == 0
+                      ? mmap(nullptr, connection->length, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0)
+                      : MAP_FAILED;
+  close(shm);
+  if (mapping == MAP_FAILED)
+  {
+    std::cerr << "Cannot map shared memory " << connection->sharedMemory << ": " << strerror(errno) << std::endl;
+    return nullptr;
+  }
+  connection->frames = static_cast<char*>(mapping);
+
+  DRRServerHello hello;
+  memset(&hello, 0, sizeof(hello));
+  hello.magic = DRRRenderProtocol::Magic;
+  hello.version = DRRRenderProtocol::Version;
+  hello.volumeCount = static_cast<uint32_t>(m_Volumes.size());
+  hello.slotCount = static_cast<uint32_t>(std::max(1, m_SlotCount));
+  hello.slotBytes = connection->slotBytes;
+  strncpy(hello.sharedMemory, connection->sharedMemory.c_str(), sizeof(hello.sharedMemory) - 1);
+  if (!SendAll(fd, reinterpret_cast<const char*>(&hello), sizeof(hello))) return nullptr;
+  return connection;
+}
+
+bool DRRRenderServer::Receive(const std::shared_ptr<Connection>& connection)
+{
+  char buffer[4096];
+  bool open = true;
+  while (true)
+  {
+    const ssize_t received = recv(connection->socket, buffer, sizeof(buffer), 0);
+    if (received > 0)
+    {
+      connection->input.append(buffer, static_cast<size_t>(received));
+      continue;
+    }
+    if (received < 0 && errno == EINTR) continue;
+    open = received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    break;
+  }
+
+  const size_t count = connection->input.size() / sizeof(DRRRenderRequest);
+  if (count == 0) return open;
+  auto now = std::chrono::steady_clock::now();
+  std::string rejected;
+  {
+    std::lock_guard<std::mutex> lock(m_QueueMutex);
+    for (size_t i = 0; i < count; i++)
+    {
+      Pending pending;
+      pending.connection = connection;
+      memcpy(&pending.request, connection->input.data() + i * sizeof(DRRRenderRequest), sizeof(DRRRenderRequest));
+      pending.received = now;
+      if (this->Validate(pending, pending.reply))
+      {
+        m_Queue.push_back(std::move(pending));
+      }
+      else
+      {
+        rejected.append(reinterpret_cast<const char*>(&pending.reply), sizeof(DRRRenderReply));
+      }
+    }
+  }
+  connection->input.erase(0, count * sizeof(DRRRenderRequest));
+  m_QueueCondition.notify_one();
+
+  if (!rejected.empty())
+  {
+    open = connection->Send(rejected) && open;
+    std::lock_guard<std::mutex> lock(m_StatisticsMutex);
+    m_ErrorCount += rejected.size() / sizeof(DRRRenderReply);
+  }
+  return open;
+}
+
+void DRRRenderServer::Reply(const std::vector<Pending>& batch)
+{
+  // 同一连接的回复合并成一次发送
+  std::map<Connection*, std::string> replies;
+  for (const Pending& pending : batch)
+  {
+    replies[pending.connection.get()].append(reinterpret_cast<const char*>(&pending.reply), sizeof(DRRRenderReply));
+  }
+  for (auto& reply : replies) reply.first->Send(reply.second);
+
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(m_StatisticsMutex);
+  for (const Pending& pending : batch) m_Latencies.push_back(Milliseconds(now - pending.received));
+  m_BatchCount++;
+}
+#else
+bool DRRRenderServer::Listen(const std::string&)
+{
+  std::cerr << "The render server requires Unix-domain sockets" << std::endl;
+  return false;
+}
+
+void DRRRenderServer::Run()
+{
+}
+
+void DRRRenderServer::Reply(const std::vector<Pending>&)
+{
+}
+#endif
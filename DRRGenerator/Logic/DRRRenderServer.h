@@ -0,0 +1,113 @@
+#pragma once
+
+#include "DRRRenderProtocol.h"
+#include "DRRVolume.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class DRRGenerator;
+
+// 本地渲染服务(仅Linux/POSIX):
+// CT只在启动时加载一次, 客户端通过Unix域套接字按DRRRenderProtocol发送pose请求.
+// 一个线程负责收发消息, 一个线程把同时到达的请求攒成一批(最多等待BatchWindow),
+// 按CT和几何参数排序后分给各worker线程; 每个worker对每个CT有自己的DRRGenerator(共享同一个DRRVolume),
+// 以单线程连续渲染分到的请求, 避免每帧创建线程和重新初始化, 结果写入该连接的共享内存.
+class DRRRenderServer
+{
+ public:
+  // 自上次TakeStatistics以来完成的请求
+  struct Statistics
+  {
+    uint64_t requestCount = 0;  // 成功渲染的请求数
+    uint64_t errorCount = 0;    // 被拒绝的请求数
+    uint64_t batchCount = 0;    // 批数
+    double p50 = 0.0;           // 从收到请求到发出回复的耗时的中位数(ms)
+    double p99 = 0.0;           // 同上, 99%分位数(ms)
+    double throughput = 0.0;    // 每秒完成的请求数
+  };
+
+  DRRRenderServer();
+  ~DRRRenderServer();
+
+  // 读入CT(.nrrd/.nhdr/.mha/.mhd, 未压缩short), 按加载顺序编号; 需在Run之前调用
+  bool AddVolume(const std::string& fileName);
+  void AddVolume(std::shared_ptr<const DRRVolume> volume);
+  size_t GetVolumeCount() const { return m_Volumes.size(); }
+
+  void SetWorkerCount(int count) { m_WorkerCount = count; }
+  void SetMaxBatchSize(int size) { m_MaxBatchSize = size; }
+  void SetBatchWindow(double milliseconds) { m_BatchWindow = milliseconds; }
+  void SetSlotCount(int count) { m_SlotCount = count; }
+  void SetSlotBytes(size_t bytes) { m_SlotBytes = bytes; }
+  void SetReportInterval(double seconds) { m_ReportInterval = seconds; }
+
+  // 在socketPath上监听, 已存在的同名文件会被删除
+  bool Listen(const std::string& socketPath);
+  // 处理连接和请求直到Stop被调用. ReportInterval大于0时每隔ReportInterval秒及退出时向std::cout输出统计,
+  // 为0时不输出任何信息, 统计只能通过TakeStatistics取得
+  void Run();
+  // 只设置标志, 可以在其他线程或信号处理函数中调用
+  void Stop() { m_Stopping = true; }
+
+  Statistics TakeStatistics();
+
+ private:
+  DRRRenderServer(const DRRRenderServer&) = delete;
+  void operator=(const DRRRenderServer&) = delete;
+
+  struct Connection;
+  struct Pending
+  {
+    std::shared_ptr<Connection> connection;
+    DRRRenderRequest request;
+    DRRRenderReply reply;
+    std::chrono::steady_clock::time_point received;
+  };
+
+  std::shared_ptr<Connection> Accept();
+  bool Receive(const std::shared_ptr<Connection>& connection);
+  bool Validate(const Pending& pending, DRRRenderReply& reply) const;
+  void BatchMain(int workerCount);
+  void WorkerMain(int index, int workerCount);
+  void Render(Pending& pending, std::vector<std::unique_ptr<DRRGenerator>>& contexts);
+  void Reply(const std::vector<Pending>& batch);
+  void Report();
+
+  std::vector<std::shared_ptr<const DRRVolume>> m_Volumes;         // 按编号排列的CT
+  std::vector<std::shared_ptr<std::vector<short>>> m_VolumeData;  // 从文件读入的CT数据
+  std::string m_SocketPath;
+  int m_ListenSocket;
+  int m_WorkerCount;      // worker线程数, 0表示与核心数相同
+  int m_ThreadCount;      // 每个worker渲染时使用的线程数
+  int m_MaxBatchSize;     // 每批最多的请求数
+  double m_BatchWindow;   // 收到一批中的第一个请求后最多再等待的时间(ms)
+  int m_SlotCount;        // 每个连接的共享内存帧数
+  size_t m_SlotBytes;     // 每帧的字节数
+  double m_ReportInterval;
+  std::atomic<bool> m_Stopping;
+
+  std::mutex m_QueueMutex;  // 保护m_Queue
+  std::condition_variable m_QueueCondition;
+  std::deque<Pending> m_Queue;  // 已收到, 尚未分批的请求
+
+  std::mutex m_BatchMutex;  // 保护以下的批处理状态
+  std::condition_variable m_BatchStart;
+  std::condition_variable m_BatchDone;
+  std::vector<Pending> m_Batch;  // 当前一批, 第i个worker渲染其中的第i段
+  uint64_t m_BatchSerial;        // 每开始一批加一
+  int m_BusyWorkers;             // 还未完成当前一批的worker数
+
+  std::mutex m_StatisticsMutex;  // 保护以下的统计
+  std::vector<double> m_Latencies;
+  uint64_t m_ErrorCount;
+  uint64_t m_BatchCount;
+  std::chrono::steady_clock::time_point m_StatisticsBegin;
+};
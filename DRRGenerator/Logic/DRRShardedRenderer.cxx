@@ -0,0 +1,420 @@
+#include "DRRShardedRenderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+const uint32_t VolumeMagic = 0x44525256;  // "DRRV"
+const size_t HeaderAlignment = 64;
+
+// 共享内存中CT数据之前的文件头
+struct VolumeHeader
+{
+  uint32_t magic;
+  int dims[3];
+  double spacing[3];
+};
+
+const size_t VolumeDataOffset = (sizeof(VolumeHeader) + HeaderAlignment - 1) / HeaderAlignment * HeaderAlignment;
+
+enum SlotState
+{
+  SlotFree = 0,
+  SlotWriting,
+  SlotReady
+};
+
+// 帧的状态字: 低32位为SlotState, 高32位为写入该帧的worker进程号.
+// worker以一次CAS同时领取帧并记录所有者, 在任何时刻退出都能由协调者找到并回收它占用的帧
+uint64_t SlotWord(SlotState state, int32_t writer = 0)
+{
+  return static_cast<uint64_t>(static_cast<uint32_t>(writer)) << 32 | static_cast<uint32_t>(state);
+}
+
+SlotState StateOf(uint64_t word)
+{
+  return static_cast<SlotState>(word & 0xffffffffu);
+}
+
+// 环形缓冲区中的一帧
+struct Slot
+{
+  std::atomic<uint64_t> state;  // 见SlotWord
+  uint64_t entry;               // 该帧对应本轮待渲染列表中的第几项
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "slot states are shared between processes");
+
+#ifndef _WIN32
+std::string UniqueName(const char* kind)
+{
+  static std::atomic<int> counter{0};
+  return "/drr-" + std::to_string(static_cast<long>(getpid())) + "-" + std::to_string(counter++) + "-" + kind;
+}
+
+// sem_timedwait所用的绝对时刻: 现在之后milliseconds毫秒
+timespec Deadline(long milliseconds)
+{
+  timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += milliseconds / 1000;
+  deadline.tv_nsec += milliseconds % 1000 * 1000 * 1000;
+  if (deadline.tv_nsec >= 1000 * 1000 * 1000)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000 * 1000 * 1000;
+  }
+  return deadline;
+}
+#endif
+}  // namespace
+
+#ifndef _WIN32
+// 本轮渲染的控制块, 之后依次是slotCount个Slot和slotCount帧图像.
+// 帧的归属只由Slot::state决定; freeSlots只用于唤醒等待空闲帧的worker, 不计数,
+// 因此worker在等待和领取之间退出不会使空闲帧丢失
+struct DRRShardedRenderer::Ring
+{
+  sem_t freeSlots;   // 有帧被释放时post
+  sem_t readySlots;  // 已写好等待协调者取走的帧的个数
+  std::atomic<uint64_t> nextEntry;
+  uint64_t entryCount;
+  uint32_t slotCount;
+  uint32_t frameLength;
+
+  static size_t SlotOffset() { return (sizeof(Ring) + HeaderAlignment - 1) / HeaderAlignment * HeaderAlignment; }
+  static size_t FrameOffset(uint32_t slotCount)
+  {
+    return (SlotOffset() + slotCount * sizeof(Slot) + HeaderAlignment - 1) / HeaderAlignment * HeaderAlignment;
+  }
+  static size_t Length(uint32_t slotCount, uint32_t frameLength)
+  {
+    return FrameOffset(slotCount) + static_cast<size_t>(slotCount) * frameLength * sizeof(short);
+  }
+  Slot* GetSlot(uint32_t i) { return reinterpret_cast<Slot*>(reinterpret_cast<char*>(this) + SlotOffset()) + i; }
+  short* GetFrame(uint32_t i)
+  {
+    return reinterpret_cast<short*>(reinterpret_cast<char*>(this) + FrameOffset(slotCount)) +
+           static_cast<size_t>(i) * frameLength;
+  }
+};
+#else
+struct DRRShardedRenderer::Ring
+{
+};
+#endif
+
+DRRShardedRenderer::DRRShardedRenderer()
+    : m_VolumeLength(0),
+      m_Size{256, 256},
+      m_Spacing{1., 1.},
+      m_SourceToDetectorDistance(1000),
+      m_Threshold(0),
+      m_WorkerCount(0),
+      m_BatchSize(4),
+      m_SlotCount(0),
+      m_MaxRetries(1)
+{
+}
+
+DRRShardedRenderer::~DRRShardedRenderer()
+{
+  this->Unpublish();
+}
+
+void DRRShardedRenderer::SetGeometry(double scd, double threshold, const int size[2], const double spacing[2])
+{
+  m_SourceToDetectorDistance = scd;
+  m_Threshold = threshold;
+  m_Size[0] = size[0];
+  m_Size[1] = size[1];
+  m_Spacing[0] = spacing[0];
+  m_Spacing[1] = spacing[1];
+}
+
+#ifndef _WIN32
+bool DRRShardedRenderer::Publish(const short* data, const int dims[3], const double spacing[3])
+{
+  this->Unpublish();
+  const size_t dataLength = static_cast<size_t>(dims[0]) * dims[1] * dims[2] * sizeof(short);
+  std::string name = UniqueName("volume");
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+  {
+    std::cerr << "Cannot create shared memory " << name << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+  const size_t length = VolumeDataOffset + dataLength;
+  void* mapping = ftruncate(fd, static_cast<off_t>(length)) == 0
+                      ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                      : MAP_FAILED;
+  close(fd);
+  if (mapping == MAP_FAILED)
+  {
+    std::cerr << "Cannot map shared memory " << name << ": " << strerror(errno) << std::endl;
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  VolumeHeader* header = static_cast<VolumeHeader*>(mapping);
+  header->magic = VolumeMagic;
+  std::copy(dims, dims + 3, header->dims);
+  std::copy(spacing, spacing + 3, header->spacing);
+  memcpy(static_cast<char*>(mapping) + VolumeDataOffset, data, dataLength);
+  // 协调者本身不读CT, 发布后即可解除映射, 数据保留在共享内存对象中
+  munmap(mapping, length);
+
+  m_VolumeName = name;
+  m_VolumeLength = length;
+  return true;
+}
+
+void DRRShardedRenderer::Unpublish()
+{
+  if (!m_VolumeName.empty()) shm_unlink(m_VolumeName.c_str());
+  m_VolumeName.clear();
+  m_VolumeLength = 0;
+}
+
+bool DRRShardedRenderer::Render(const std::vector<DRRPose>& poses, const FrameCallback& callback)
+{
+  m_FailedPoses.clear();
+  std::vector<size_t> pending(poses.size());
+  for (size_t i = 0; i < pending.size(); i++) pending[i] = i;
+  if (m_VolumeName.empty())
+  {
+    std::cerr << "No volume has been published for sharded rendering" << std::endl;
+    m_FailedPoses = pending;
+    return false;
+  }
+
+  for (int attempt = 0; attempt <= m_MaxRetries && !pending.empty(); attempt++)
+  {
+    pending = this->RunRound(poses, pending, callback);
+  }
+  m_FailedPoses = pending;
+  return pending.empty();
+}
+
+std::vector<size_t> DRRShardedRenderer::RunRound(const std::vector<DRRPose>& poses,
+                                                 const std::vector<size_t>& pending,
+                                                 const FrameCallback& callback)
+{
+  const int hardwareThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int workerCount = std::max(1, std::min(m_WorkerCount > 0 ? m_WorkerCount : hardwareThreads,
+                                               static_cast<int>(pending.size())));
+  const uint32_t slotCount = static_cast<uint32_t>(m_SlotCount > 0 ? m_SlotCount : 2 * workerCount);
+  const uint32_t frameLength = static_cast<uint32_t>(m_Size[0] * m_Size[1]);
+
+  // 环形缓冲区在fork之前创建, worker继承同一份共享映射
+  const std::string ringName = UniqueName("ring");
+  const size_t ringLength = Ring::Length(slotCount, frameLength);
+  int fd = shm_open(ringName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  void* mapping = fd >= 0 && ftruncate(fd, static_cast<off_t>(ringLength)) == 0
+                      ? mmap(nullptr, ringLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                      : MAP_FAILED;
+  if (fd >= 0) close(fd);
+  shm_unlink(ringName.c_str());
+  if (mapping == MAP_FAILED)
+  {
+    std::cerr << "Cannot create frame ring " << ringName << ": " << strerror(errno) << std::endl;
+    return pending;
+  }
+
+  Ring* ring = new (mapping) Ring;
+  sem_init(&ring->freeSlots, 1, slotCount);
+  sem_init(&ring->readySlots, 1, 0);
+  ring->nextEntry.store(0);
+  ring->entryCount = pending.size();
+  ring->slotCount = slotCount;
+  ring->frameLength = frameLength;
+  for (uint32_t i = 0; i < slotCount; i++) new (ring->GetSlot(i)) Slot{{SlotWord(SlotFree)}, 0};
+
+  fflush(nullptr);
+  std::cout.flush();
+  std::vector<int>& workers = m_Workers;
+  workers.clear();
+  for (int i = 0; i < workerCount; i++)
+  {
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      _exit(this->WorkerMain(ring, poses, pending));
+    }
+    if (pid > 0) workers.push_back(pid);
+  }
+
+  std::vector<char> done(pending.size(), 0);
+  auto consume = [&]()
+  {
+    for (uint32_t i = 0; i < slotCount; i++)
+    {
+      Slot* slot = ring->GetSlot(i);
+      if (StateOf(slot->state.load(std::memory_order_acquire)) != SlotReady) continue;
+      callback(pending[slot->entry], ring->GetFrame(i));
+      done[slot->entry] = 1;
+      slot->state.store(SlotWord(SlotFree), std::memory_order_release);
+      sem_post(&ring->freeSlots);
+      return;
+    }
+  };
+
+  while (true)
+  {
+    const timespec deadline = Deadline(100);
+    if (sem_timedwait(&ring->readySlots, &deadline) == 0)
+    {
+      consume();
+      continue;
+    }
+
+    // 超时后检查worker是否退出, 异常退出的worker正在写入的帧归还为空闲帧并唤醒等待的worker
+    for (auto it = workers.begin(); it != workers.end();)
+    {
+      int status = 0;
+      if (waitpid(*it, &status, WNOHANG) != *it)
+      {
+        ++it;
+        continue;
+      }
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      {
+        std::cerr << "DRR worker " << *it << " failed"
+                  << (WIFSIGNALED(status) ? " with signal " + std::to_string(WTERMSIG(status)) : std::string())
+                  << std::endl;
+        for (uint32_t i = 0; i < slotCount; i++)
+        {
+          Slot* slot = ring->GetSlot(i);
+          uint64_t writing = SlotWord(SlotWriting, *it);
+          if (slot->state.compare_exchange_strong(writing, SlotWord(SlotFree))) sem_post(&ring->freeSlots);
+        }
+      }
+      it = workers.erase(it);
+    }
+    if (workers.empty())
+    {
+      while (sem_trywait(&ring->readySlots) == 0) consume();
+      break;
+    }
+  }
+
+  sem_destroy(&ring->freeSlots);
+  sem_destroy(&ring->readySlots);
+  munmap(mapping, ringLength);
+  workers.clear();
+
+  std::vector<size_t> failed;
+  for (size_t i = 0; i < pending.size(); i++)
+    if (!done[i]) failed.push_back(pending[i]);
+  return failed;
+}
+
+int DRRShardedRenderer::WorkerMain(Ring* ring, const std::vector<DRRPose>& poses,
+                                   const std::vector<size_t>& pending)
+{
+  // 以只读方式映射共享内存中的CT, 不做拷贝
+  int fd = shm_open(m_VolumeName.c_str(), O_RDONLY, 0);
+  if (fd < 0) return 1;
+  void* mapping = mmap(nullptr, m_VolumeLength, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) return 1;
+  const VolumeHeader* header = static_cast<const VolumeHeader*>(mapping);
+  if (header->magic != VolumeMagic) return 1;
+
+  // 每个进程只使用分到的那部分核心
+  const int hardwareThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int workerCount = m_WorkerCount > 0 ? m_WorkerCount : hardwareThreads;
+  DRRGenerator generator;
+  generator.SetThreadCount(std::max(1, hardwareThreads / workerCount));
+  generator.SetInputData(reinterpret_cast<const short*>(static_cast<const char*>(mapping) + VolumeDataOffset),
+                         header->dims, header->spacing);
+  generator.SetSourceToDetectorDistance(m_SourceToDetectorDistance);
+  generator.SetThreshold(m_Threshold);
+  generator.SetSize(m_Size[0], m_Size[1], 1);
+  generator.SetSpacing(m_Spacing[0], m_Spacing[1], 1.0);
+
+  const uint64_t batchSize = static_cast<uint64_t>(std::max(1, m_BatchSize));
+  const int32_t pid = static_cast<int32_t>(getpid());
+  while (true)
+  {
+    const uint64_t first = ring->nextEntry.fetch_add(batchSize);
+    if (first >= ring->entryCount) break;
+    const uint64_t last = std::min(first + batchSize, ring->entryCount);
+    for (uint64_t entry = first; entry < last; entry++)
+    {
+      generator.SetPose(poses[pending[entry]]);
+      generator.Update();
+
+      // 领取一个空闲帧, 没有时等待协调者释放; 唤醒信号可能多于空闲帧, 也可能因worker退出而缺少,
+      // 因此每次被唤醒或超时后重新查找
+      uint32_t claimed = ring->slotCount;
+      while (claimed == ring->slotCount)
+      {
+        for (uint32_t i = 0; i < ring->slotCount; i++)
+        {
+          uint64_t expected = SlotWord(SlotFree);
+          if (ring->GetSlot(i)->state.compare_exchange_strong(expected, SlotWord(SlotWriting, pid)))
+          {
+            claimed = i;
+            break;
+          }
+        }
+        if (claimed < ring->slotCount) break;
+        const timespec deadline = Deadline(10);
+        sem_timedwait(&ring->freeSlots, &deadline);
+      }
+      Slot* slot = ring->GetSlot(claimed);
+      memcpy(ring->GetFrame(claimed), generator.GetRawOutput(), ring->frameLength * sizeof(short));
+      slot->entry = entry;
+      slot->state.store(SlotWord(SlotReady, pid), std::memory_order_release);
+      sem_post(&ring->readySlots);
+    }
+  }
+  munmap(mapping, m_VolumeLength);
+  return 0;
+}
+#else
+bool DRRShardedRenderer::Publish(const short*, const int*, const double*)
+{
+  std::cerr << "Sharded rendering requires POSIX shared memory" << std::endl;
+  return false;
+}
+
+void DRRShardedRenderer::Unpublish() {}
+
+bool DRRShardedRenderer::Render(const std::vector<DRRPose>& poses, const FrameCallback&)
+{
+  m_FailedPoses.resize(poses.size());
+  for (size_t i = 0; i < poses.size(); i++) m_FailedPoses[i] = i;
+  return false;
+}
+
+std::vector<size_t> DRRShardedRenderer::RunRound(const std::vector<DRRPose>&, const std::vector<size_t>& pending,
+                                                 const FrameCallback&)
+{
+  return pending;
+}
+
+int DRRShardedRenderer::WorkerMain(Ring*, const std::vector<DRRPose>&, const std::vector<size_t>&)
+{
+  return 1;
+}
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "DRRGenerator.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// 多进程分片渲染(仅Linux/POSIX):
+// 协调者把CT发布到POSIX共享内存中, fork出的worker进程以只读方式映射同一份数据,
+// 从共享的计数器中成批领取pose进行渲染, 结果写入共享内存中的环形缓冲区交回协调者.
+// worker崩溃时, 它已领取但未交回的pose会由新的worker重新渲染.
+// fork出的进程会继承调用者的地址空间, 适合在批处理程序中使用.
+class DRRShardedRenderer
+{
+ public:
+  // frame为Size[0] * Size[1]的short图像(同DRRGenerator::GetRawOutput), 只在回调期间有效
+  typedef std::function<void(size_t poseIndex, const short* frame)> FrameCallback;
+
+  DRRShardedRenderer();
+  ~DRRShardedRenderer();
+
+  // 把CT复制到共享内存中, 之后的渲染都使用这份数据
+  bool Publish(const short* data, const int dims[3], const double spacing[3]);
+  void Unpublish();
+
+  // 除pose之外的渲染参数
+  void SetGeometry(double scd, double threshold, const int size[2], const double spacing[2]);
+  void SetWorkerCount(int count) { m_WorkerCount = count; }
+  void SetBatchSize(int size) { m_BatchSize = size; }
+  void SetSlotCount(int count) { m_SlotCount = count; }
+  void SetMaxRetries(int retries) { m_MaxRetries = retries; }
+
+  // 渲染所有pose, 每交回一帧调用一次callback(调用顺序与pose顺序无关).
+  // 全部完成时返回true, 否则GetFailedPoses给出重试后仍失败的pose
+  bool Render(const std::vector<DRRPose>& poses, const FrameCallback& callback);
+  const std::vector<size_t>& GetFailedPoses() const { return m_FailedPoses; }
+  // 当前一轮的worker进程号, 可在callback中查看; Render返回后为空
+  const std::vector<int>& GetWorkers() const { return m_Workers; }
+
+ private:
+  DRRShardedRenderer(const DRRShardedRenderer&) = delete;
+  void operator=(const DRRShardedRenderer&) = delete;
+
+  struct Ring;
+  std::vector<size_t> RunRound(const std::vector<DRRPose>& poses, const std::vector<size_t>& pending,
+                               const FrameCallback& callback);
+  int WorkerMain(Ring* ring, const std::vector<DRRPose>& poses, const std::vector<size_t>& pending);
+
+  std::string m_VolumeName;  // 共享内存中CT的名字
+  size_t m_VolumeLength;     // 共享内存中CT的字节数(含文件头)
+  int m_Size[2];             // DRR图像的size
+  double m_Spacing[2];       // DRR图像的spacing
+  double m_SourceToDetectorDistance;
+  double m_Threshold;
+  int m_WorkerCount;  // worker进程数, 0表示与核心数相同
+  int m_BatchSize;    // worker每次领取的pose数
+  int m_SlotCount;    // 环形缓冲区的帧数, 0表示worker数的两倍
+  int m_MaxRetries;   // worker异常退出后重试的轮数
+  std::vector<size_t> m_FailedPoses;
+  std::vector<int> m_Workers;  // 当前一轮的worker进程号
+};
@@ -0,0 +1,66 @@
+#include "DRRSpectrum.h"
+
+#include <cmath>
+#include <iostream>
+
+DRRSpectrum::DRRSpectrum() : m_BoneHU(1000.0)
+{
+  this->BuildTable();
+}
+
+void DRRSpectrum::Clear()
+{
+  m_Weights.clear();
+  m_MuWater.clear();
+  m_MuBone.clear();
+  this->BuildTable();
+}
+
+bool DRRSpectrum::AddBin(double weight, double muWater, double muBone)
+{
+  if (static_cast<int>(m_Weights.size()) >= MaxBins)
+  {
+    std::cerr << "A spectrum supports at most " << MaxBins << " energy bins" << std::endl;
+    return false;
+  }
+  m_Weights.push_back(weight);
+  m_MuWater.push_back(muWater);
+  m_MuBone.push_back(muBone);
+  this->BuildTable();
+  return true;
+}
+
+void DRRSpectrum::SetBoneHU(double hu)
+{
+  m_BoneHU = hu;
+  this->BuildTable();
+}
+
+void DRRSpectrum::BuildTable()
+{
+  m_Table.assign(static_cast<size_t>(EntryCount) * MaxBins, 0.0f);
+  for (int entry = 0; entry < EntryCount; entry++)
+  {
+    // 取每行区间的中点, 使查表误差不超过TableStep / 2
+    const double hu = TableMin + (entry + 0.5) * TableStep;
+    for (size_t bin = 0; bin < m_Weights.size(); bin++)
+    {
+      // HU < 0: 空气与水的混合; HU >= 0: 水与骨的混合
+      double mu = hu < 0 ? m_MuWater[bin] * (1.0 + hu / 1000.0)
+                         : m_MuWater[bin] + hu / m_BoneHU * (m_MuBone[bin] - m_MuWater[bin]);
+      m_Table[entry * MaxBins + bin] = static_cast<float>(std::max(0.0, mu));
+    }
+  }
+}
+
+float DRRSpectrum::Combine(const float* lineIntegrals) const
+{
+  double intensity = 0.0, total = 0.0;
+  for (size_t bin = 0; bin < m_Weights.size(); bin++)
+  {
+    intensity += m_Weights[bin] * std::exp(-static_cast<double>(lineIntegrals[bin]));
+    total += m_Weights[bin];
+  }
+  if (total <= 0.0) return 0.0f;
+  return static_cast<float>(-std::log(std::max(intensity / total, 1e-30)));
+}
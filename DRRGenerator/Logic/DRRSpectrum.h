@@ -0,0 +1,51 @@
+#pragma once
+
+#include "vtkSlicerDRRGeneratorModuleLogicExport.h"
+
+#include <algorithm>
+#include <vector>
+
+// 多能谱投影的参数:
+// 每个能量bin有一个权重(源谱强度与探测器响应的乘积)以及该能量下水和骨的线衰减系数.
+// CT值按水-空气/水-骨两段线性插值换算为每个bin的线衰减系数, 预先制成按CT值索引的表,
+// 表中每一行存放所有bin的系数, 遍历时每个体素只查一次表即可累加所有bin.
+class VTK_SLICER_DRRGENERATOR_MODULE_LOGIC_EXPORT DRRSpectrum
+{
+ public:
+  static const int MaxBins = 8;  // 每行的bin数, 不足的bin系数为0
+  static const int TableMin = -1024;
+  static const int TableMax = 4096;
+  static const int TableStep = 4;  // 表中相邻两行的CT值间隔
+
+  DRRSpectrum();
+
+  void Clear();
+  // muWater, muBone的单位为1/mm
+  bool AddBin(double weight, double muWater, double muBone);
+  // 骨对应的CT值, 默认1000
+  void SetBoneHU(double hu);
+  double GetBoneHU() const { return m_BoneHU; }
+  int GetBinCount() const { return static_cast<int>(m_Weights.size()); }
+
+  // CT值对应的一行系数, 共MaxBins个
+  inline const float* GetRow(float value) const
+  {
+    int entry = static_cast<int>((value - TableMin) * (1.0f / TableStep));
+    entry = std::min(std::max(entry, 0), EntryCount - 1);
+    return m_Table.data() + entry * MaxBins;
+  }
+
+  // 由各bin的线积分得到有效线积分 -ln(sum(w * exp(-L)) / sum(w))
+  float Combine(const float* lineIntegrals) const;
+
+ private:
+  static const int EntryCount = (TableMax - TableMin) / TableStep;
+
+  void BuildTable();
+
+  double m_BoneHU;
+  std::vector<double> m_Weights;
+  std::vector<double> m_MuWater;
+  std::vector<double> m_MuBone;
+  std::vector<float> m_Table;  // EntryCount行, 每行MaxBins个系数
+};
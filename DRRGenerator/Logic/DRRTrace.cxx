@@ -0,0 +1,215 @@
+#include "DRRTrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+struct TraceEvent
+{
+  const char* name;
+  const char* category;
+  uint64_t begin;
+  uint64_t duration;
+  int args[2];
+};
+
+struct TraceBuffer
+{
+  std::mutex mutex;  // 只在记录线程和导出之间竞争
+  std::vector<TraceEvent> events;
+  size_t next = 0;
+  size_t count = 0;
+  int id = 0;
+  std::string threadName;
+  bool inUse = false;
+};
+
+struct TraceRegistry
+{
+  std::mutex mutex;
+  std::vector<std::unique_ptr<TraceBuffer>> buffers;
+  size_t bufferSize = size_t(1) << 16;
+};
+
+// 不析构, 避免进程退出时线程仍在记录
+TraceRegistry& Registry()
+{
+  static TraceRegistry* registry = new TraceRegistry;
+  return *registry;
+}
+
+// 线程退出时把缓冲区交还给注册表
+struct ThreadBuffer
+{
+  TraceBuffer* buffer = nullptr;
+  ~ThreadBuffer()
+  {
+    if (!buffer) return;
+    std::lock_guard<std::mutex> lock(Registry().mutex);
+    buffer->inUse = false;
+  }
+};
+thread_local ThreadBuffer CurrentBuffer;
+
+TraceBuffer* AcquireBuffer()
+{
+  if (CurrentBuffer.buffer) return CurrentBuffer.buffer;
+  TraceRegistry& registry = Registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  auto found = std::find_if(registry.buffers.begin(), registry.buffers.end(),
+                            [](const std::unique_ptr<TraceBuffer>& buffer) { return !buffer->inUse; });
+  TraceBuffer* buffer = nullptr;
+  if (found != registry.buffers.end())
+  {
+    buffer = found->get();
+  }
+  else
+  {
+    registry.buffers.emplace_back(new TraceBuffer);
+    buffer = registry.buffers.back().get();
+    buffer->id = static_cast<int>(registry.buffers.size());
+    buffer->events.resize(registry.bufferSize);
+    buffer->threadName = "Thread " + std::to_string(buffer->id);
+  }
+  buffer->inUse = true;
+  CurrentBuffer.buffer = buffer;
+  return buffer;
+}
+
+void WriteString(std::ostream& out, const char* text)
+{
+  out << '"';
+  for (const char* c = text; *c; c++)
+  {
+    if (*c == '"' || *c == '\\') out << '\\';
+    out << *c;
+  }
+  out << '"';
+}
+}  // namespace
+
+std::atomic<bool> DRRTrace::s_Enabled{false};
+
+DRRTrace::Scope::Scope(const char* name, const char* category, int arg0, int arg1)
+    : m_Name(name), m_Category(category), m_Args{arg0, arg1}, m_Begin(DRRTrace::IsEnabled() ? DRRTrace::Now() : 0)
+{
+}
+
+DRRTrace::Scope::~Scope()
+{
+  this->End();
+}
+
+void DRRTrace::Scope::Next(const char* name)
+{
+  if (m_Begin == 0) return;
+  const uint64_t now = DRRTrace::Now();
+  DRRTrace::Record(m_Name, m_Category, m_Begin, now, m_Args[0], m_Args[1]);
+  m_Name = name;
+  m_Begin = now;
+}
+
+void DRRTrace::Scope::End()
+{
+  if (m_Begin == 0) return;
+  DRRTrace::Record(m_Name, m_Category, m_Begin, DRRTrace::Now(), m_Args[0], m_Args[1]);
+  m_Begin = 0;
+}
+
+void DRRTrace::SetEnabled(bool enabled)
+{
+  // 让时间原点早于第一个事件
+  DRRTrace::Now();
+  s_Enabled = enabled;
+}
+
+void DRRTrace::SetBufferSize(size_t events)
+{
+  std::lock_guard<std::mutex> lock(Registry().mutex);
+  Registry().bufferSize = std::max<size_t>(1, events);
+}
+
+void DRRTrace::SetThreadName(const char* name)
+{
+  TraceBuffer* buffer = AcquireBuffer();
+  std::lock_guard<std::mutex> lock(buffer->mutex);
+  buffer->threadName = name;
+}
+
+uint64_t DRRTrace::Now()
+{
+  static const auto start = std::chrono::steady_clock::now();
+  // 加1使得0可以表示"未记录"
+  return static_cast<uint64_t>(
+             std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()) +
+         1;
+}
+
+void DRRTrace::Record(const char* name, const char* category, uint64_t begin, uint64_t end, int arg0, int arg1)
+{
+  if (!DRRTrace::IsEnabled()) return;
+  TraceBuffer* buffer = AcquireBuffer();
+  std::lock_guard<std::mutex> lock(buffer->mutex);
+  buffer->events[buffer->next] = TraceEvent{name, category, begin, end - begin, {arg0, arg1}};
+  buffer->next = (buffer->next + 1) % buffer->events.size();
+  buffer->count = std::min(buffer->count + 1, buffer->events.size());
+}
+
+bool DRRTrace::Write(const std::string& fileName)
+{
+  std::ofstream out(fileName);
+  if (!out)
+  {
+    std::cerr << "Cannot write trace to " << fileName << std::endl;
+    return false;
+  }
+  out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  TraceRegistry& registry = Registry();
+  std::lock_guard<std::mutex> registryLock(registry.mutex);
+  for (const auto& buffer : registry.buffers)
+  {
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    if (buffer->count == 0) continue;
+    out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id
+        << ",\"args\":{\"name\":";
+    WriteString(out, buffer->threadName.c_str());
+    out << "}}";
+    first = false;
+    // 从最旧的事件开始
+    const size_t size = buffer->events.size();
+    for (size_t n = 0; n < buffer->count; n++)
+    {
+      const TraceEvent& event = buffer->events[(buffer->next + size - buffer->count + n) % size];
+      out << ",\n{\"name\":";
+      WriteString(out, event.name);
+      out << ",\"cat\":";
+      WriteString(out, event.category);
+      out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",\"ts\":" << event.begin / 1000.0
+          << ",\"dur\":" << event.duration / 1000.0;
+      if (event.args[0] >= 0) out << ",\"args\":{\"arg0\":" << event.args[0] << ",\"arg1\":" << event.args[1] << "}";
+      out << "}";
+    }
+  }
+  out << "\n]}\n";
+  return static_cast<bool>(out);
+}
+
+void DRRTrace::Clear()
+{
+  TraceRegistry& registry = Registry();
+  std::lock_guard<std::mutex> registryLock(registry.mutex);
+  for (const auto& buffer : registry.buffers)
+  {
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    buffer->next = 0;
+    buffer->count = 0;
+  }
+}
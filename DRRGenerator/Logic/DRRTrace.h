@@ -0,0 +1,53 @@
+#pragma once
+
+#include "vtkSlicerDRRGeneratorModuleLogicExport.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 渲染过程的时间线追踪(默认关闭):
+// 每个线程把事件记录在自己的环形缓冲区中, 写满后覆盖最旧的事件, 线程退出后缓冲区留给之后的线程使用.
+// Write把所有缓冲区导出为Chrome trace JSON, 可以在chrome://tracing或Perfetto中查看.
+// 事件名和分类必须是字符串常量, 记录时只保存指针.
+class VTK_SLICER_DRRGENERATOR_MODULE_LOGIC_EXPORT DRRTrace
+{
+ public:
+  // 记录一个作用域从构造到析构的时间, 追踪关闭时没有额外开销
+  class Scope
+  {
+   public:
+    explicit Scope(const char* name, const char* category = "render", int arg0 = -1, int arg1 = -1);
+    ~Scope();
+    // 结束当前的事件并开始名为name的下一个, 用于依次记录各阶段
+    void Next(const char* name);
+    void End();
+
+   private:
+    Scope(const Scope&) = delete;
+    void operator=(const Scope&) = delete;
+
+    const char* m_Name;
+    const char* m_Category;
+    int m_Args[2];
+    uint64_t m_Begin;  // 0表示未记录
+  };
+
+  static void SetEnabled(bool enabled);
+  static bool IsEnabled() { return s_Enabled.load(std::memory_order_relaxed); }
+  // 每个线程的缓冲区可保存的事件数, 只对之后新建的缓冲区生效
+  static void SetBufferSize(size_t events);
+  // 时间线上当前线程的名字
+  static void SetThreadName(const char* name);
+
+  // 自进程中第一次调用起的纳秒数
+  static uint64_t Now();
+  static void Record(const char* name, const char* category, uint64_t begin, uint64_t end, int arg0 = -1,
+                     int arg1 = -1);
+  static bool Write(const std::string& fileName);
+  static void Clear();
+
+ private:
+  static std::atomic<bool> s_Enabled;
+};
@@ -0,0 +1,243 @@
+#include "DRRVolume.h"
+#include "DRRAxisProjector.h"
+#include "DRRMappedVolume.h"
+#include "DRRTrace.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+#include <vtkImageData.h>
+
+namespace
+{
+// 按阈值缓存的包围盒只有6个整数, 前缀和每份约为CT的两倍内存
+const size_t ContentBoxCapacity = 16;
+const size_t PrefixSumCapacity = 2;
+
+// 在按最近使用排序的缓存中查找key, 没有时插入新的一项, 超过capacity时淘汰最久未用的一项.
+// 被淘汰的项若正在生成或使用, 由持有它的调用者继续保持
+template <typename Entry, typename Key>
+std::shared_ptr<Entry> FindEntry(std::vector<std::shared_ptr<Entry>>& cache, const Key& key, size_t capacity)
+{
+  auto found = std::find_if(cache.begin(), cache.end(),
+                            [&](const std::shared_ptr<Entry>& entry) { return entry->key == key; });
+  std::shared_ptr<Entry> entry;
+  if (found != cache.end())
+  {
+    entry = *found;
+    cache.erase(found);
+  }
+  else
+  {
+    entry = std::make_shared<Entry>(key);
+    if (cache.size() >= capacity) cache.pop_back();
+  }
+  cache.insert(cache.begin(), entry);
+  return entry;
+}
+}  // namespace
+
+DRRVolume::DRRVolume(const short* data, const int dims[3], const double spacing[3], unsigned long mtime)
+    : m_Data(data), m_MTime(mtime)
+{
+  std::copy(dims, dims + 3, m_Dimensions);
+  std::copy(spacing, spacing + 3, m_Spacing);
+}
+
+std::shared_ptr<const DRRVolume> DRRVolume::New(const short* data, const int dims[3], const double spacing[3],
+                                                unsigned long mtime)
+{
+  return std::shared_ptr<const DRRVolume>(new DRRVolume(data, dims, spacing, mtime));
+}
+
+std::shared_ptr<const DRRVolume> DRRVolume::New(vtkImageData* image, const double spacing[3])
+{
+  const double defaultSpacing[3]{1.0, 1.0, 1.0};
+  DRRVolume* volume = new DRRVolume(static_cast<const short*>(image->GetScalarPointer()), image->GetDimensions(),
+                                    spacing ? spacing : defaultSpacing, image->GetMTime());
+  volume->m_Image = image;
+  return std::shared_ptr<const DRRVolume>(volume);
+}
+
+std::shared_ptr<const DRRVolume> DRRVolume::New(std::shared_ptr<const DRRMappedVolume> mapped)
+{
+  DRRVolume* volume = new DRRVolume(mapped->GetData(), mapped->GetDimensions(), mapped->GetSpacing(),
+                                    static_cast<unsigned long>(mapped->GetFileStamp()));
+  volume->m_MappedVolume = std::move(mapped);
+  return std::shared_ptr<const DRRVolume>(volume);
+}
+
+size_t DRRVolume::GetLength() const
+{
+  return static_cast<size_t>(m_Dimensions[0]) * m_Dimensions[1] * m_Dimensions[2];
+}
+
+bool DRRVolume::IsCurrent() const
+{
+  if (!m_Image) return true;
+  return m_Image->GetMTime() == m_MTime && m_Image->GetScalarPointer() == m_Data &&
+         std::equal(m_Dimensions, m_Dimensions + 3, m_Image->GetDimensions());
+}
+
+std::shared_ptr<const DRREncodedVolume> DRRVolume::GetEncodedVolume(DRREncodedVolume::Encoding encoding) const
+{
+  std::call_once(m_EncodedOnce[encoding],
+                 [&]
+                 {
+                   auto built = std::make_shared<DRREncodedVolume>();
+                   built->Build(m_Data, m_Dimensions, encoding);
+                   m_Encoded[encoding] = built;
+                 });
+  return m_Encoded[encoding];
+}
+
+std::vector<std::shared_ptr<DRRNuma::Buffer>> DRRVolume::GetReplicas(DRRNuma::Policy policy, bool hugePages) const
+{
+  // 单节点或内存映射的CT不做NUMA放置
+  const int nodeCount = DRRNuma::GetNodeCount();
+  if (policy == DRRNuma::Off || nodeCount < 2 || m_MappedVolume || !m_Data)
+  {
+    return std::vector<std::shared_ptr<DRRNuma::Buffer>>();
+  }
+
+  std::lock_guard<std::mutex> lock(m_ReplicaMutex);
+  auto found = m_Replicas.find(std::make_pair(static_cast<int>(policy), hugePages));
+  if (found != m_Replicas.end()) return found->second;
+
+  std::vector<std::shared_ptr<DRRNuma::Buffer>> replicas;
+  const size_t length = this->GetLength() * sizeof(short);
+  if (policy == DRRNuma::Replicate)
+  {
+    for (int node = 0; node < nodeCount; node++)
+    {
+      replicas.push_back(DRRNuma::CopyToNode(m_Data, length, node, hugePages));
+    }
+  }
+  else
+  {
+    replicas.push_back(DRRNuma::CopyInterleaved(m_Data, length, hugePages));
+  }
+  if (std::find(replicas.begin(), replicas.end(), nullptr) != replicas.end())
+  {
+    std::cerr << "Cannot allocate NUMA copies of the volume, using the original" << std::endl;
+    replicas.clear();
+  }
+  m_Replicas[std::make_pair(static_cast<int>(policy), hugePages)] = replicas;
+  return replicas;
+}
+
+std::array<int, 6> DRRVolume::GetContentBox(double threshold, int threadCount) const
+{
+  std::array<int, 6> box{0, m_Dimensions[0], 0, m_Dimensions[1], 0, m_Dimensions[2]};
+  // 内存映射的CT不为此额外读一遍文件, 使用整个体数据
+  if (m_MappedVolume || !m_Data) return box;
+
+  std::shared_ptr<ContentBoxEntry> entry;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    entry = FindEntry(m_ContentBoxes, threshold, ContentBoxCapacity);
+  }
+  std::call_once(entry->once, [&] { entry->value = this->ComputeContentBox(threshold, threadCount); });
+  return entry->value;
+}
+
+std::array<int, 6> DRRVolume::ComputeContentBox(double threshold, int threadCount) const
+{
+  DRRTrace::Scope trace("ContentBox");
+  std::array<int, 6> box;
+  // 体素值为整数, v > threshold 等价于 v > floor(threshold)
+  const int limit = static_cast<int>(
+      std::min(std::max(std::floor(threshold), double(SHRT_MIN) - 1.0), double(SHRT_MAX)));
+  threadCount = std::max(1, std::min(threadCount, m_Dimensions[2]));
+  std::vector<std::array<int, 6>> partial(threadCount, {INT_MAX, INT_MIN, INT_MAX, INT_MIN, INT_MAX, INT_MIN});
+  auto scan = [&](int index)
+  {
+    // 各线程交错领取层, 每行只需找到首尾两个高于阈值的体素
+    std::array<int, 6>& bounds = partial[index];
+    const int nx = m_Dimensions[0], ny = m_Dimensions[1];
+    for (int k = index; k < m_Dimensions[2]; k += threadCount)
+      for (int j = 0; j < ny; j++)
+      {
+        const short* line = m_Data + (static_cast<size_t>(k) * ny + j) * nx;
+        int first = 0;
+        while (first < nx && line[first] <= limit) first++;
+        if (first == nx) continue;
+        int last = nx - 1;
+        while (line[last] <= limit) last--;
+        bounds[0] = std::min(bounds[0], first);
+        bounds[1] = std::max(bounds[1], last + 1);
+        bounds[2] = std::min(bounds[2], j);
+        bounds[3] = std::max(bounds[3], j + 1);
+        bounds[4] = std::min(bounds[4], k);
+        bounds[5] = std::max(bounds[5], k + 1);
+      }
+  };
+  std::vector<std::thread> pool;
+  for (int i = 1; i < threadCount; i++) pool.emplace_back(scan, i);
+  scan(0);
+  for (auto& thread : pool) thread.join();
+
+  for (int axis = 0; axis < 3; axis++)
+  {
+    box[2 * axis] = INT_MAX;
+    box[2 * axis + 1] = INT_MIN;
+    for (const std::array<int, 6>& bounds : partial)
+    {
+      box[2 * axis] = std::min(box[2 * axis], bounds[2 * axis]);
+      box[2 * axis + 1] = std::max(box[2 * axis + 1], bounds[2 * axis + 1]);
+    }
+  }
+  // 没有高于阈值的体素时包围盒为空
+  if (box[1] == INT_MIN) box.fill(0);
+  return box;
+}
+
+std::shared_ptr<const std::vector<float>> DRRVolume::GetPrefixSum(int axis, double threshold) const
+{
+  std::shared_ptr<PrefixSumEntry> entry;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    entry = FindEntry(m_PrefixSums, std::make_pair(axis, threshold), PrefixSumCapacity);
+  }
+  std::call_once(entry->once,
+                 [&] { entry->value = DRRAxisProjector::BuildPrefixSum(m_Data, m_Dimensions, axis, threshold); });
+  return entry->value;
+}
+
+std::shared_ptr<const std::vector<short>> DRRVolume::GetPermutedVolume(int axis, int threadCount) const
+{
+  if (axis <= 0 || axis > 2 || m_MappedVolume || !m_Data) return nullptr;
+
+  std::call_once(m_PermutedOnce[axis], [&] { m_Permuted[axis] = this->ComputePermutedVolume(axis, threadCount); });
+  return m_Permuted[axis];
+}
+
+std::shared_ptr<const std::vector<short>> DRRVolume::ComputePermutedVolume(int axis, int threadCount) const
+{
+  DRRTrace::Scope trace("PermuteVolume");
+  const int a = axis, b = (axis + 1) % 3, c = (axis + 2) % 3;
+  const size_t stride[3]{1, static_cast<size_t>(m_Dimensions[0]),
+                         static_cast<size_t>(m_Dimensions[0]) * m_Dimensions[1]};
+  auto built = std::make_shared<std::vector<short>>(this->GetLength());
+  short* target = built->data();
+  threadCount = std::max(1, std::min(threadCount, m_Dimensions[c]));
+  auto copy = [&](int index)
+  {
+    // 按副本的顺序连续写入, 各线程交错领取最慢变化轴上的层
+    for (int ic = index; ic < m_Dimensions[c]; ic += threadCount)
+      for (int ib = 0; ib < m_Dimensions[b]; ib++)
+      {
+        short* line = target + (static_cast<size_t>(ic) * m_Dimensions[b] + ib) * m_Dimensions[a];
+        const short* source = m_Data + ic * stride[c] + ib * stride[b];
+        for (int ia = 0; ia < m_Dimensions[a]; ia++) line[ia] = source[ia * stride[a]];
+      }
+  };
+  std::vector<std::thread> pool;
+  for (int i = 1; i < threadCount; i++) pool.emplace_back(copy, i);
+  copy(0);
+  for (auto& thread : pool) thread.join();
+  return built;
+}
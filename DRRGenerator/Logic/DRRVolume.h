@@ -0,0 +1,94 @@
+#pragma once
+
+#include "DRREncodedVolume.h"
+#include "DRRNuma.h"
+#include "vtkSlicerDRRGeneratorModuleLogicExport.h"
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <vtkSmartPointer.h>
+
+class DRRMappedVolume;
+class vtkImageData;
+
+// 渲染所用的CT体数据, 创建后不再改变, 以shared_ptr<const DRRVolume>在多个DRRGenerator之间共享.
+// 编码, NUMA副本, 包围盒和前缀和等派生数据在第一次需要时生成并缓存, 每一项只生成一次,
+// 生成某一项时不阻塞其他项的查找和生成; 按阈值缓存的包围盒和前缀和只保留最近用到的几项.
+// DRRGenerator在Update开始时取得它们的引用, 遍历期间不再访问DRRVolume,
+// 因此多个DRRGenerator可以在任意线程中同时渲染同一份CT, 不复制体数据
+class VTK_SLICER_DRRGENERATOR_MODULE_LOGIC_EXPORT DRRVolume
+{
+ public:
+  // data在DRRVolume的生命期内需保持有效且不被修改, mtime用于区分同一块内存中先后存放的不同CT
+  static std::shared_ptr<const DRRVolume> New(const short* data, const int dims[3], const double spacing[3],
+                                              unsigned long mtime = 0);
+  // 持有image(short类型)的引用, spacing为空时为1mm
+  static std::shared_ptr<const DRRVolume> New(vtkImageData* image, const double spacing[3] = nullptr);
+  // 内存映射的CT, 持有volume的引用; 之后不能再对它Open或Close, 重新映射时应创建新的DRRMappedVolume
+  static std::shared_ptr<const DRRVolume> New(std::shared_ptr<const DRRMappedVolume> volume);
+
+  const short* GetData() const { return m_Data; }
+  const int* GetDimensions() const { return m_Dimensions; }
+  const double* GetSpacing() const { return m_Spacing; }
+  unsigned long GetMTime() const { return m_MTime; }
+  const DRRMappedVolume* GetMappedVolume() const { return m_MappedVolume.get(); }
+  // 数据来自vtkImageData时为它, 否则为nullptr
+  vtkImageData* GetImage() const { return m_Image; }
+  // 包装的vtkImageData被修改(MTime或数据指针变化)后为false, 此时缓存已失效, 应以它创建新的DRRVolume
+  bool IsCurrent() const;
+  size_t GetLength() const;
+
+  // 按encoding编码后的CT, 每种编码只生成一次
+  std::shared_ptr<const DRREncodedVolume> GetEncodedVolume(DRREncodedVolume::Encoding encoding) const;
+  // 按policy放置到NUMA节点上的副本: Replicate时每个节点一份, Interleave时一份; Off或分配失败时为空
+  std::vector<std::shared_ptr<DRRNuma::Buffer>> GetReplicas(DRRNuma::Policy policy, bool hugePages) const;
+  // 高于threshold的体素的包围盒(体素索引, 上界不含), 没有时全为0; 内存映射的CT返回整个体数据
+  std::array<int, 6> GetContentBox(double threshold, int threadCount) const;
+  // 沿axis的前缀和(见DRRAxisProjector::BuildPrefixSum), 每份约为CT的两倍内存, 保留最近用到的两份(如正位和侧位)
+  std::shared_ptr<const std::vector<float>> GetPrefixSum(int axis, double threshold) const;
+  // 以axis为最快变化轴的CT副本, 体素(i0, i1, i2)位于i[a] + n[a] * (i[b] + n[b] * i[c]), b = (a + 1) % 3, c = (a + 2) % 3.
+  // axis为0时即原数据, 返回空; 每个轴只生成一次, 内存映射的CT不生成
+  std::shared_ptr<const std::vector<short>> GetPermutedVolume(int axis, int threadCount) const;
+
+ private:
+  DRRVolume(const short* data, const int dims[3], const double spacing[3], unsigned long mtime);
+  DRRVolume(const DRRVolume&) = delete;
+  void operator=(const DRRVolume&) = delete;
+
+  // 按参数缓存的一项, 查找和插入时持有m_Mutex, 由call_once在锁外生成
+  template <typename Key, typename Value>
+  struct CacheEntry
+  {
+    explicit CacheEntry(const Key& k) : key(k) {}
+    Key key;
+    std::once_flag once;
+    Value value;
+  };
+  using ContentBoxEntry = CacheEntry<double, std::array<int, 6>>;
+  using PrefixSumEntry = CacheEntry<std::pair<int, double>, std::shared_ptr<const std::vector<float>>>;
+
+  std::array<int, 6> ComputeContentBox(double threshold, int threadCount) const;
+  std::shared_ptr<const std::vector<short>> ComputePermutedVolume(int axis, int threadCount) const;
+
+  const short* m_Data;                    // CT体数据
+  int m_Dimensions[3];                    // CT图像的Size
+  double m_Spacing[3];                    // CT图像的Spacing
+  unsigned long m_MTime;                  // CT数据的修改时间
+  std::shared_ptr<const DRRMappedVolume> m_MappedVolume;  // 非空时数据为内存映射的文件, 持有映射
+  vtkSmartPointer<vtkImageData> m_Image;  // 数据来自vtkImageData时持有它的引用
+
+  mutable std::once_flag m_EncodedOnce[3];
+  mutable std::shared_ptr<const DRREncodedVolume> m_Encoded[3];
+  mutable std::mutex m_ReplicaMutex;  // 保护m_Replicas, 复制到各节点时持有
+  mutable std::map<std::pair<int, bool>, std::vector<std::shared_ptr<DRRNuma::Buffer>>> m_Replicas;
+  mutable std::once_flag m_PermutedOnce[3];
+  mutable std::shared_ptr<const std::vector<short>> m_Permuted[3];
+  mutable std::mutex m_Mutex;  // 只保护以下两个列表, 不在生成时持有
+  mutable std::vector<std::shared_ptr<ContentBoxEntry>> m_ContentBoxes;  // 最近用到的在前
+  mutable std::vector<std::shared_ptr<PrefixSumEntry>> m_PrefixSums;     // 最近用到的在前
+};
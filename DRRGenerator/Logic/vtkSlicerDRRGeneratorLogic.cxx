@@ -17,28 +17,46 @@
 
 // DRRGenerator Logic includes
 #include "vtkSlicerDRRGeneratorLogic.h"
+#include "DRRAtlas.h"
+#include "DRRCinePlayer.h"
+#include "DRRDataset.h"
+#include "DRRFrameCache.h"
 #include "DRRGenerator.h"
+#include "DRRMappedVolume.h"
+#include "DRRTrace.h"
 
 // MRML includes
+#include <vtkMRMLLabelMapVolumeNode.h>
 #include <vtkMRMLMarkupsFiducialNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLVectorVolumeNode.h>
 
 // VTK includes
 #include <vtkIntArray.h>
 #include <vtkImageData.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
+#include <vtkPoints.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <fstream>
 
 vtkStandardNewMacro(vtkSlicerDRRGeneratorLogic);
 
 vtkSlicerDRRGeneratorLogic::vtkSlicerDRRGeneratorLogic()
 {
   this->drrGen = std::make_shared<DRRGenerator>();
+  this->frameCache = std::make_shared<DRRFrameCache>();
+  this->cinePlayer = std::make_shared<DRRCinePlayer>();
+  this->atlas = std::make_shared<DRRAtlas>();
+  this->atlasEnabled = false;
+  this->atlasAngles[0] = -180;
+  this->atlasAngles[1] = 180;
+  this->atlasAngles[2] = 2;
 }
 
 vtkSlicerDRRGeneratorLogic::~vtkSlicerDRRGeneratorLogic() {}
@@ -76,13 +94,52 @@ void vtkSlicerDRRGeneratorLogic::applyDRR(vtkMRMLScalarVolumeNode* ctVolume,
                                           double threshold, double scd, double rotation[3],
                                           double translation[3], int size[3], double spacing[3])
 {
+  double ctSpacing[3];
+  ctVolume->GetSpacing(ctSpacing);
+  this->drrGen->SetInputData(ctVolume->GetImageData(), ctSpacing);
+  if (this->atlasEnabled)
+  {
+    this->updateAtlas(ctVolume, angle, threshold, scd, rotation, translation, size, spacing);
+  }
+  vtkImageData* ctImage = ctVolume->GetImageData();
+  this->updateDRR(drrVolume, reinterpret_cast<uintptr_t>(ctImage), ctImage->GetMTime(), angle, threshold, scd,
+                  rotation, translation, size, spacing);
+}
+
+bool vtkSlicerDRRGeneratorLogic::applyDRR(const std::string& volumeFile,
+                                          vtkMRMLScalarVolumeNode* drrVolume, double angle,
+                                          double threshold, double scd, double rotation[3],
+                                          double translation[3], int size[3], double spacing[3])
+{
+  // 换了文件, 或同名文件在映射后被改写或替换时重新映射. 每次映射一个新的对象, 渲染上下文和图谱中
+  // 仍在使用的DRRVolume持有旧的映射, 直到它们换用新的CT
+  if (!this->mappedVolume || this->mappedVolume->GetFileName() != volumeFile || !this->mappedVolume->IsCurrent())
+  {
+    std::shared_ptr<DRRMappedVolume> mapped = std::make_shared<DRRMappedVolume>();
+    if (!mapped->Open(volumeFile))
+    {
+      std::cout << __FUNCTION__ << ": cannot map \"" << volumeFile << "\"." << std::endl;
+      return false;
+    }
+    this->mappedVolume = mapped;
+  }
+  this->drrGen->SetInputData(this->mappedVolume);
+  this->updateDRR(drrVolume, std::hash<std::string>()(volumeFile), this->mappedVolume->GetFileStamp(), angle,
+                  threshold, scd, rotation, translation, size, spacing);
+  return true;
+}
+
+void vtkSlicerDRRGeneratorLogic::updateDRR(vtkMRMLScalarVolumeNode* drrVolume, uint64_t volumeId,
+                                           uint64_t volumeMTime, double angle, double threshold, double scd,
+                                           double rotation[3], double translation[3], int size[3],
+                                           double spacing[3])
+{
+  DRRTrace::Scope trace("updateDRR", "logic");
   auto begin = std::chrono::duration_cast<std::chrono::milliseconds>(
                    std::chrono::system_clock::now().time_since_epoch())
                    .count();
 
   const double dtr = 0.017453292519943295;
-  double ctSpacing[3];
-  ctVolume->GetSpacing(ctSpacing);
   rotation[0] *= dtr;
   rotation[1] *= dtr;
   rotation[2] *= dtr;
@@ -95,9 +152,30 @@ void vtkSlicerDRRGeneratorLogic::applyDRR(vtkMRMLScalarVolumeNode* ctVolume,
   this->drrGen->SetThreshold(threshold);
   this->drrGen->SetSpacing(spacing);
   this->drrGen->SetSize(size);
-  this->drrGen->SetInputData(ctVolume->GetImageData(), ctSpacing);
-  this->drrGen->Update();
-  vtkSmartPointer<vtkImageData> drrImage = this->drrGen->GetOutput();
+
+  // 标签和能谱通道不在缓存中, 需要它们时总是重新渲染
+  DRRFrameCache::Key key;
+  key.volume = volumeId;
+  key.volumeMTime = volumeMTime;
+  key.pose = this->drrGen->GetPose();
+  key.scd = scd;
+  key.threshold = threshold;
+  std::copy(size, size + 3, key.size);
+  std::copy(spacing, spacing + 3, key.spacing);
+  key.encoding = this->drrGen->GetVolumeEncoding();
+  key.superSampling = this->drrGen->GetSuperSampling();
+  key.fastProjection = this->drrGen->GetFastProjection();
+  key.window = this->drrGen->GetOutputWindow();
+  const bool cacheable = this->drrGen->GetLabelValues().empty() && !this->drrGen->GetSpectral();
+  vtkSmartPointer<vtkImageData> drrImage = cacheable ? this->frameCache->Find(key) : nullptr;
+  const bool cacheHit = drrImage != nullptr;
+  if (!cacheHit)
+  {
+    this->drrGen->Update();
+    drrImage = this->drrGen->GetOutput();
+    // 二维变换得到的近似结果不放入缓存
+    if (cacheable && !this->drrGen->GetStatistics().warped) this->frameCache->Insert(key, drrImage);
+  }
   drrVolume->SetAndObserveImageData(drrImage.GetPointer());
   drrVolume->StorableModified();
   drrVolume->Modified();
@@ -107,22 +185,379 @@ void vtkSlicerDRRGeneratorLogic::applyDRR(vtkMRMLScalarVolumeNode* ctVolume,
   std::cout << "Time Used:" << end - begin << "ms" << std::endl;
 }
 
+bool vtkSlicerDRRGeneratorLogic::renderToFile(const std::string& fileName, vtkMRMLScalarVolumeNode* ctVolume,
+                                              double angle, double threshold, double scd, double rotation[3],
+                                              double translation[3], int size[3], double spacing[3])
+{
+  vtkImageData* ctImage = ctVolume ? ctVolume->GetImageData() : nullptr;
+  if (!ctImage || ctImage->GetScalarType() != VTK_SHORT)
+  {
+    std::cout << __FUNCTION__ << ": the CT must be a short volume." << std::endl;
+    return false;
+  }
+  auto begin = std::chrono::steady_clock::now();
+  double ctSpacing[3];
+  ctVolume->GetSpacing(ctSpacing);
+  this->drrGen->SetInputData(ctImage, ctSpacing);
+
+  // 使用单独的渲染上下文, 不改变drrGen的结果
+  const double dtr = 0.017453292519943295;
+  DRRPose pose;
+  pose.angle = angle * dtr;
+  for (int i = 0; i < 3; i++)
+  {
+    pose.rotation[i] = rotation[i] * dtr;
+    pose.translation[i] = translation[i];
+  }
+  std::shared_ptr<DRRGenerator> context = this->newRenderContext();
+  context->SetPose(pose);
+  context->SetSourceToDetectorDistance(scd);
+  context->SetThreshold(threshold);
+  context->SetSize(size[0], size[1], 1);
+  context->SetSpacing(spacing[0], spacing[1], 1.0);
+  context->SetSuperSampling(this->drrGen->GetSuperSampling());
+  context->SetFastProjection(this->drrGen->GetFastProjection());
+
+  std::ofstream file(fileName, std::ios::binary);
+  if (!file)
+  {
+    std::cout << __FUNCTION__ << ": cannot create \"" << fileName << "\"." << std::endl;
+    return false;
+  }
+  const bool mapped = context->GetOutputWindow().mode == DRRWindowFixed;
+  const uint16_t byteOrder = 1;
+  file << "NRRD0004\ntype: " << (mapped ? "uchar" : "short") << "\ndimension: 2\nsizes: " << size[0] << " "
+       << size[1] << "\nspacings: " << spacing[0] << " " << spacing[1] << "\nencoding: raw\n";
+  if (!mapped) file << "endian: " << (*reinterpret_cast<const char*>(&byteOrder) ? "little" : "big") << "\n";
+  file << "\n";
+
+  // 每个行带到达时直接写入文件
+  const bool succeeded = context->UpdateStreaming(
+      [&file, mapped](const DRROutputBand& band)
+      {
+        const size_t count = static_cast<size_t>(band.rowCount) * band.width;
+        if (mapped)
+          file.write(reinterpret_cast<const char*>(band.mapped), count);
+        else
+          file.write(reinterpret_cast<const char*>(band.raw), count * sizeof(short));
+        return static_cast<bool>(file);
+      },
+      256);
+  file.close();
+  if (!succeeded || !file)
+  {
+    std::cout << __FUNCTION__ << ": cannot write \"" << fileName << "\"." << std::endl;
+    return false;
+  }
+  std::cout << "Wrote " << size[0] << "x" << size[1] << " DRR to " << fileName << " in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() << " s" << std::endl;
+  return true;
+}
+
+std::shared_ptr<DRRGenerator> vtkSlicerDRRGeneratorLogic::newRenderContext() const
+{
+  auto context = std::make_shared<DRRGenerator>();
+  if (this->drrGen->GetVolume()) context->SetVolume(this->drrGen->GetVolume());
+  context->SetVolumeEncoding(this->drrGen->GetVolumeEncoding());
+  context->SetNumaPolicy(this->drrGen->GetNumaPolicy());
+  context->SetHugePages(this->drrGen->GetHugePages());
+  context->SetPermutedVolumes(this->drrGen->GetPermutedVolumes());
+  context->SetOutputWindow(this->drrGen->GetOutputWindow());
+  return context;
+}
+
+bool vtkSlicerDRRGeneratorLogic::startCine(vtkMRMLScalarVolumeNode* ctVolume, const std::vector<double>& angles,
+                                           double fps, double threshold, double scd, double rotation[3],
+                                           double translation[3], int size[3], double spacing[3])
+{
+  this->stopCine();
+  vtkImageData* ctImage = ctVolume ? ctVolume->GetImageData() : nullptr;
+  if (!ctImage || ctImage->GetScalarType() != VTK_SHORT)
+  {
+    std::cout << __FUNCTION__ << ": the CT must be a short volume." << std::endl;
+    return false;
+  }
+  double ctSpacing[3];
+  ctVolume->GetSpacing(ctSpacing);
+  this->drrGen->SetInputData(ctImage, ctSpacing);
+
+  const double dtr = 0.017453292519943295;
+  DRRPose pose;
+  for (int i = 0; i < 3; i++)
+  {
+    pose.rotation[i] = rotation[i] * dtr;
+    pose.translation[i] = translation[i];
+  }
+  auto configure = [&](DRRGenerator& context, int width, int height)
+  {
+    // 降级的上下文像素数减为四分之一, 视野保持不变
+    context.SetPose(pose);
+    context.SetSourceToDetectorDistance(scd);
+    context.SetThreshold(threshold);
+    context.SetSize(width, height, 1);
+    context.SetSpacing(spacing[0] * size[0] / width, spacing[1] * size[1] / height, spacing[2]);
+  };
+  std::shared_ptr<DRRGenerator> context = this->newRenderContext();
+  configure(*context, size[0], size[1]);
+  std::shared_ptr<DRRGenerator> reduced = this->newRenderContext();
+  configure(*reduced, (size[0] + 1) / 2, (size[1] + 1) / 2);
+  // 两个上下文都只在播放器的渲染线程中使用, 共用一份临时缓冲
+  std::shared_ptr<DRRGenerator::Scratch> scratch = DRRGenerator::NewScratch();
+  context->SetScratch(scratch);
+  reduced->SetScratch(scratch);
+
+  std::vector<double> radians(angles.size());
+  for (size_t i = 0; i < angles.size(); i++) radians[i] = angles[i] * dtr;
+  return this->cinePlayer->Start(context, reduced, radians, fps);
+}
+
+bool vtkSlicerDRRGeneratorLogic::updateCine(vtkMRMLScalarVolumeNode* drrVolume)
+{
+  DRRCinePlayer::Frame frame;
+  if (drrVolume && this->cinePlayer->NextFrame(frame))
+  {
+    drrVolume->SetAndObserveImageData(frame.image);
+    drrVolume->Modified();
+  }
+  if (!this->cinePlayer->IsFinished()) return true;
+
+  const DRRCinePlayer::Statistics statistics = this->cinePlayer->GetStatistics();
+  std::cout << "Cine: " << statistics.shownCount << " frames shown, " << statistics.droppedCount << " dropped, "
+            << statistics.degradedCount << " at half resolution; render " << statistics.renderTime
+            << " ms (half resolution " << statistics.reducedTime << " ms), post-processing " << statistics.postTime
+            << " ms" << std::endl;
+  return false;
+}
+
+void vtkSlicerDRRGeneratorLogic::stopCine()
+{
+  this->cinePlayer->Stop();
+}
+
+void vtkSlicerDRRGeneratorLogic::setIncremental(bool enabled)
+{
+  this->drrGen->SetIncremental(enabled);
+}
+
+void vtkSlicerDRRGeneratorLogic::setOutputWindow(const DRROutputWindow& window)
+{
+  this->drrGen->SetOutputWindow(window);
+}
+
+void vtkSlicerDRRGeneratorLogic::setAtlas(bool enabled, double minAngle, double maxAngle, double step)
+{
+  if (!enabled || minAngle != this->atlasAngles[0] || maxAngle != this->atlasAngles[1] ||
+      step != this->atlasAngles[2])
+  {
+    this->atlas = std::make_shared<DRRAtlas>();
+  }
+  this->atlasEnabled = enabled;
+  this->atlasAngles[0] = minAngle;
+  this->atlasAngles[1] = maxAngle;
+  this->atlasAngles[2] = step;
+}
+
+bool vtkSlicerDRRGeneratorLogic::updateAtlas(vtkMRMLScalarVolumeNode* ctVolume, double angle, double threshold,
+                                             double scd, double rotation[3], double translation[3],
+                                             int size[3], double spacing[3])
+{
+  vtkImageData* ctImage = ctVolume->GetImageData();
+  if (!ctImage || ctImage->GetScalarType() != VTK_SHORT) return false;
+
+  const double dtr = 0.017453292519943295;
+  DRRAtlas::Parameters parameters;
+  parameters.minAngle = this->atlasAngles[0] * dtr;
+  parameters.maxAngle = this->atlasAngles[1] * dtr;
+  parameters.step = this->atlasAngles[2] * dtr;
+  for (int i = 0; i < 3; i++)
+  {
+    parameters.pose.rotation[i] = rotation[i] * dtr;
+    parameters.pose.translation[i] = translation[i];
+  }
+  parameters.scd = scd;
+  parameters.threshold = threshold;
+  std::copy(size, size + 2, parameters.size);
+  std::copy(spacing, spacing + 2, parameters.spacing);
+  parameters.window = this->drrGen->GetOutputWindow();
+
+  const short* ctData = static_cast<const short*>(ctImage->GetScalarPointer());
+  if (!this->atlas->IsCompatible(ctData, ctImage->GetMTime(), parameters))
+  {
+    // 与drrGen共享CT, 不重复编码
+    double ctSpacing[3];
+    ctVolume->GetSpacing(ctSpacing);
+    this->drrGen->SetInputData(ctImage, ctSpacing);
+    this->atlas->Start(this->drrGen->GetVolume(), parameters, angle * dtr);
+  }
+  return true;
+}
+
+bool vtkSlicerDRRGeneratorLogic::previewDRR(vtkMRMLScalarVolumeNode* ctVolume, vtkMRMLScalarVolumeNode* drrVolume,
+                                            double angle, double threshold, double scd, double rotation[3],
+                                            double translation[3], int size[3], double spacing[3])
+{
+  DRRTrace::Scope trace("previewDRR", "logic");
+  if (!this->atlasEnabled ||
+      !this->updateAtlas(ctVolume, angle, threshold, scd, rotation, translation, size, spacing))
+  {
+    return false;
+  }
+  vtkNew<vtkImageData> previewImage;
+  previewImage->SetDimensions(size[0], size[1], 1);
+  previewImage->SetSpacing(1.0, 1.0, 1.0);
+  previewImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  const double dtr = 0.017453292519943295;
+  if (!this->atlas->GetPreview(angle * dtr, static_cast<unsigned char*>(previewImage->GetScalarPointer())))
+  {
+    return false;
+  }
+  drrVolume->SetAndObserveImageData(previewImage.GetPointer());
+  drrVolume->Modified();
+  return true;
+}
+
+bool vtkSlicerDRRGeneratorLogic::setLabelMap(vtkMRMLLabelMapVolumeNode* labelVolume)
+{
+  return this->drrGen->SetLabelData(labelVolume ? labelVolume->GetImageData() : nullptr);
+}
+
+bool vtkSlicerDRRGeneratorLogic::getLabelDRR(vtkMRMLScalarVolumeNode* drrVolume,
+                                             vtkMRMLVectorVolumeNode* labelDRRVolume)
+{
+  vtkSmartPointer<vtkImageData> labelImage = this->drrGen->GetLabelOutput();
+  if (!labelImage)
+  {
+    std::cout << __FUNCTION__ << ": no label map has been set." << std::endl;
+    return false;
+  }
+  labelDRRVolume->CopyOrientation(drrVolume);
+  labelDRRVolume->SetAndObserveImageData(labelImage.GetPointer());
+  labelDRRVolume->StorableModified();
+  labelDRRVolume->Modified();
+  return true;
+}
+
+bool vtkSlicerDRRGeneratorLogic::getSpectralDRR(vtkMRMLScalarVolumeNode* drrVolume,
+                                                vtkMRMLScalarVolumeNode* spectralVolume)
+{
+  vtkSmartPointer<vtkImageData> spectralImage = this->drrGen->GetSpectralOutput();
+  if (!spectralImage)
+  {
+    std::cout << __FUNCTION__ << ": spectral rendering is not enabled." << std::endl;
+    return false;
+  }
+  spectralVolume->CopyOrientation(drrVolume);
+  spectralVolume->SetAndObserveImageData(spectralImage.GetPointer());
+  spectralVolume->StorableModified();
+  spectralVolume->Modified();
+  return true;
+}
+
 void vtkSlicerDRRGeneratorLogic::getFiducialPosition(vtkMRMLScalarVolumeNode* volumeNode,
                                                      vtkMRMLMarkupsFiducialNode* pointNode,
                                                      IJKVec& ijkPoints)
 {
-  double rasPos[3]{}, point3D[3]{}, point2D[2]{}, origin[3];
-  volumeNode->GetOrigin(origin);
-  ijkPoints.clear();
+  vtkNew<vtkPoints> rasPoints;
+  rasPoints->SetNumberOfPoints(pointNode->GetNumberOfControlPoints());
+  double rasPos[3]{};
   for (int i = 0; i < pointNode->GetNumberOfControlPoints(); i++)
   {
     pointNode->GetNthControlPointPosition(i, rasPos);
+    rasPoints->SetPoint(i, rasPos);
+  }
+  this->projectPoints(volumeNode, rasPoints, ijkPoints);
+}
+
+void vtkSlicerDRRGeneratorLogic::projectPoints(vtkMRMLScalarVolumeNode* volumeNode, vtkPoints* rasPoints,
+                                               IJKVec& ijkPoints)
+{
+  static_assert(sizeof(IJKVec::value_type) == 2 * sizeof(double), "IJKVec must be tightly packed");
+  double origin[3], rasPos[3];
+  volumeNode->GetOrigin(origin);
+  const vtkIdType count = rasPoints->GetNumberOfPoints();
+  std::vector<double> lps(3 * count);
+  for (vtkIdType i = 0; i < count; i++)
+  {
+    rasPoints->GetPoint(i, rasPos);
     // !RAS -> LPS 计算Camera2LPS时, 认为CT origin为0, 0, 0
     // !但实际在CT上选点的时候origin时不为0的,所以要减掉
-    point3D[0] = -(rasPos[0] - origin[0]);
-    point3D[1] = -(rasPos[1] - origin[1]);
-    point3D[2] = rasPos[2] - origin[2];
-    this->drrGen->GetFiducialPosition(point3D, point2D);
-    ijkPoints.push_back({point2D[0], point2D[1]});
+    lps[3 * i] = -(rasPos[0] - origin[0]);
+    lps[3 * i + 1] = -(rasPos[1] - origin[1]);
+    lps[3 * i + 2] = rasPos[2] - origin[2];
   }
-}
\ No newline at end of file
+  ijkPoints.resize(count);
+  if (count > 0) this->drrGen->ProjectPoints(lps.data(), count, ijkPoints[0].data());
+}
+
+bool vtkSlicerDRRGeneratorLogic::renderDataset(const std::string& fileName, vtkMRMLScalarVolumeNode* ctVolume,
+                                               const std::vector<DRRPose>& poses, double threshold, double scd,
+                                               int size[3], double spacing[3],
+                                               vtkMRMLMarkupsFiducialNode* fiducials, bool compress)
+{
+  vtkImageData* ctImage = ctVolume ? ctVolume->GetImageData() : nullptr;
+  if (!ctImage || ctImage->GetScalarType() != VTK_SHORT)
+  {
+    std::cout << __FUNCTION__ << ": the CT must be a short volume." << std::endl;
+    return false;
+  }
+  auto begin = std::chrono::steady_clock::now();
+  double ctSpacing[3];
+  ctVolume->GetSpacing(ctSpacing);
+
+  // 使用单独的渲染上下文, 不改变drrGen的位姿, 结果和增量渲染的状态; 新的上下文不做增量渲染,
+  // 数据集中只保存精确渲染的帧. CT与drrGen相同时共享其缓存
+  std::shared_ptr<DRRGenerator> context = this->newRenderContext();
+  context->SetInputData(ctImage, ctSpacing);
+  context->SetSourceToDetectorDistance(scd);
+  context->SetThreshold(threshold);
+  context->SetSpacing(spacing);
+  context->SetSize(size);
+  context->SetSuperSampling(this->drrGen->GetSuperSampling());
+  context->SetFastProjection(this->drrGen->GetFastProjection());
+
+  DRRDatasetWriter writer;
+  writer.SetCompression(compress ? DRRDatasetWriter::Delta : DRRDatasetWriter::None);
+  const int frameSize[2]{size[0], size[1]};
+  const double frameSpacing[2]{spacing[0], spacing[1]};
+  if (!writer.Open(fileName, frameSize, frameSpacing))
+  {
+    std::cout << __FUNCTION__ << ": cannot create \"" << fileName << "\"." << std::endl;
+    return false;
+  }
+
+  // 标记点的LPS坐标, 同projectPoints
+  double origin[3], rasPos[3];
+  ctVolume->GetOrigin(origin);
+  const int pointCount = fiducials ? fiducials->GetNumberOfControlPoints() : 0;
+  std::vector<double> lps(3 * pointCount), projected(2 * pointCount);
+  for (int i = 0; i < pointCount; i++)
+  {
+    fiducials->GetNthControlPointPosition(i, rasPos);
+    lps[3 * i] = -(rasPos[0] - origin[0]);
+    lps[3 * i + 1] = -(rasPos[1] - origin[1]);
+    lps[3 * i + 2] = rasPos[2] - origin[2];
+  }
+
+  // 数据集中的pose同DRRGenerator::GetPose, 角度为弧度
+  const double dtr = 0.017453292519943295;
+  bool succeeded = true;
+  for (size_t n = 0; n < poses.size() && succeeded; n++)
+  {
+    DRRPose pose;
+    pose.angle = poses[n].angle * dtr;
+    for (int i = 0; i < 3; i++)
+    {
+      pose.rotation[i] = poses[n].rotation[i] * dtr;
+      pose.translation[i] = poses[n].translation[i];
+    }
+    context->SetPose(pose);
+    context->Update();
+    if (pointCount > 0) context->ProjectPoints(lps.data(), pointCount, projected.data());
+    succeeded = writer.Append(context->GetRawOutput(), pose, projected.data(), pointCount);
+  }
+  succeeded = writer.Close() && succeeded;
+
+  std::cout << "Wrote " << writer.GetFrameCount() << " frames to " << fileName << " in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() << " s" << std::endl;
+  return succeeded;
+}
@@ -29,14 +29,25 @@
 
 // STD includes
 #include <array>
+#include <cstdint>
 #include <cstdlib>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "vtkSlicerDRRGeneratorModuleLogicExport.h"
+class DRRAtlas;
+class DRRCinePlayer;
+class DRRFrameCache;
 class DRRGenerator;
+class DRRMappedVolume;
+struct DRROutputWindow;
+struct DRRPose;
+class vtkMRMLLabelMapVolumeNode;
 class vtkMRMLMarkupsFiducialNode;
 class vtkMRMLScalarVolumeNode;
+class vtkMRMLVectorVolumeNode;
+class vtkPoints;
 
 /// \ingroup Slicer_QtModules_ExtensionTemplate
 class VTK_SLICER_DRRGENERATOR_MODULE_LOGIC_EXPORT vtkSlicerDRRGeneratorLogic
@@ -57,8 +68,77 @@ class VTK_SLICER_DRRGENERATOR_MODULE_LOGIC_EXPORT vtkSlicerDRRGeneratorLogic
   void applyDRR(vtkMRMLScalarVolumeNode*, vtkMRMLScalarVolumeNode*, double angle, double threshold,
                 double scd, double rotation[3], double translation[3], int size[3],
                 double spacing[3]);
+  /// Render from a CT file (.nrrd/.nhdr/.mha/.mhd) that is memory-mapped instead of loaded,
+  /// for volumes that do not fit in memory. Another file, or a file rewritten since it was mapped, is mapped anew;
+  /// render contexts and the atlas keep the previous mapping alive until they move to the new volume.
+  bool applyDRR(const std::string& volumeFile, vtkMRMLScalarVolumeNode*, double angle, double threshold,
+                double scd, double rotation[3], double translation[3], int size[3], double spacing[3]);
+  /// Label map aligned with the CT. Every non-zero label is projected into its own channel during
+  /// the same traversal as the DRR. Pass nullptr to render without label channels.
+  bool setLabelMap(vtkMRMLLabelMapVolumeNode*);
+  /// Store the per-label DRRs of the last applyDRR as a multi-component volume with the geometry of drrVolume.
+  bool getLabelDRR(vtkMRMLScalarVolumeNode* drrVolume, vtkMRMLVectorVolumeNode* labelDRRVolume);
+  /// Store the polychromatic projection of the last applyDRR (effective line integral, float).
+  /// Energy bins are configured through drrGen->GetSpectrum() and drrGen->SetSpectral(true).
+  bool getSpectralDRR(vtkMRMLScalarVolumeNode* drrVolume, vtkMRMLScalarVolumeNode* spectralVolume);
+  /// Pre-render views every step degrees between minAngle and maxAngle in the background on idle cores,
+  /// so that previewDRR can answer camera angle changes without a full render. Over a full turn the step is
+  /// rounded so that 360 degrees holds a whole number of views.
+  /// The atlas is rebuilt whenever any other parameter or the CT changes.
+  void setAtlas(bool enabled, double minAngle = -180, double maxAngle = 180, double step = 2);
+  /// Show a view interpolated from the two nearest atlas views in drrVolume.
+  /// Returns false if they are not rendered yet; the caller should then use applyDRR.
+  bool previewDRR(vtkMRMLScalarVolumeNode*, vtkMRMLScalarVolumeNode*, double angle, double threshold,
+                  double scd, double rotation[3], double translation[3], int size[3], double spacing[3]);
+  /// While a pose slider is dragged, produce frames by warping the last exact DRR when the pose only
+  /// moves in the detector plane. Turn it off and apply again once the interaction ends for an exact frame.
+  /// Whether a frame was warped, and how many pixels were re-traced, is in drrGen->GetStatistics().
+  void setIncremental(bool enabled);
+  /// Gray-level mapping of the DRR images: the full range, percentile clipping (robust to implants and metal)
+  /// or a fixed window of raw DRR values, each with an optional log/exponential transform. Percentiles come
+  /// from a histogram gathered while rendering, so auto-windowing costs no extra pass over the image.
+  void setOutputWindow(const DRROutputWindow& window);
   void getFiducialPosition(vtkMRMLScalarVolumeNode*, vtkMRMLMarkupsFiducialNode*, IJKVec&);
+  /// Project RAS points (fiducials, mesh vertices, segment surfaces...) of the CT onto the DRR
+  /// in one batch, using the pose of the last applyDRR.
+  void projectPoints(vtkMRMLScalarVolumeNode*, vtkPoints* rasPoints, IJKVec&);
+  /// Render the CT at every pose (angles in degrees, as in applyDRR) into a DRRDataset file with the poses
+  /// and the projected fiducials. The file stores the poses in radians, as DRRGenerator::GetPose does.
+  /// Frames are compressed and written on a background thread while the next ones render; read them back
+  /// with DRRDatasetReader. Rendering uses its own context and leaves drrGen and its output unchanged.
+  bool renderDataset(const std::string& fileName, vtkMRMLScalarVolumeNode* ctVolume,
+                     const std::vector<DRRPose>& poses, double threshold, double scd, int size[3],
+                     double spacing[3], vtkMRMLMarkupsFiducialNode* fiducials = nullptr, bool compress = true);
+  /// Render a DRR straight to an NRRD file (.nrrd) one row band at a time, so that memory stays at a few bands
+  /// however large the detector is. The file holds 8-bit gray levels when a fixed output window is set and raw
+  /// DRR values (short) otherwise, with rows in the same order as applyDRR.
+  bool renderToFile(const std::string& fileName, vtkMRMLScalarVolumeNode* ctVolume, double angle,
+                    double threshold, double scd, double rotation[3], double translation[3], int size[3],
+                    double spacing[3]);
+  /// Play the CT as a cine loop over the camera angles (degrees) at fps frames per second. Rendering,
+  /// gray-level mapping and display of consecutive frames overlap; frames that cannot be shown in time are
+  /// dropped, and frames are rendered at half resolution while full-resolution rendering cannot keep up.
+  bool startCine(vtkMRMLScalarVolumeNode* ctVolume, const std::vector<double>& angles, double fps,
+                 double threshold, double scd, double rotation[3], double translation[3], int size[3],
+                 double spacing[3]);
+  /// Show the cine frame that is due in drrVolume. Call it from a GUI timer at least at the frame rate;
+  /// returns false once the last frame has been shown.
+  bool updateCine(vtkMRMLScalarVolumeNode* drrVolume);
+  void stopCine();
+  /// The interactive render context. drrGen->GetStatistics() describes its last render: time, projector,
+  /// NUMA placement (policy, nodes, volume copies, page kind, threads per node), warp and culling.
   std::shared_ptr<DRRGenerator> drrGen;
+  /// A new render context on the CT of the last applyDRR, with the same encoding, NUMA, volume copy and output
+  /// window options. Contexts share the volume and its caches with drrGen, and can render concurrently from
+  /// any thread. A context holds only its pose, options and last output; render buffers are allocated on its first
+  /// Update, or shared through SetScratch between contexts that take turns on one thread.
+  std::shared_ptr<DRRGenerator> newRenderContext() const;
+  std::shared_ptr<const DRRMappedVolume> mappedVolume;
+  /// Finished DRRs by CT and render parameters; applyDRR reuses a frame instead of rendering it again.
+  /// Bounded by frameCache->SetCapacity (bytes), hit/miss counts via GetHits/GetMisses, and whether the last
+  /// cache lookup of applyDRR hit via GetLastHit.
+  std::shared_ptr<DRRFrameCache> frameCache;
+  std::shared_ptr<DRRCinePlayer> cinePlayer;
 
  protected:
   vtkSlicerDRRGeneratorLogic();
@@ -72,6 +152,18 @@ class VTK_SLICER_DRRGENERATOR_MODULE_LOGIC_EXPORT vtkSlicerDRRGeneratorLogic
   void OnMRMLSceneNodeAdded(vtkMRMLNode* node) override;
   void OnMRMLSceneNodeRemoved(vtkMRMLNode* node) override;
 
+  /// volumeId and volumeMTime identify the CT in the frame cache.
+  void updateDRR(vtkMRMLScalarVolumeNode*, uint64_t volumeId, uint64_t volumeMTime, double angle,
+                 double threshold, double scd, double rotation[3], double translation[3], int size[3],
+                 double spacing[3]);
+  /// Restart the atlas if it does not match the CT and parameters. Returns false if the CT is unsupported.
+  bool updateAtlas(vtkMRMLScalarVolumeNode*, double angle, double threshold, double scd, double rotation[3],
+                   double translation[3], int size[3], double spacing[3]);
+
+  std::shared_ptr<DRRAtlas> atlas;
+  bool atlasEnabled;
+  double atlasAngles[3];  // min, max, step (degrees)
+
  private:
   vtkSlicerDRRGeneratorLogic(const vtkSlicerDRRGeneratorLogic&);  // Not implemented
   void operator=(const vtkSlicerDRRGeneratorLogic&);              // Not implemented
@@ -0,0 +1,86 @@
+#include "DRRRenderServer.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace
+{
+DRRRenderServer* RunningServer = nullptr;
+
+void HandleSignal(int)
+{
+  if (RunningServer) RunningServer->Stop();
+}
+
+void PrintUsage(const char* program)
+{
+  std::cerr << "Usage: " << program << " [options] volume1.nrrd [volume2.mha ...]\n"
+            << "  --socket PATH      Unix-domain socket to listen on (default /tmp/drr-render.sock)\n"
+            << "  --workers N        render threads, 0 for one per core (default 0)\n"
+            << "  --batch N          maximum requests per batch (default 32)\n"
+            << "  --window MS        time to wait for a batch to fill (default 1)\n"
+            << "  --slots N          shared memory frames per connection (default 8)\n"
+            << "  --slot-bytes N     bytes per frame (default 2 MiB)\n"
+            << "  --report SECONDS   latency/throughput report interval, 0 to disable (default 10)" << std::endl;
+}
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  DRRRenderServer server;
+  std::string socketPath = "/tmp/drr-render.sock";
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string argument = argv[i];
+    const bool hasValue = i + 1 < argc;
+    if (argument == "--help" || argument == "-h")
+    {
+      PrintUsage(argv[0]);
+      return EXIT_SUCCESS;
+    }
+    else if (argument == "--socket" && hasValue)
+      socketPath = argv[++i];
+    else if (argument == "--workers" && hasValue)
+      server.SetWorkerCount(std::atoi(argv[++i]));
+    else if (argument == "--batch" && hasValue)
+      server.SetMaxBatchSize(std::atoi(argv[++i]));
+    else if (argument == "--window" && hasValue)
+      server.SetBatchWindow(std::atof(argv[++i]));
+    else if (argument == "--slots" && hasValue)
+      server.SetSlotCount(std::atoi(argv[++i]));
+    else if (argument == "--slot-bytes" && hasValue)
+      server.SetSlotBytes(std::strtoull(argv[++i], nullptr, 10));
+    else if (argument == "--report" && hasValue)
+      server.SetReportInterval(std::atof(argv[++i]));
+    else if (argument.compare(0, 2, "--") == 0)
+    {
+      std::cerr << "Unknown option " << argument << std::endl;
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+    else if (!server.AddVolume(argument))
+    {
+      return EXIT_FAILURE;
+    }
+    else
+    {
+      std::cout << "Volume " << server.GetVolumeCount() - 1 << ": " << argument << std::endl;
+    }
+  }
+  if (server.GetVolumeCount() == 0)
+  {
+    PrintUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (!server.Listen(socketPath)) return EXIT_FAILURE;
+
+  RunningServer = &server;
+  std::signal(SIGINT, HandleSignal);
+  std::signal(SIGTERM, HandleSignal);
+  server.Run();
+  RunningServer = nullptr;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+#include "DRRDataset.h"
+#include "DRRTestingPhantoms.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+// 数据集文件的写入和读取: 不压缩和差分压缩时, 读回的size, spacing, 每帧的图像, pose和投影标记点都与写入的完全相同.
+// 块很小时帧跨越多个块; 压缩后不小于原图的噪声帧按原样存储; 没有标记点的帧读回0个点.
+
+namespace
+{
+const int DRRSize[2]{48, 40};
+const double DRRSpacing[2]{2.0, 2.5};
+
+struct Frame
+{
+  std::vector<short> image;
+  DRRPose pose;
+  std::vector<double> fiducials;
+};
+
+std::vector<Frame> CreateFrames(vtkImageData* phantom, double spacing[3])
+{
+  DRRGenerator generator;
+  SetupGenerator(generator, phantom, spacing, DRRSize[0], DRRSize[1], DRRSpacing[0]);
+  generator.SetSpacing(DRRSpacing[0], DRRSpacing[1], 1.0);
+  const double markers[6]{10, 20, 30, 40, 35, 25};
+  const size_t pixelCount = static_cast<size_t>(DRRSize[0]) * DRRSize[1];
+
+  std::vector<Frame> frames(7);
+  for (size_t n = 0; n < frames.size(); n++)
+  {
+    Frame& frame = frames[n];
+    frame.pose.angle = 0.45 * n;
+    frame.pose.rotation[1] = 0.03 * n;
+    frame.pose.translation[0] = 1.5 * n - 4;
+    generator.SetPose(frame.pose);
+    generator.Update();
+    frame.image.assign(generator.GetRawOutput(), generator.GetRawOutput() + pixelCount);
+    // 第3帧没有标记点, 其余的帧有1~3个
+    const size_t count = n == 3 ? 0 : n % 3 + 1;
+    frame.fiducials.resize(2 * count);
+    generator.ProjectPoints(markers, count, frame.fiducials.data());
+  }
+  // 差分后仍不能变小的噪声帧
+  std::mt19937 random(7);
+  std::uniform_int_distribution<int> noise(VTK_SHORT_MIN, VTK_SHORT_MAX);
+  for (short& value : frames[5].image) value = static_cast<short>(noise(random));
+  return frames;
+}
+
+bool TestRoundTrip(const std::vector<Frame>& frames, DRRDatasetWriter::Compression compression, size_t chunkBytes)
+{
+  const std::string fileName = "DRRDatasetTest.drrdataset";
+  {
+    DRRDatasetWriter writer;
+    writer.SetCompression(compression);
+    writer.SetChunkBytes(chunkBytes);
+    bool written = writer.Open(fileName, DRRSize, DRRSpacing);
+    for (const Frame& frame : frames)
+    {
+      written = written && writer.Append(frame.image.data(), frame.pose, frame.fiducials.data(),
+                                         frame.fiducials.size() / 2);
+    }
+    written = writer.Close() && written;
+    if (!written || writer.GetFrameCount() != frames.size())
+    {
+      std::printf("compression %d: cannot write %zu frames\n", compression, frames.size());
+      return false;
+    }
+  }
+
+  bool passed = true;
+  {
+    DRRDatasetReader reader;
+    if (!reader.Open(fileName) || reader.GetFrameCount() != frames.size() || reader.GetSize()[0] != DRRSize[0] ||
+        reader.GetSize()[1] != DRRSize[1] || reader.GetSpacing()[0] != DRRSpacing[0] ||
+        reader.GetSpacing()[1] != DRRSpacing[1])
+    {
+      std::printf("compression %d: unexpected header after reading back\n", compression);
+      std::remove(fileName.c_str());
+      return false;
+    }
+    std::vector<short> buffer;
+    for (size_t n = 0; n < frames.size(); n++)
+    {
+      const Frame& frame = frames[n];
+      const short* image = reader.GetFrame(n, buffer);
+      const DRRPose pose = reader.GetPose(n);
+      const double* points = nullptr;
+      const size_t count = reader.GetFiducials(n, points);
+      const bool samePose = pose.angle == frame.pose.angle &&
+                            std::equal(pose.rotation, pose.rotation + 3, frame.pose.rotation) &&
+                            std::equal(pose.translation, pose.translation + 3, frame.pose.translation);
+      if (!image || std::memcmp(image, frame.image.data(), frame.image.size() * sizeof(short)) != 0 || !samePose ||
+          count != frame.fiducials.size() / 2 ||
+          (count > 0 && std::memcmp(points, frame.fiducials.data(), frame.fiducials.size() * sizeof(double)) != 0))
+      {
+        std::printf("compression %d: frame %zu differs after reading back\n", compression, n);
+        passed = false;
+      }
+    }
+  }
+  std::remove(fileName.c_str());
+  return passed;
+}
+}  // namespace
+
+int DRRDatasetTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const int dims[3]{48, 44, 40};
+  double spacing[3]{1.2, 1.3, 1.5};
+  vtkSmartPointer<vtkImageData> phantom = CreateAnatomyPhantom(dims);
+  const std::vector<Frame> frames = CreateFrames(phantom, spacing);
+  const size_t frameBytes = static_cast<size_t>(DRRSize[0]) * DRRSize[1] * sizeof(short);
+
+  bool passed = true;
+  for (DRRDatasetWriter::Compression compression : {DRRDatasetWriter::None, DRRDatasetWriter::Delta})
+  {
+    // 每块两帧, 以及所有帧在一块中
+    passed = TestRoundTrip(frames, compression, 2 * frameBytes) && passed;
+    passed = TestRoundTrip(frames, compression, 64 * frameBytes) && passed;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
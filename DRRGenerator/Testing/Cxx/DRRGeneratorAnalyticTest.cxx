@@ -0,0 +1,125 @@
+#include "DRRTestingPhantoms.h"
+
+#include <cstdlib>
+
+// DRR的像素值为 ∫(HU - threshold)dl / |射线|, 其中射线从光源到探测器像素, 探测器平面经过isocenter.
+// 对均匀立方体和球, 这个积分有解析解.
+// Siddon遍历把每一段射线计入它进入的体素, 在材料边界处会多算或少算一段, 因此容差以体素为单位.
+
+namespace
+{
+const int VolumeSize = 128;
+const double VolumeSpacing = 1.0;
+const short Value = 10000;
+const double Scd = 500;
+const int DRRSize = 96;
+
+DRRGenerator* CreateGenerator(vtkImageData* volume, double angle)
+{
+  DRRGenerator* generator = new DRRGenerator;
+  double spacing[3]{VolumeSpacing, VolumeSpacing, VolumeSpacing};
+  generator->SetInputData(volume, spacing);
+  generator->SetSize(DRRSize, DRRSize, 1);
+  generator->SetSpacing(1.0, 1.0, 1.0);
+  generator->SetSourceToDetectorDistance(Scd);
+  generator->SetThreshold(0);
+  generator->SetAngle(angle);
+  return generator;
+}
+
+// 像素中心在探测器平面上相对isocenter的坐标(mm)
+double DetectorOffset(int index)
+{
+  return index - (DRRSize - 1) * 0.5;
+}
+
+// 一个体素长度的线积分
+double VoxelIntegral(double rayLength)
+{
+  return VolumeSpacing * Value / rayLength;
+}
+
+// 穿过立方体前后两个面的射线, 长度与|射线|之比恒为edge / scd, 在立方体投影之外为0.
+// 快速投影沿体素轴累加, 没有边界误差
+bool TestCube(bool fastProjection)
+{
+  const double edge = 60;
+  vtkSmartPointer<vtkImageData> cube = CreateCubePhantom(VolumeSize, VolumeSpacing, edge, Value);
+  const double inner = edge / 2 * Scd / (Scd + edge / 2) - 1;
+  const double outer = edge / 2 * Scd / (Scd - edge / 2) + 1;
+  bool passed = true;
+  for (double angle : {0.0, M_PI / 2, M_PI, 3 * M_PI / 2})
+  {
+    std::unique_ptr<DRRGenerator> generator(CreateGenerator(cube, angle));
+    generator->SetFastProjection(fastProjection);
+    generator->Update();
+    const short* drr = generator->GetRawOutput();
+    int failures = 0;
+    for (int j = 0; j < DRRSize; j++)
+      for (int i = 0; i < DRRSize; i++)
+      {
+        const double u = std::abs(DetectorOffset(i)), w = std::abs(DetectorOffset(j));
+        double expected;
+        if (u < inner && w < inner)
+          expected = edge * Value / Scd;
+        else if (u > outer || w > outer)
+          expected = 0;
+        else
+          continue;
+        const double tolerance = fastProjection ? 1.0 : VoxelIntegral(Scd) + 1;
+        if (!CheckNear("cube pixel", drr[i + j * DRRSize], expected, tolerance) && ++failures > 5) break;
+      }
+    if (failures > 0)
+    {
+      std::printf("cube at angle %g (fast projection %d) failed\n", angle, fastProjection);
+      passed = false;
+    }
+  }
+  return passed;
+}
+
+// 射线到球心的距离d = scd * r / |射线|, 弦长为2 * sqrt(R^2 - d^2);
+// 体素化的球面和边界处的遍历误差使弦长的两端各有一到两个体素的误差
+bool TestSphere()
+{
+  const double radius = 40;
+  vtkSmartPointer<vtkImageData> sphere = CreateSpherePhantom(VolumeSize, VolumeSpacing, radius, Value);
+  bool passed = true;
+  for (double angle : {0.0, 0.7, 2.0})
+  {
+    std::unique_ptr<DRRGenerator> generator(CreateGenerator(sphere, angle));
+    generator->Update();
+    const short* drr = generator->GetRawOutput();
+    double errorSum = 0, expectedSum = 0;
+    int failures = 0;
+    for (int j = 0; j < DRRSize; j++)
+      for (int i = 0; i < DRRSize; i++)
+      {
+        const double r2 = DetectorOffset(i) * DetectorOffset(i) + DetectorOffset(j) * DetectorOffset(j);
+        const double rayLength = std::sqrt(Scd * Scd + r2);
+        const double d = Scd * std::sqrt(r2) / rayLength;
+        if (d > radius - 3 * VolumeSpacing) continue;
+        const double expected = 2 * std::sqrt(radius * radius - d * d) * Value / rayLength;
+        const double tolerance = 3 * VoxelIntegral(rayLength) + 1;
+        if (!CheckNear("sphere pixel", drr[i + j * DRRSize], expected, tolerance) && ++failures > 5) break;
+        errorSum += std::abs(drr[i + j * DRRSize] - expected);
+        expectedSum += expected;
+      }
+    if (failures > 0 || errorSum > 0.02 * expectedSum)
+    {
+      std::printf("sphere at angle %g: %d pixels out of tolerance, mean relative error %g\n", angle, failures,
+                  errorSum / expectedSum);
+      passed = false;
+    }
+  }
+  return passed;
+}
+}  // namespace
+
+int DRRGeneratorAnalyticTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  bool passed = TestCube(false);
+  passed = TestCube(true) && passed;
+  passed = TestSphere() && passed;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
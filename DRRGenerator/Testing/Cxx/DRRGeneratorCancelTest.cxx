@@ -0,0 +1,162 @@
+#include "DRRTestingPhantoms.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+// 可取消的渲染: 开始前已取消或超时的token直接返回对应的状态, 不渲染任何block;
+// 完整的渲染(逐block, 按slab和增量变换)的进度最终等于总数, 回调每个block恰好一次;
+// 在回调中取消后不再领取新的block, 已完成的block与完整渲染相同; Reset后的token可以再次使用.
+
+namespace
+{
+const int DRRSize = 64;
+const int BlockSize = 16;
+const int TileCount = (DRRSize / BlockSize) * (DRRSize / BlockSize);
+
+void Setup(DRRGenerator& generator, vtkImageData* phantom, double spacing[3])
+{
+  SetupGenerator(generator, phantom, spacing, DRRSize, DRRSize, 2.0);
+  generator.SetBlockSize(BlockSize);
+  generator.SetPose(CreatePose(0.6, 0.1, 0, 0, 0, 0, 4));
+}
+
+bool CheckStatus(const char* what, DRRRenderStatus status, DRRRenderStatus expected)
+{
+  if (status == expected) return true;
+  std::printf("%s: status %d, expected %d\n", what, status, expected);
+  return false;
+}
+
+// 回调的次数和最后一次的计数都应等于总数; 单线程时计数依次加1
+struct ProgressRecorder
+{
+  int calls = 0, lastCompleted = 0, lastTotal = 0;
+  bool ordered = true;
+  void operator()(int completed, int total)
+  {
+    ordered = ordered && completed == calls + 1;
+    calls++;
+    lastCompleted = completed;
+    lastTotal = total;
+  }
+};
+
+// 完整渲染, 得到的总数由调用者检查
+bool CheckCompleted(const char* what, DRRGenerator& generator, int& total)
+{
+  DRRRenderToken token;
+  ProgressRecorder recorder;
+  token.SetProgressCallback(std::ref(recorder));
+  bool passed = CheckStatus(what, generator.Update(token), DRRRenderCompleted);
+  total = token.GetTotalTiles();
+  if (token.GetCompletedTiles() != total || token.GetProgress() != 1.0 || recorder.calls != total ||
+      recorder.lastCompleted != total || recorder.lastTotal != total || !recorder.ordered)
+  {
+    std::printf("%s: %d of %d tiles, %d callbacks (last %d of %d)\n", what, token.GetCompletedTiles(), total,
+                recorder.calls, recorder.lastCompleted, recorder.lastTotal);
+    passed = false;
+  }
+  return passed;
+}
+}  // namespace
+
+int DRRGeneratorCancelTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const int dims[3]{64, 60, 56};
+  double spacing[3]{1.2, 1.3, 1.5};
+  vtkSmartPointer<vtkImageData> phantom = CreateAnatomyPhantom(dims);
+  const size_t pixelCount = static_cast<size_t>(DRRSize) * DRRSize;
+
+  DRRGenerator reference;
+  Setup(reference, phantom, spacing);
+  reference.Update();
+  const std::vector<short> expected(reference.GetRawOutput(), reference.GetRawOutput() + pixelCount);
+
+  bool passed = true;
+  DRRGenerator generator;
+  Setup(generator, phantom, spacing);
+  generator.SetThreadCount(1);
+
+  // 开始之前已取消或已超时
+  {
+    DRRRenderToken token;
+    token.Cancel();
+    passed = CheckStatus("cancelled before start", generator.Update(token), DRRRenderCancelled) && passed;
+    DRRRenderToken expired;
+    expired.SetTimeout(0);
+    passed = CheckStatus("timed out before start", generator.Update(expired), DRRRenderTimedOut) && passed;
+    expired.Reset();
+    expired.SetDeadline(std::chrono::steady_clock::now() - std::chrono::seconds(1));
+    passed = CheckStatus("deadline in the past", generator.Update(expired), DRRRenderTimedOut) && passed;
+    if (token.GetCompletedTiles() != 0 || expired.GetCompletedTiles() != 0 || expired.GetTotalTiles() != 0)
+    {
+      std::printf("tiles were rendered after the token had stopped\n");
+      passed = false;
+    }
+  }
+
+  // 单线程时在回调中取消, 恰好完成cancelAfter个block, 它们与完整渲染相同
+  {
+    const int cancelAfter = 5;
+    DRRRenderToken token;
+    token.SetProgressCallback(
+        [&token, cancelAfter](int completed, int)
+        {
+          if (completed == cancelAfter) token.Cancel();
+        });
+    passed = CheckStatus("cancelled from the callback", generator.Update(token), DRRRenderCancelled) && passed;
+    if (token.GetCompletedTiles() != cancelAfter || token.GetTotalTiles() != TileCount)
+    {
+      std::printf("cancelled after %d of %d tiles, expected %d of %d\n", token.GetCompletedTiles(),
+                  token.GetTotalTiles(), cancelAfter, TileCount);
+      passed = false;
+    }
+    // block按行带领取: 第t个block覆盖列[(t / 4) * 16, +16)和行[(t % 4) * 16, +16)
+    const short* image = generator.GetRawOutput();
+    for (int tile = 0; tile < cancelAfter; tile++)
+    {
+      const int imin = (tile / (DRRSize / BlockSize)) * BlockSize, jmin = (tile % (DRRSize / BlockSize)) * BlockSize;
+      for (int j = jmin; j < jmin + BlockSize; j++)
+      {
+        const size_t row = imin + j * static_cast<size_t>(DRRSize);
+        if (std::memcmp(image + row, expected.data() + row, BlockSize * sizeof(short)) != 0)
+        {
+          std::printf("completed tile %d differs from the full render\n", tile);
+          passed = false;
+          break;
+        }
+      }
+    }
+
+    // Reset后再次使用同一个token得到完整的结果
+    token.Reset();
+    token.SetProgressCallback(nullptr);
+    passed = CheckStatus("reused token", generator.Update(token), DRRRenderCompleted) && passed;
+    if (std::memcmp(generator.GetRawOutput(), expected.data(), pixelCount * sizeof(short)) != 0)
+    {
+      std::printf("render with a reused token differs from Update()\n");
+      passed = false;
+    }
+  }
+
+  // 完整渲染的进度: 逐block; 增量变换; 按slab遍历时先初始化射线, 再计每个slab的每个block
+  int tiles = 0, warpTiles = 0, slabTiles = 0;
+  passed = CheckCompleted("tiles", generator, tiles) && passed;
+  generator.SetIncremental(true);
+  generator.Update();
+  DRRPose moved = generator.GetPose();
+  moved.translation[2] += 2;
+  generator.SetPose(moved);
+  passed = CheckCompleted("warp", generator, warpTiles) && passed;
+  passed = CheckNear("warped", generator.GetStatistics().warped, 1, 0) && passed;
+  generator.SetIncremental(false);
+  generator.SetSlabThickness(20);
+  passed = CheckCompleted("slabs", generator, slabTiles) && passed;
+  if (tiles != TileCount || warpTiles != TileCount || slabTiles <= 2 * TileCount)
+  {
+    std::printf("total tiles: %d, warp %d, slabs %d\n", tiles, warpTiles, slabTiles);
+    passed = false;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,94 @@
+#include "DRRTestingPhantoms.h"
+
+#include <cstdlib>
+
+// 空气中的一个小标记点: DRR中标记点投影的质心应与GetFiducialPosition计算的位置一致.
+// GetFiducialPosition给出的是上下翻转后(GetOutput)的图像坐标y, 对应未翻转图像中的Size[1] - y.
+
+namespace
+{
+const int VolumeSize = 96;
+const int DRRSize = 128;
+const int Marker[3]{30, 55, 62};  // 3x3x3的标记点中心的体素
+
+vtkSmartPointer<vtkImageData> CreateMarkerPhantom()
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetDimensions(VolumeSize, VolumeSize, VolumeSize);
+  image->AllocateScalars(VTK_SHORT, 1);
+  short* voxels = static_cast<short*>(image->GetScalarPointer());
+  for (int k = 0; k < VolumeSize; k++)
+    for (int j = 0; j < VolumeSize; j++)
+      for (int i = 0; i < VolumeSize; i++)
+      {
+        const bool marker =
+            std::abs(i - Marker[0]) <= 1 && std::abs(j - Marker[1]) <= 1 && std::abs(k - Marker[2]) <= 1;
+        voxels[i + VolumeSize * (j + static_cast<size_t>(VolumeSize) * k)] = marker ? 3000 : -1000;
+      }
+  return image;
+}
+}  // namespace
+
+int DRRGeneratorFiducialTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSmartPointer<vtkImageData> phantom = CreateMarkerPhantom();
+  double spacing[3]{1.0, 1.0, 1.0};
+  double markerLPS[3]{(Marker[0] + 0.5) * spacing[0], (Marker[1] + 0.5) * spacing[1], (Marker[2] + 0.5) * spacing[2]};
+  struct
+  {
+    double angle;
+    double rotation[3];
+    double translation[3];
+  } poses[] = {{0, {0, 0, 0}, {0, 0, 0}},       {M_PI / 2, {0, 0, 0}, {0, 0, 0}},   {0.4, {0, 0, 0}, {4, -7, 3}},
+               {-1.3, {0.2, 0, 0}, {0, 0, 0}}, {2.5, {0.1, -0.15, 0.3}, {-5, 2, 6}}};
+
+  bool passed = true;
+  for (const auto& pose : poses)
+  {
+    DRRGenerator generator;
+    generator.SetInputData(phantom, spacing);
+    generator.SetSize(DRRSize, DRRSize, 1);
+    generator.SetSpacing(1.0, 1.0, 1.0);
+    generator.SetSourceToDetectorDistance(800);
+    generator.SetThreshold(0);
+    generator.SetAngle(pose.angle);
+    generator.SetRotation(pose.rotation[0], pose.rotation[1], pose.rotation[2]);
+    generator.SetTranslation(pose.translation[0], pose.translation[1], pose.translation[2]);
+    generator.Update();
+
+    const short* drr = generator.GetRawOutput();
+    double weight = 0, centroid[2]{0, 0};
+    for (int j = 0; j < DRRSize; j++)
+      for (int i = 0; i < DRRSize; i++)
+      {
+        weight += drr[i + j * DRRSize];
+        centroid[0] += i * drr[i + j * DRRSize];
+        centroid[1] += j * drr[i + j * DRRSize];
+      }
+    if (weight <= 0)
+    {
+      std::printf("pose at angle %g: the marker is not visible\n", pose.angle);
+      passed = false;
+      continue;
+    }
+
+    double projected[2];
+    generator.GetFiducialPosition(markerLPS, projected);
+    // Siddon遍历把射线段计入进入的体素, 投影的质心最多偏移约半个体素
+    passed = CheckNear("marker i", centroid[0] / weight, projected[0], 0.5) && passed;
+    passed = CheckNear("marker j", centroid[1] / weight, DRRSize - projected[1], 0.5) && passed;
+
+    // 批量投影与逐点投影一致, 没有平移时isocenter投影到图像中心
+    double points[6]{markerLPS[0], markerLPS[1], markerLPS[2], VolumeSize * 0.5, VolumeSize * 0.5, VolumeSize * 0.5};
+    double batch[4];
+    generator.ProjectPoints(points, 2, batch);
+    passed = CheckNear("batch i", batch[0], projected[0], 1e-9) && passed;
+    passed = CheckNear("batch j", batch[1], projected[1], 1e-9) && passed;
+    if (pose.translation[0] == 0 && pose.translation[1] == 0 && pose.translation[2] == 0)
+    {
+      passed = CheckNear("isocenter i", batch[2], (DRRSize - 1) * 0.5, 1e-6) && passed;
+      passed = CheckNear("isocenter j", DRRSize - batch[3], (DRRSize - 1) * 0.5, 1e-6) && passed;
+    }
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
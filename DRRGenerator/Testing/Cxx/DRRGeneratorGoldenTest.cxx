@@ -0,0 +1,112 @@
+#include "DRRTestingPhantoms.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+// 与Testing/Data/Baseline中的DRR比较(64x64的short, 小端序, 未翻转).
+// 有意修改了渲染结果时, 以"--update"作为第二个参数运行一次, 重新生成基准图像.
+
+namespace
+{
+const int DRRSize = 64;
+
+struct GoldenPose
+{
+  double angle;
+  double rotation[3];
+  double translation[3];
+  double scd;
+};
+
+const GoldenPose Poses[] = {
+    {0.0, {0, 0, 0}, {0, 0, 0}, 1000},
+    {M_PI / 2, {0, 0, 0}, {0, 0, 0}, 1000},
+    {0.6, {0, 0, 0}, {5, -3, 8}, 700},
+    {-2.2, {0.15, 0, 0}, {0, 0, 0}, 600},
+    {1.1, {0, -0.2, 0.3}, {-6, 4, 0}, 900},
+    {M_PI, {0.05, 0.1, -0.15}, {2, 2, -10}, 500},
+};
+
+std::string BaselineName(const std::string& directory, size_t pose)
+{
+  return directory + "/DRRGolden" + std::to_string(pose) + ".raw";
+}
+
+bool Compare(const short* drr, const std::vector<short>& baseline, const char* what)
+{
+  int differences = 0, maxDifference = 0;
+  for (size_t i = 0; i < baseline.size(); i++)
+  {
+    const int difference = std::abs(drr[i] - baseline[i]);
+    // 允许不同编译器/指令集的浮点舍入差异
+    if (difference > 1) differences++;
+    maxDifference = std::max(maxDifference, difference);
+  }
+  if (differences == 0) return true;
+  std::printf("%s: %d pixels differ from the baseline, max difference %d\n", what, differences, maxDifference);
+  return false;
+}
+}  // namespace
+
+int DRRGeneratorGoldenTest(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::printf("Usage: %s <baseline directory> [--update]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const std::string directory = argv[1];
+  const bool update = argc > 2 && std::string(argv[2]) == "--update";
+
+  const int dims[3]{80, 72, 64};
+  double spacing[3]{0.9, 1.1, 1.4};
+  vtkSmartPointer<vtkImageData> phantom = CreateAnatomyPhantom(dims);
+  const size_t pixelCount = static_cast<size_t>(DRRSize) * DRRSize;
+
+  bool passed = true;
+  for (size_t n = 0; n < sizeof(Poses) / sizeof(Poses[0]); n++)
+  {
+    const GoldenPose& pose = Poses[n];
+    DRRGenerator generator;
+    generator.SetInputData(phantom, spacing);
+    generator.SetSize(DRRSize, DRRSize, 1);
+    generator.SetSpacing(1.6, 1.6, 1.0);
+    generator.SetThreshold(-300);
+    generator.SetSourceToDetectorDistance(pose.scd);
+    generator.SetAngle(pose.angle);
+    generator.SetRotation(pose.rotation[0], pose.rotation[1], pose.rotation[2]);
+    generator.SetTranslation(pose.translation[0], pose.translation[1], pose.translation[2]);
+    generator.Update();
+
+    const std::string fileName = BaselineName(directory, n);
+    if (update)
+    {
+      std::ofstream file(fileName, std::ios::binary);
+      file.write(reinterpret_cast<const char*>(generator.GetRawOutput()), pixelCount * sizeof(short));
+      if (!file)
+      {
+        std::printf("Cannot write %s\n", fileName.c_str());
+        passed = false;
+      }
+      continue;
+    }
+
+    std::vector<short> baseline(pixelCount);
+    std::ifstream file(fileName, std::ios::binary);
+    if (!file.read(reinterpret_cast<char*>(baseline.data()), pixelCount * sizeof(short)))
+    {
+      std::printf("Cannot read %s\n", fileName.c_str());
+      passed = false;
+      continue;
+    }
+    const std::string what = "pose " + std::to_string(n);
+    passed = Compare(generator.GetRawOutput(), baseline, what.c_str()) && passed;
+
+    // slab顺序的遍历必须得到相同的结果
+    generator.SetSlabThickness(8);
+    generator.Update();
+    passed = Compare(generator.GetRawOutput(), baseline, (what + " slabs").c_str()) && passed;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,115 @@
+#include "DRRTestingPhantoms.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// 增量模式的误差界: 与精确帧相比只差平行于探测器的平移或绕射束轴的旋转时, 二维变换得到的每个像素
+// 不超出同一位姿精确DRR中该像素3x3邻域的[最小值, 最大值]加减值域的5%, 平均误差不超过值域的1%.
+// 误差主要来自双线性插值抹平骨块和标记点的边缘(单个像素可达值域的1/3), 以及不在isocenter深度的结构的视差.
+// 沿射束方向平移超过1/4像素或绕其他轴旋转时不能变换, 结果必须与精确渲染完全相同.
+
+namespace
+{
+const int DRRSize = 64;
+const double NeighborhoodTolerance = 0.05;  // 超出3x3邻域的部分, 按值域的比例
+const double MeanTolerance = 0.01;          // 平均绝对误差, 按值域的比例
+
+struct Move
+{
+  const char* name;
+  double angle;
+  double rotation[3];
+  double translation[3];
+  bool warped;  // 是否应当由二维变换得到
+};
+
+// angle时射束沿(-sin(angle), cos(angle), 0), 世界Z轴总是平行于探测器; 探测器对角线的一半约45个像素,
+// SDD为700时沿射束的平移不超过约3.9mm才能变换
+const Move Moves[] = {
+    {"tz 5mm", 0.3, {0, 0, 0}, {0, 0, 5}, true},
+    {"tz -8mm", 0.3, {0, 0, 0}, {0, 0, -8}, true},
+    {"in plane 5mm", 0.3, {0, 0, 0}, {5 * 0.955336, 5 * 0.295520, 0}, true},
+    {"mixed", 0.3, {0, 0, 0}, {3, -2, 4}, true},
+    {"tz 5mm, lateral", 1.2, {0, 0, 0}, {0, 0, 5}, true},
+    {"mixed, lateral", 1.2, {0, 0, 0}, {3, -2, 4}, true},
+    {"about the beam", 0.0, {0, 0.2, 0}, {0, 0, 0}, true},
+    {"along the beam 5mm", 0.3, {0, 0, 0}, {-5 * 0.295520, 5 * 0.955336, 0}, false},
+    {"about z", 0.3, {0, 0, 0.2}, {0, 0, 0}, false},
+    {"about x", 0.3, {0.2, 0, 0}, {0, 0, 0}, false},
+};
+
+bool TestMove(vtkImageData* phantom, double spacing[3], const Move& move)
+{
+  DRRPose base;
+  base.angle = move.angle;
+  DRRPose pose = base;
+  std::copy(move.rotation, move.rotation + 3, pose.rotation);
+  std::copy(move.translation, move.translation + 3, pose.translation);
+
+  // 先在base精确渲染作为源, 再移动到pose
+  DRRGenerator incremental;
+  SetupGenerator(incremental, phantom, spacing, DRRSize, DRRSize, 2.0);
+  incremental.SetIncremental(true);
+  incremental.SetPose(base);
+  incremental.Update();
+  incremental.SetPose(pose);
+  incremental.Update();
+
+  DRRGenerator exact;
+  SetupGenerator(exact, phantom, spacing, DRRSize, DRRSize, 2.0);
+  exact.SetPose(pose);
+  exact.Update();
+
+  if (incremental.GetStatistics().warped != move.warped)
+  {
+    std::printf("%s: warped is %d\n", move.name, incremental.GetStatistics().warped);
+    return false;
+  }
+  const short* result = incremental.GetRawOutput();
+  const short* reference = exact.GetRawOutput();
+  const size_t pixelCount = static_cast<size_t>(DRRSize) * DRRSize;
+  if (!move.warped)
+  {
+    if (std::memcmp(result, reference, pixelCount * sizeof(short)) == 0) return true;
+    std::printf("%s: not warped, but differs from the exact render\n", move.name);
+    return false;
+  }
+
+  const auto extremes = std::minmax_element(reference, reference + pixelCount);
+  const double range = *extremes.second - *extremes.first;
+  double errorSum = 0.0, worstExcess = 0.0;
+  for (int j = 0; j < DRRSize; j++)
+    for (int i = 0; i < DRRSize; i++)
+    {
+      int low = VTK_SHORT_MAX, high = VTK_SHORT_MIN;
+      for (int y = std::max(j - 1, 0); y <= std::min(j + 1, DRRSize - 1); y++)
+        for (int x = std::max(i - 1, 0); x <= std::min(i + 1, DRRSize - 1); x++)
+        {
+          low = std::min<int>(low, reference[x + y * DRRSize]);
+          high = std::max<int>(high, reference[x + y * DRRSize]);
+        }
+      const int value = result[i + j * DRRSize];
+      worstExcess = std::max(worstExcess, static_cast<double>(std::max(low - value, value - high)));
+      errorSum += std::abs(value - reference[i + j * DRRSize]);
+    }
+  const double meanError = errorSum / pixelCount;
+  if (worstExcess > NeighborhoodTolerance * range || meanError > MeanTolerance * range)
+  {
+    std::printf("%s: %.0f outside the neighborhood, mean error %.2f, range %.0f\n", move.name, worstExcess, meanError,
+                range);
+    return false;
+  }
+  return true;
+}
+}  // namespace
+
+int DRRGeneratorIncrementalTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const int dims[3]{64, 60, 56};
+  double spacing[3]{1.2, 1.3, 1.5};
+  vtkSmartPointer<vtkImageData> phantom = CreateAnatomyPhantom(dims);
+
+  bool passed = true;
+  for (const Move& move : Moves) passed = TestMove(phantom, spacing, move) && passed;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,137 @@
+#include "DRRTestingPhantoms.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// 特化的遍历内核(不判断体素索引边界, 按slab或不分slab)与通用内核的结果必须逐位相同: 覆盖各种CT编码和副本,
+// 标签和能谱通道, 超采样和按slab遍历. 阈值低于空气时包围盒即整个CT, 射线从CT的面离开, 大部分使用通用内核.
+
+namespace
+{
+const int DRRSize = 48;
+
+struct KernelCase
+{
+  const char* name;
+  double threshold;
+  DRREncodedVolume::Encoding encoding;
+  bool permuted;
+  int slabThickness;
+  DRRSuperSampling superSampling;
+  bool channels;  // 同时计算标签和能谱通道
+};
+
+const KernelCase Cases[] = {
+    {"plain", -300, DRREncodedVolume::None, false, 0, DRRSingleSample, false},
+    {"whole volume", -1100, DRREncodedVolume::None, false, 0, DRRSingleSample, false},
+    {"brick8", -300, DRREncodedVolume::Brick8, false, 0, DRRSingleSample, false},
+    {"packed12", -300, DRREncodedVolume::Packed12, false, 0, DRRSingleSample, false},
+    {"permuted", -300, DRREncodedVolume::None, true, 0, DRRSingleSample, false},
+    {"slabs", -300, DRREncodedVolume::None, false, 7, DRRSingleSample, false},
+    {"slabs, whole volume", -1100, DRREncodedVolume::None, false, 7, DRRSingleSample, false},
+    {"super sampling", -300, DRREncodedVolume::None, false, 0, DRRRotatedGrid, false},
+    {"channels", -300, DRREncodedVolume::None, false, 0, DRRSingleSample, true},
+    {"channels, slabs", -300, DRREncodedVolume::None, false, 5, DRRSingleSample, true},
+};
+
+// 包括射线平行于CT轴平面的正侧位, 以及CT部分位于视野之外的位姿
+const DRRPose Poses[] = {
+    CreatePose(0.0, 0, 0, 0, 0, 0, 0),
+    CreatePose(M_PI / 2, 0, 0, 0, 0, 0, 0),
+    CreatePose(0.7, 0.1, -0.2, 0.3, 4, -3, 6),
+    CreatePose(-2.4, 0, 0.5, 0, 0, 0, -20),
+    CreatePose(1.9, 0.4, 0, -0.1, 30, 10, 0),
+};
+
+struct KernelResult
+{
+  std::vector<short> image;
+  std::vector<float> labels;
+  std::vector<float> spectral;
+  int interiorRays;
+};
+
+// 标签1为骨块, 标签2为其余的软组织
+vtkSmartPointer<vtkImageData> CreateLabels(vtkImageData* phantom)
+{
+  vtkSmartPointer<vtkImageData> labels = vtkSmartPointer<vtkImageData>::New();
+  labels->SetDimensions(phantom->GetDimensions());
+  labels->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  const short* voxels = static_cast<const short*>(phantom->GetScalarPointer());
+  unsigned char* label = static_cast<unsigned char*>(labels->GetScalarPointer());
+  const size_t length = static_cast<size_t>(phantom->GetNumberOfPoints());
+  for (size_t i = 0; i < length; i++) label[i] = voxels[i] == 8000 ? 1 : voxels[i] > 0 ? 2 : 0;
+  return labels;
+}
+
+KernelResult Render(vtkImageData* phantom, vtkImageData* labels, double spacing[3], const KernelCase& kernelCase,
+                    const DRRPose& pose, bool specialized)
+{
+  DRRGenerator generator;
+  SetupGenerator(generator, phantom, spacing, DRRSize, DRRSize, 2.5);
+  generator.SetThreshold(kernelCase.threshold);
+  generator.SetVolumeEncoding(kernelCase.encoding);
+  generator.SetPermutedVolumes(kernelCase.permuted);
+  generator.SetSlabThickness(kernelCase.slabThickness);
+  generator.SetSuperSampling(kernelCase.superSampling);
+  generator.SetKernelSpecialization(specialized);
+  if (kernelCase.channels)
+  {
+    generator.SetLabelData(labels);
+    generator.SetSpectral(true);
+    generator.GetSpectrum().AddBin(0.6, 0.25, 0.5);
+    generator.GetSpectrum().AddBin(0.4, 0.18, 0.3);
+  }
+  generator.SetPose(pose);
+  generator.Update();
+
+  KernelResult result;
+  const size_t pixelCount = static_cast<size_t>(DRRSize) * DRRSize;
+  result.image.assign(generator.GetRawOutput(), generator.GetRawOutput() + pixelCount);
+  if (kernelCase.channels)
+  {
+    vtkSmartPointer<vtkImageData> labelOutput = generator.GetLabelOutput();
+    const float* channels = static_cast<const float*>(labelOutput->GetScalarPointer());
+    result.labels.assign(channels, channels + pixelCount * generator.GetLabelValues().size());
+    vtkSmartPointer<vtkImageData> spectralOutput = generator.GetSpectralOutput();
+    const float* spectral = static_cast<const float*>(spectralOutput->GetScalarPointer());
+    result.spectral.assign(spectral, spectral + pixelCount);
+  }
+  result.interiorRays = generator.GetStatistics().interiorRayCount;
+  return result;
+}
+}  // namespace
+
+int DRRGeneratorKernelTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const int dims[3]{56, 50, 44};
+  double spacing[3]{1.1, 1.3, 1.7};
+  vtkSmartPointer<vtkImageData> phantom = CreateAnatomyPhantom(dims);
+  vtkSmartPointer<vtkImageData> labels = CreateLabels(phantom);
+
+  bool passed = true;
+  for (const KernelCase& kernelCase : Cases)
+  {
+    int interiorRays = 0, generic = 0;
+    for (size_t n = 0; n < sizeof(Poses) / sizeof(Poses[0]); n++)
+    {
+      const KernelResult specialized = Render(phantom, labels, spacing, kernelCase, Poses[n], true);
+      const KernelResult reference = Render(phantom, labels, spacing, kernelCase, Poses[n], false);
+      interiorRays += specialized.interiorRays;
+      generic += reference.interiorRays;
+      if (specialized.image != reference.image || specialized.labels != reference.labels ||
+          specialized.spectral != reference.spectral)
+      {
+        std::printf("%s, pose %zu: specialized kernels differ from the generic kernel\n", kernelCase.name, n);
+        passed = false;
+      }
+    }
+    // 关闭特化时不应有射线使用不判断边界的内核; 打开时CT内容远离边界的情形应当用到它
+    if (generic != 0 || (kernelCase.threshold > -1000 && interiorRays == 0))
+    {
+      std::printf("%s: %d interior rays with specialization, %d without\n", kernelCase.name, interiorRays, generic);
+      passed = false;
+    }
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,251 @@
+#include "DRRTestingPhantoms.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// 不改变结果的渲染选项与基准逐位比较: 包围盒裁剪和block剔除的开与关, 轴置换的CT副本与原数据,
+// 流式输出的行带与Update后翻转的结果(原始值, 固定窗口的灰度和直方图).
+// GetOutput的灰度映射与按文档独立计算的结果比较: 全范围, 固定窗口(包括空区间), 百分位, 对数和指数变换.
+
+namespace
+{
+const int DRRSize[2]{64, 56};
+const int BlockSize = 16;
+
+// 正位, 侧位, 射线沿CT的Z轴, 一般的斜位, 以及CT大部分移出视野
+const DRRPose Poses[] = {
+    CreatePose(0.0, 0, 0, 0, 0, 0, 0),
+    CreatePose(M_PI / 2, 0, 0, 0, 0, 0, 0),
+    CreatePose(0.0, M_PI / 2, 0, 0, 0, 0, 0),
+    CreatePose(0.7, 0.1, -0.2, 0.3, 4, -3, 6),
+    CreatePose(1.9, 0.4, 0, -0.1, 90, 10, -70),
+};
+
+// 探测器比CT的投影大得多, 包围盒之外的block可以剔除
+void Setup(DRRGenerator& generator, vtkImageData* phantom, double spacing[3], const DRRPose& pose)
+{
+  SetupGenerator(generator, phantom, spacing, DRRSize[0], DRRSize[1], 4.0);
+  generator.SetBlockSize(BlockSize);
+  generator.SetPose(pose);
+}
+
+std::vector<short> RawOutput(const DRRGenerator& generator)
+{
+  return std::vector<short>(generator.GetRawOutput(),
+                            generator.GetRawOutput() + static_cast<size_t>(DRRSize[0]) * DRRSize[1]);
+}
+
+bool TestClipping(vtkImageData* phantom, double spacing[3])
+{
+  // 除固定的位姿外, 逐步平移使包围盒投影的边缘扫过block的边界
+  std::vector<DRRPose> poses(Poses, Poses + sizeof(Poses) / sizeof(Poses[0]));
+  for (int k = 0; k < 24; k++) poses.push_back(CreatePose(0.25 * k, 0.05 * k, 0, 0, 2.7 * k - 30, 0, 3.1 * k - 35));
+
+  bool passed = true;
+  int culled = 0;
+  for (size_t n = 0; n < poses.size(); n++)
+  {
+    DRRGenerator clipped, reference;
+    Setup(clipped, phantom, spacing, poses[n]);
+    Setup(reference, phantom, spacing, poses[n]);
+    reference.SetContentClipping(false);
+    clipped.Update();
+    reference.Update();
+    culled += clipped.GetStatistics().culledTileCount;
+    if (RawOutput(clipped) != RawOutput(reference) || reference.GetStatistics().culledTileCount != 0)
+    {
+      std::printf("pose %zu: content clipping changes the DRR\n", n);
+      passed = false;
+    }
+  }
+  return CheckNear("poses with culled tiles", culled > 0, 1, 0) && passed;
+}
+
+bool TestPermuted(vtkImageData* phantom, double spacing[3])
+{
+  bool passed = true;
+  bool contiguous[3]{false, false, false};
+  for (size_t n = 0; n < sizeof(Poses) / sizeof(Poses[0]); n++)
+  {
+    DRRGenerator permuted, reference;
+    Setup(permuted, phantom, spacing, Poses[n]);
+    Setup(reference, phantom, spacing, Poses[n]);
+    permuted.SetPermutedVolumes(true);
+    permuted.Update();
+    reference.Update();
+    contiguous[permuted.GetStatistics().contiguousAxis] = true;
+    if (RawOutput(permuted) != RawOutput(reference) || reference.GetStatistics().contiguousAxis != 0)
+    {
+      std::printf("pose %zu: the permuted volume changes the DRR\n", n);
+      passed = false;
+    }
+  }
+  // 射线主要沿Y和沿Z的位姿都应改用副本
+  if (!contiguous[1] || !contiguous[2])
+  {
+    std::printf("permuted volumes were not used for both the Y and Z axes\n");
+    passed = false;
+  }
+  return passed;
+}
+
+// 输出图像第row行对应原始DRR的第Size[1] - 1 - row行
+bool TestStreaming(vtkImageData* phantom, double spacing[3], const DRRPose& pose, int bandRows)
+{
+  DRROutputWindow window;
+  window.mode = DRRWindowFixed;
+  window.level = 150;
+  window.width = 200;
+
+  DRRGenerator reference;
+  Setup(reference, phantom, spacing, pose);
+  reference.SetOutputWindow(window);
+  reference.Update();
+  const std::vector<short> expected = RawOutput(reference);
+  std::vector<unsigned char> lut;
+  int low;
+  reference.GetOutputLookupTable(lut, low);
+  const int last = static_cast<int>(lut.size()) - 1;
+
+  DRRGenerator generator;
+  Setup(generator, phantom, spacing, pose);
+  generator.SetOutputWindow(window);
+  int nextRow = 0, mismatches = 0;
+  const bool completed = generator.UpdateStreaming(
+      [&](const DRROutputBand& band)
+      {
+        if (band.firstRow != nextRow || band.rowCount <= 0 || band.width != DRRSize[0] || !band.mapped)
+        {
+          mismatches++;
+          return false;
+        }
+        for (int r = 0; r < band.rowCount; r++)
+        {
+          const short* source = expected.data() + static_cast<size_t>(DRRSize[1] - 1 - nextRow - r) * DRRSize[0];
+          for (int i = 0; i < DRRSize[0]; i++)
+          {
+            const int index = std::min(std::max(source[i] - low, 0), last);
+            const size_t k = static_cast<size_t>(r) * DRRSize[0] + i;
+            if (band.raw[k] != source[i] || band.mapped[k] != lut[index]) mismatches++;
+          }
+        }
+        nextRow += band.rowCount;
+        return true;
+      },
+      bandRows);
+
+  if (!completed || nextRow != DRRSize[1] || mismatches != 0 || generator.GetRawOutput() ||
+      generator.GetHistogram() != reference.GetHistogram())
+  {
+    std::printf("%d band rows: completed %d, %d of %d rows, %d mismatches\n", bandRows, completed, nextRow, DRRSize[1],
+                mismatches);
+    return false;
+  }
+
+  // sink返回false时立即停止
+  int bands = 0;
+  if (generator.UpdateStreaming([&bands](const DRROutputBand&) { return ++bands < 2; }, bandRows) || bands != 2)
+  {
+    std::printf("%d band rows: streaming did not stop after the sink returned false\n", bandRows);
+    return false;
+  }
+  return true;
+}
+
+// 按DRRIntensityTransform的文档计算区间[low, high]内的灰度
+unsigned char ExpectedGray(int value, int low, int high, DRRIntensityTransform transform)
+{
+  if (high <= low) return 0;
+  const int k = std::min(std::max(value - low, 0), high - low);
+  const double t = static_cast<double>(k) / (high - low);
+  switch (transform)
+  {
+    case DRRIntensityLog:
+      return static_cast<unsigned char>(255.0 * std::log1p(255.0 * t) / std::log(256.0));
+    case DRRIntensityExponential:
+      return static_cast<unsigned char>(std::pow(256.0, t) - 1.0);
+    default:
+      return static_cast<unsigned char>(255.0 * k / (high - low));
+  }
+}
+
+// 排序后第ceil(总数 * p%)个值(从1起), 即直方图累计数首次达到该比例的值
+int Percentile(std::vector<short> values, double percentile)
+{
+  std::sort(values.begin(), values.end());
+  const double rank = std::ceil(values.size() * 0.01 * percentile);
+  return values[static_cast<size_t>(std::min(std::max(rank - 1, 0.0), values.size() - 1.0))];
+}
+
+bool TestOutputWindow(vtkImageData* phantom, double spacing[3])
+{
+  DRRGenerator generator;
+  Setup(generator, phantom, spacing, Poses[3]);
+  generator.Update();
+  const std::vector<short> raw = RawOutput(generator);
+  const auto extremes = std::minmax_element(raw.begin(), raw.end());
+
+  struct WindowCase
+  {
+    const char* name;
+    DRROutputWindow window;
+    int low, high;  // 期望的区间
+  };
+  std::vector<WindowCase> cases;
+  DRROutputWindow window;
+  cases.push_back({"full range", window, *extremes.first, *extremes.second});
+  window.transform = DRRIntensityLog;
+  cases.push_back({"full range, log", window, *extremes.first, *extremes.second});
+  window.transform = DRRIntensityExponential;
+  cases.push_back({"full range, exponential", window, *extremes.first, *extremes.second});
+  window.transform = DRRIntensityLinear;
+  window.mode = DRRWindowPercentile;
+  window.percentiles[0] = 5;
+  window.percentiles[1] = 95;
+  cases.push_back({"percentile", window, Percentile(raw, 5), Percentile(raw, 95)});
+  window.mode = DRRWindowFixed;
+  window.level = 100.4;
+  window.width = 151;
+  cases.push_back({"fixed", window, 25, 176});
+  window.width = 0;
+  cases.push_back({"empty fixed", window, 100, 100});
+
+  bool passed = true;
+  for (const WindowCase& windowCase : cases)
+  {
+    generator.SetOutputWindow(windowCase.window);
+    vtkSmartPointer<vtkImageData> output = generator.GetOutput();
+    const unsigned char* gray = static_cast<const unsigned char*>(output->GetScalarPointer());
+    int mismatches = 0;
+    for (int j = 0; j < DRRSize[1]; j++)
+      for (int i = 0; i < DRRSize[0]; i++)
+      {
+        const int value = raw[i + (DRRSize[1] - 1 - j) * static_cast<size_t>(DRRSize[0])];
+        const DRRIntensityTransform transform = windowCase.window.transform;
+        if (gray[i + j * DRRSize[0]] != ExpectedGray(value, windowCase.low, windowCase.high, transform)) mismatches++;
+      }
+    if (mismatches != 0)
+    {
+      std::printf("%s window [%d, %d]: %d pixels differ\n", windowCase.name, windowCase.low, windowCase.high,
+                  mismatches);
+      passed = false;
+    }
+  }
+  return passed;
+}
+}  // namespace
+
+int DRRGeneratorOptionsTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const int dims[3]{64, 60, 56};
+  double spacing[3]{1.2, 1.3, 1.5};
+  vtkSmartPointer<vtkImageData> phantom = CreateAnatomyPhantom(dims);
+
+  bool passed = TestClipping(phantom, spacing);
+  passed = TestPermuted(phantom, spacing) && passed;
+  // 一个block和跨多个block的行带, 最后一个行带不满
+  passed = TestStreaming(phantom, spacing, Poses[3], 0) && passed;
+  passed = TestStreaming(phantom, spacing, Poses[4], 20) && passed;
+  passed = TestOutputWindow(phantom, spacing) && passed;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,48 @@
+#include "DRRTestingPhantoms.h"
+
+#include <cstdlib>
+
+// 参考场景的耗时预算: 渲染(Update)和灰度映射(GetOutput)的中位数分别超过预算时失败.
+// 预算(ms)由参数给出, 默认值来自CMake变量DRRGenerator_RENDER_BUDGET_MS/DRRGenerator_OUTPUT_BUDGET_MS.
+
+int DRRGeneratorPerformanceTest(int argc, char* argv[])
+{
+  const double renderBudget = argc > 1 ? std::atof(argv[1]) : 2000;
+  const double outputBudget = argc > 2 ? std::atof(argv[2]) : 200;
+
+  const int dims[3]{256, 256, 200};
+  double spacing[3]{0.8, 0.8, 1.25};
+  vtkSmartPointer<vtkImageData> phantom = CreateAnatomyPhantom(dims);
+  DRRGenerator generator;
+  generator.SetInputData(phantom, spacing);
+  generator.SetSize(512, 512, 1);
+  generator.SetSpacing(0.8, 0.8, 1.0);
+  generator.SetSourceToDetectorDistance(1000);
+  generator.SetThreshold(-300);
+  generator.SetAngle(0.3);
+  generator.Update();
+
+  int frame = 0;
+  const double renderTime = MedianTime(5,
+                                       [&]()
+                                       {
+                                         generator.SetAngle(0.3 + 0.1 * ++frame);
+                                         generator.Update();
+                                       });
+  const double outputTime = MedianTime(5, [&]() { generator.GetOutput(); });
+  std::printf("Render: %.1f ms (budget %.1f ms), GetOutput: %.1f ms (budget %.1f ms), %d threads\n", renderTime,
+              renderBudget, outputTime, outputBudget, generator.GetStatistics().threadCount);
+
+  bool passed = true;
+  if (renderTime > renderBudget)
+  {
+    std::printf("Render time is over budget\n");
+    passed = false;
+  }
+  if (outputTime > outputBudget)
+  {
+    std::printf("GetOutput time is over budget\n");
+    passed = false;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
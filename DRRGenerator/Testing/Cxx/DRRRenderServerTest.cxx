@@ -0,0 +1,145 @@
+#include "DRRRenderClient.h"
+#include "DRRRenderServer.h"
+#include "DRRTestingPhantoms.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+// 经Unix域套接字往返一次: Hello, 一批请求和回复, 共享内存中的帧与DRRGenerator::Update完全相同;
+// 无效的CT和slot编号被拒绝, 且不影响同一连接上之后的请求.
+
+namespace
+{
+const int DRRSize = 40;
+
+DRRRenderRequest CreateRequest(uint32_t id, uint32_t volume, uint32_t slot)
+{
+  DRRRenderRequest request;
+  std::memset(&request, 0, sizeof(request));
+  request.id = id;
+  request.volume = volume;
+  request.slot = slot;
+  request.angle = 0.3 * id;
+  request.rotation[2] = 0.05 * id;
+  request.translation[0] = 2.0 * id;
+  request.sourceToDetectorDistance = 700;
+  request.threshold = -300;
+  request.size[0] = DRRSize;
+  request.size[1] = DRRSize;
+  request.spacing[0] = 2.0;
+  request.spacing[1] = 2.0;
+  return request;
+}
+
+std::vector<short> Render(std::shared_ptr<const DRRVolume> volume, const DRRRenderRequest& request)
+{
+  DRRGenerator generator;
+  generator.SetVolume(volume);
+  generator.SetSourceToDetectorDistance(request.sourceToDetectorDistance);
+  generator.SetThreshold(request.threshold);
+  generator.SetSize(request.size[0], request.size[1], 1);
+  generator.SetSpacing(request.spacing[0], request.spacing[1], 1.0);
+  DRRPose pose;
+  pose.angle = request.angle;
+  std::copy(request.rotation, request.rotation + 3, pose.rotation);
+  std::copy(request.translation, request.translation + 3, pose.translation);
+  generator.SetPose(pose);
+  generator.Update();
+  return std::vector<short>(generator.GetRawOutput(), generator.GetRawOutput() + request.size[0] * request.size[1]);
+}
+
+// 发送requests后收齐回复, 按id检查状态, 成功的帧与单独渲染的结果比较
+bool RoundTrip(DRRRenderClient& client, std::shared_ptr<const DRRVolume> volume,
+               const std::vector<DRRRenderRequest>& requests, const std::vector<int32_t>& statuses)
+{
+  for (const DRRRenderRequest& request : requests)
+  {
+    if (!client.Send(request))
+    {
+      std::printf("cannot send request %u\n", request.id);
+      return false;
+    }
+  }
+  bool passed = true;
+  for (size_t n = 0; n < requests.size(); n++)
+  {
+    DRRRenderReply reply;
+    if (!client.Receive(reply))
+    {
+      std::printf("connection closed after %zu replies\n", n);
+      return false;
+    }
+    size_t index = 0;
+    while (index < requests.size() && requests[index].id != reply.id) index++;
+    if (index == requests.size() || reply.status != statuses[index])
+    {
+      std::printf("reply %u: status %d\n", reply.id, reply.status);
+      passed = false;
+      continue;
+    }
+    if (reply.status != DRRRenderProtocol::Ok) continue;
+    const std::vector<short> expected = Render(volume, requests[index]);
+    if (std::memcmp(client.GetFrame(reply.slot), expected.data(), expected.size() * sizeof(short)) != 0)
+    {
+      std::printf("frame of request %u differs from DRRGenerator::Update\n", reply.id);
+      passed = false;
+    }
+  }
+  return passed;
+}
+}  // namespace
+
+int DRRRenderServerTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const int dims[3]{48, 44, 40};
+  double spacing[3]{1.2, 1.3, 1.5};
+  vtkSmartPointer<vtkImageData> phantom = CreateAnatomyPhantom(dims);
+  std::shared_ptr<const DRRVolume> volume = DRRVolume::New(phantom, spacing);
+
+  DRRRenderServer server;
+  server.AddVolume(volume);
+  server.SetWorkerCount(2);
+  server.SetSlotCount(4);
+  server.SetSlotBytes(DRRSize * DRRSize * sizeof(short));
+  server.SetReportInterval(0);
+  const std::string socketPath = "/tmp/drr-server-test-" + std::to_string(static_cast<long>(getpid())) + ".sock";
+  if (!server.Listen(socketPath)) return EXIT_FAILURE;
+  std::thread serverThread(&DRRRenderServer::Run, &server);
+
+  bool passed = true;
+  {
+    DRRRenderClient client;
+    passed = client.Connect(socketPath);
+    if (passed)
+    {
+      const DRRServerHello& hello = client.GetHello();
+      passed = hello.volumeCount == 1 && hello.slotCount == 4 && hello.slotBytes >= DRRSize * DRRSize * sizeof(short);
+      if (!passed) std::printf("unexpected hello: %u volumes, %u slots\n", hello.volumeCount, hello.slotCount);
+
+      // 一批三个请求, 各用一个slot
+      passed = RoundTrip(client, volume, {CreateRequest(1, 0, 0), CreateRequest(2, 0, 1), CreateRequest(3, 0, 2)},
+                         {DRRRenderProtocol::Ok, DRRRenderProtocol::Ok, DRRRenderProtocol::Ok}) &&
+               passed;
+      // 无效的CT和slot被拒绝, 同一批中有效的请求照常完成
+      passed = RoundTrip(client, volume, {CreateRequest(4, 5, 0), CreateRequest(5, 0, 9), CreateRequest(6, 0, 3)},
+                         {DRRRenderProtocol::BadVolume, DRRRenderProtocol::BadSlot, DRRRenderProtocol::Ok}) &&
+               passed;
+    }
+  }
+
+  server.Stop();
+  serverThread.join();
+  const DRRRenderServer::Statistics statistics = server.TakeStatistics();
+  if (statistics.requestCount != 4 || statistics.errorCount != 2)
+  {
+    std::printf("server counted %llu requests and %llu errors\n",
+                static_cast<unsigned long long>(statistics.requestCount),
+                static_cast<unsigned long long>(statistics.errorCount));
+    passed = false;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+#include "DRRShardedRenderer.h"
+#include "DRRTestingPhantoms.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <signal.h>
+
+// 多进程分片渲染的每一帧都必须与单进程的DRRGenerator完全相同;
+// 渲染中途杀死一个worker后, 它占用的帧和未完成的pose都要被回收, 每个pose恰好交回一次.
+
+namespace
+{
+const int DRRSize = 48;
+
+std::vector<DRRPose> CreatePoses(size_t count)
+{
+  std::vector<DRRPose> poses(count);
+  for (size_t n = 0; n < count; n++)
+  {
+    poses[n].angle = 0.4 * n;
+    poses[n].rotation[0] = 0.02 * n;
+    poses[n].translation[2] = 1.5 * n - 6;
+  }
+  return poses;
+}
+
+// killAfter为第几帧交回后杀死第一个worker, 0表示不杀
+bool TestRender(vtkImageData* phantom, double spacing[3], int workerCount, int slotCount, int killAfter)
+{
+  const std::vector<DRRPose> poses = CreatePoses(12);
+  const size_t pixelCount = static_cast<size_t>(DRRSize) * DRRSize;
+  std::vector<std::vector<short>> expected(poses.size());
+  for (size_t n = 0; n < poses.size(); n++)
+  {
+    DRRGenerator generator;
+    generator.SetInputData(phantom, spacing);
+    generator.SetSize(DRRSize, DRRSize, 1);
+    generator.SetSpacing(2.0, 2.0, 1.0);
+    generator.SetThreshold(-300);
+    generator.SetSourceToDetectorDistance(800);
+    generator.SetPose(poses[n]);
+    generator.Update();
+    expected[n].assign(generator.GetRawOutput(), generator.GetRawOutput() + pixelCount);
+  }
+
+  DRRShardedRenderer renderer;
+  const int size[2]{DRRSize, DRRSize};
+  const double detectorSpacing[2]{2.0, 2.0};
+  if (!renderer.Publish(static_cast<const short*>(phantom->GetScalarPointer()), phantom->GetDimensions(), spacing))
+  {
+    std::printf("cannot publish the volume\n");
+    return false;
+  }
+  renderer.SetGeometry(800, -300, size, detectorSpacing);
+  renderer.SetWorkerCount(workerCount);
+  renderer.SetSlotCount(slotCount);
+  renderer.SetBatchSize(2);
+  renderer.SetMaxRetries(2);
+
+  std::vector<int> delivered(poses.size(), 0);
+  int frameCount = 0, mismatches = 0;
+  const bool completed = renderer.Render(
+      poses,
+      [&](size_t pose, const short* frame)
+      {
+        delivered[pose]++;
+        if (std::memcmp(frame, expected[pose].data(), pixelCount * sizeof(short)) != 0) mismatches++;
+        // 其他worker此时多半正在渲染或等待空闲帧
+        if (++frameCount == killAfter && !renderer.GetWorkers().empty()) kill(renderer.GetWorkers()[0], SIGKILL);
+      });
+
+  bool passed = completed && renderer.GetFailedPoses().empty() && mismatches == 0;
+  for (size_t n = 0; n < poses.size(); n++) passed = passed && delivered[n] == 1;
+  if (!passed)
+  {
+    std::printf("%d workers, %d slots, kill after %d frames: completed %d, %zu failed poses, %d mismatches\n",
+                workerCount, slotCount, killAfter, completed, renderer.GetFailedPoses().size(), mismatches);
+  }
+  return passed;
+}
+}  // namespace
+
+int DRRShardedRendererTest(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  const int dims[3]{48, 44, 40};
+  double spacing[3]{1.2, 1.3, 1.5};
+  vtkSmartPointer<vtkImageData> phantom = CreateAnatomyPhantom(dims);
+
+  bool passed = TestRender(phantom, spacing, 3, 0, 0);
+  // 只有一个帧时, 被杀死的worker占用的帧不回收会使其余worker永远等待
+  passed = TestRender(phantom, spacing, 2, 1, 1) && passed;
+  passed = TestRender(phantom, spacing, 3, 2, 3) && passed;
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "DRRGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <vtkImageData.h>
+#include <vtkSmartPointer.h>
+
+// 测试用的解析体模, 体数据的LPS坐标范围为[0, size * spacing], 体素i覆盖[i * spacing, (i + 1) * spacing]
+
+// 空气中以isocenter为中心, 边长为edge(mm, 需为spacing的整数倍)的均匀立方体
+inline vtkSmartPointer<vtkImageData> CreateCubePhantom(int size, double spacing, double edge, short value)
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetDimensions(size, size, size);
+  image->AllocateScalars(VTK_SHORT, 1);
+  short* voxels = static_cast<short*>(image->GetScalarPointer());
+  const int half = static_cast<int>(std::lround(edge / spacing / 2));
+  for (int k = 0; k < size; k++)
+    for (int j = 0; j < size; j++)
+      for (int i = 0; i < size; i++)
+      {
+        const bool inside = std::abs(2 * i + 1 - size) < 2 * half && std::abs(2 * j + 1 - size) < 2 * half &&
+                            std::abs(2 * k + 1 - size) < 2 * half;
+        voxels[i + size * (j + static_cast<size_t>(size) * k)] = inside ? value : -1000;
+      }
+  return image;
+}
+
+// 空气中以isocenter为中心, 半径为radius(mm)的均匀球, 体素中心在球内时取value
+inline vtkSmartPointer<vtkImageData> CreateSpherePhantom(int size, double spacing, double radius, short value)
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetDimensions(size, size, size);
+  image->AllocateScalars(VTK_SHORT, 1);
+  short* voxels = static_cast<short*>(image->GetScalarPointer());
+  const double center = size * spacing / 2;
+  for (int k = 0; k < size; k++)
+    for (int j = 0; j < size; j++)
+      for (int i = 0; i < size; i++)
+      {
+        const double x = (i + 0.5) * spacing - center, y = (j + 0.5) * spacing - center,
+                     z = (k + 0.5) * spacing - center;
+        const bool inside = x * x + y * y + z * z < radius * radius;
+        voxels[i + size * (j + static_cast<size_t>(size) * k)] = inside ? value : -1000;
+      }
+  return image;
+}
+
+// 非对称的"人体": 椭球形软组织, 偏心的骨块和一个小的高密度标记点, 各个pose的DRR互不相同.
+// 数值比真实的HU高一个数量级, 使short类型的DRR有足够的动态范围
+inline vtkSmartPointer<vtkImageData> CreateAnatomyPhantom(const int dims[3])
+{
+  vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+  image->SetDimensions(dims[0], dims[1], dims[2]);
+  image->AllocateScalars(VTK_SHORT, 1);
+  short* voxels = static_cast<short*>(image->GetScalarPointer());
+  for (int k = 0; k < dims[2]; k++)
+    for (int j = 0; j < dims[1]; j++)
+      for (int i = 0; i < dims[0]; i++)
+      {
+        const double x = (i - 0.5 * dims[0]) / (0.42 * dims[0]), y = (j - 0.5 * dims[1]) / (0.38 * dims[1]),
+                     z = (k - 0.5 * dims[2]) / (0.45 * dims[2]);
+        short value = -1000;
+        if (x * x + y * y + z * z < 1) value = static_cast<short>(400 + 200 * std::sin(0.3 * i + 0.2 * k));
+        if (std::abs(i - 0.62 * dims[0]) < 0.08 * dims[0] && std::abs(j - 0.45 * dims[1]) < 0.1 * dims[1] &&
+            std::abs(k - 0.45 * dims[2]) < 0.3 * dims[2])
+        {
+          value = 8000;
+        }
+        if (std::abs(i - 0.3 * dims[0]) < 2 && std::abs(j - 0.6 * dims[1]) < 2 && std::abs(k - 0.7 * dims[2]) < 2)
+        {
+          value = 20000;
+        }
+        voxels[i + dims[0] * (j + static_cast<size_t>(dims[1]) * k)] = value;
+      }
+  return image;
+}
+
+// 角度为弧度, 旋转为绕isocenter的角度, 平移为mm, 同DRRPose
+inline DRRPose CreatePose(double angle, double rx, double ry, double rz, double tx, double ty, double tz)
+{
+  DRRPose pose;
+  pose.angle = angle;
+  pose.rotation[0] = rx;
+  pose.rotation[1] = ry;
+  pose.rotation[2] = rz;
+  pose.translation[0] = tx;
+  pose.translation[1] = ty;
+  pose.translation[2] = tz;
+  return pose;
+}
+
+// 以上体模常用的成像几何: SDD为700mm, 阈值-300(空气之上, 软组织之下), width x height的探测器,
+// 像素间距pixelSpacing(mm); 位姿和其他选项由各测试设置
+inline void SetupGenerator(DRRGenerator& generator, vtkImageData* phantom, double spacing[3], int width, int height,
+                           double pixelSpacing)
+{
+  generator.SetInputData(phantom, spacing);
+  generator.SetSize(width, height, 1);
+  generator.SetSpacing(pixelSpacing, pixelSpacing, 1.0);
+  generator.SetSourceToDetectorDistance(700);
+  generator.SetThreshold(-300);
+}
+
+// 比较两个值, 超出容差时打印信息并返回false
+inline bool CheckNear(const char* what, double actual, double expected, double tolerance)
+{
+  if (std::abs(actual - expected) <= tolerance) return true;
+  std::printf("%s: got %g, expected %g (tolerance %g)\n", what, actual, expected, tolerance);
+  return false;
+}
+
+// 多次执行func, 返回耗时的中位数(ms)
+template <typename Function>
+double MedianTime(int repeats, const Function& func)
+{
+  std::vector<double> times;
+  for (int n = 0; n < repeats; n++)
+  {
+    auto begin = std::chrono::steady_clock::now();
+    func();
+    times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
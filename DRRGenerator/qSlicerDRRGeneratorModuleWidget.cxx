@@ -16,6 +16,7 @@
 ==============================================================================*/
 #include <vector>
 #include "DRRGenerator.h"
+#include "DRRTrace.h"
 // ctk includes
 #include <ctkCollapsibleButton.h>
 #include <ctkSliderWidget.h>
@@ -24,6 +25,7 @@
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
 #include <vtkNew.h>
+#include <vtkPoints.h>
 #include <vtkSlicerDRRGeneratorLogic.h>
 
 // MRML
@@ -38,12 +40,17 @@
 #include <vtkMRMLSliceCompositeNode.h>
 
 // Qt includes
+#include <QCheckBox>
 #include <QDebug>
+#include <QDoubleSpinBox>
+#include <QFileDialog>
 #include <QFormLayout>
+#include <QHBoxLayout>
 #include <QObject>
 #include <QPushButton>
 #include <QString>
 #include <QStringList>
+#include <QTimer>
 
 // Slicer includes
 #include <qMRMLNodeComboBox.h>
@@ -77,7 +84,14 @@ class qSlicerDRRGeneratorModuleWidgetPrivate
   ctkSliderWidget* sizeSlider;
   ctkSliderWidget* spacingSlider;
   ctkSliderWidget* opacitySlider;
+  QCheckBox* atlasCheckBox;
+  QTimer* settleTimer;  // 角度/位姿滑块停止拖动后再进行完整的渲染
   QPushButton* applyButton;
+  QDoubleSpinBox* cineFpsSpinBox;
+  QPushButton* cineButton;
+  QTimer* cineTimer;  // 定时把到了显示时刻的cine帧交给DRR节点
+  QCheckBox* traceCheckBox;
+  QPushButton* saveTraceButton;
   double drrNodeOrigin[3]{0., 0., 0.};
   double drrNodeSpacing[3]{1.0, 1.0, 1.0};
   int drrNodeSize[3]{256, 256, 1};
@@ -85,6 +99,7 @@ class qSlicerDRRGeneratorModuleWidgetPrivate
   qSlicerDRRGeneratorModuleWidgetPrivate(qSlicerDRRGeneratorModuleWidget& object);
   void onEnterConnection();
   void onExitConnection();
+  void readParameters(double rotation[3], double translation[3], int size[3], double spacing[3]) const;
   void setupUi(qSlicerWidget* qSlicerDRRGeneratorModuleWidget);
   vtkSlicerDRRGeneratorLogic* logic() const;
 
@@ -267,26 +282,64 @@ void qSlicerDRRGeneratorModuleWidgetPrivate::setupUi(qSlicerWidget* qSlicerDRRGe
   opacitySlider->setValue(0.5);
   drrFormLayout->addRow("DRR Opacity: ", opacitySlider);
 
+  atlasCheckBox = new QCheckBox;
+  atlasCheckBox->setChecked(false);
+  atlasCheckBox->setToolTip("Pre-render angles in the background and preview them while dragging the angle slider");
+  drrFormLayout->addRow("Angle Preview: ", atlasCheckBox);
+
+  settleTimer = new QTimer(qSlicerDRRGeneratorModuleWidget);
+  settleTimer->setSingleShot(true);
+  settleTimer->setInterval(150);
+
   applyButton = new QPushButton("Apply");
   drrFormLayout->addRow(applyButton);
+
+  cineFpsSpinBox = new QDoubleSpinBox;
+  cineFpsSpinBox->setRange(1, 60);
+  cineFpsSpinBox->setValue(15);
+  cineFpsSpinBox->setSuffix(" fps");
+  cineButton = new QPushButton("Play Rotation");
+  cineButton->setCheckable(true);
+  cineButton->setToolTip("Play a full gantry rotation from the current angle in 1° steps, "
+                         "dropping or lowering the resolution of frames that cannot keep up");
+  cineTimer = new QTimer(qSlicerDRRGeneratorModuleWidget);
+  QHBoxLayout* cineLayout = new QHBoxLayout;
+  cineLayout->addWidget(cineFpsSpinBox);
+  cineLayout->addWidget(cineButton, 1);
+  drrFormLayout->addRow("Cine: ", cineLayout);
+
+  traceCheckBox = new QCheckBox;
+  traceCheckBox->setChecked(false);
+  traceCheckBox->setToolTip("Record a timeline of the render stages and tiles of every thread");
+  saveTraceButton = new QPushButton("Save Trace");
+  saveTraceButton->setToolTip("Save the recorded timeline as Chrome trace JSON (chrome://tracing, Perfetto)");
+  QHBoxLayout* traceLayout = new QHBoxLayout;
+  traceLayout->addWidget(traceCheckBox);
+  traceLayout->addWidget(saveTraceButton, 1);
+  drrFormLayout->addRow("Trace: ", traceLayout);
 }
 
 void qSlicerDRRGeneratorModuleWidgetPrivate::onEnterConnection()
 {
   Q_Q(qSlicerDRRGeneratorModuleWidget);
   connects.push_back(QObject::connect(applyButton, SIGNAL(clicked(bool)), q, SLOT(onApplyDRR())));
-  connects.push_back(QObject::connect(angleSlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
-  connects.push_back(QObject::connect(rxSlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
-  connects.push_back(QObject::connect(rySlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
-  connects.push_back(QObject::connect(rzSlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
-  connects.push_back(QObject::connect(txSlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
-  connects.push_back(QObject::connect(tySlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
-  connects.push_back(QObject::connect(tzSlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
-  connects.push_back(QObject::connect(tzSlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
+  connects.push_back(QObject::connect(angleSlider, SIGNAL(valueChanged(double)), q, SLOT(onAngleChanged())));
+  connects.push_back(QObject::connect(settleTimer, SIGNAL(timeout()), q, SLOT(onApplyDRR())));
+  connects.push_back(QObject::connect(atlasCheckBox, SIGNAL(toggled(bool)), q, SLOT(onAtlasToggled(bool))));
+  connects.push_back(QObject::connect(rxSlider, SIGNAL(valueChanged(double)), q, SLOT(onPoseChanged())));
+  connects.push_back(QObject::connect(rySlider, SIGNAL(valueChanged(double)), q, SLOT(onPoseChanged())));
+  connects.push_back(QObject::connect(rzSlider, SIGNAL(valueChanged(double)), q, SLOT(onPoseChanged())));
+  connects.push_back(QObject::connect(txSlider, SIGNAL(valueChanged(double)), q, SLOT(onPoseChanged())));
+  connects.push_back(QObject::connect(tySlider, SIGNAL(valueChanged(double)), q, SLOT(onPoseChanged())));
+  connects.push_back(QObject::connect(tzSlider, SIGNAL(valueChanged(double)), q, SLOT(onPoseChanged())));
   connects.push_back(QObject::connect(thSlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
   connects.push_back(QObject::connect(scdSlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
   connects.push_back(QObject::connect(spacingSlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
   connects.push_back(QObject::connect(sizeSlider, SIGNAL(valueChanged(double)), q, SLOT(onApplyDRR())));
+  connects.push_back(QObject::connect(cineButton, SIGNAL(toggled(bool)), q, SLOT(onCineToggled(bool))));
+  connects.push_back(QObject::connect(cineTimer, SIGNAL(timeout()), q, SLOT(onCineTimeout())));
+  connects.push_back(QObject::connect(traceCheckBox, SIGNAL(toggled(bool)), q, SLOT(onTraceToggled(bool))));
+  connects.push_back(QObject::connect(saveTraceButton, SIGNAL(clicked(bool)), q, SLOT(onSaveTrace())));
   connects.push_back(QObject::connect(opacitySlider, SIGNAL(valueChanged(double)), q, SLOT(onOpacityChanged(double))));
   connects.push_back(
       QObject::connect(xraySelector, SIGNAL(currentNodeChanged(vtkMRMLNode*)), q, SLOT(onXRaySelected(vtkMRMLNode*))));
@@ -299,6 +352,28 @@ void qSlicerDRRGeneratorModuleWidgetPrivate::onExitConnection()
   connects.clear();
 }
 
+void qSlicerDRRGeneratorModuleWidgetPrivate::readParameters(double rotation[3], double translation[3], int size[3],
+                                                            double spacing[3]) const
+{
+  rotation[0] = rxSlider->value();
+  rotation[1] = rySlider->value();
+  rotation[2] = rzSlider->value();
+  translation[0] = txSlider->value();
+  translation[1] = tySlider->value();
+  translation[2] = tzSlider->value();
+  if (xraySelector->currentNode())
+  {
+    memcpy(size, drrNodeSize, 3 * sizeof(int));
+  }
+  else
+  {
+    size[0] = size[1] = (int)sizeSlider->value();
+    size[2] = 1;
+  }
+  spacing[0] = spacing[1] = spacingSlider->value();
+  spacing[2] = 1;
+}
+
 vtkSlicerDRRGeneratorLogic* qSlicerDRRGeneratorModuleWidgetPrivate::logic() const
 {
   Q_Q(const qSlicerDRRGeneratorModuleWidget);
@@ -328,30 +403,37 @@ void qSlicerDRRGeneratorModuleWidget::enter()
 void qSlicerDRRGeneratorModuleWidget::exit()
 {
   Q_D(qSlicerDRRGeneratorModuleWidget);
+  d->cineButton->setChecked(false);
   d->onExitConnection();
 }
 
 void qSlicerDRRGeneratorModuleWidget::onApplyDRR()
+{
+  this->applyDRR(false);
+}
+
+void qSlicerDRRGeneratorModuleWidget::onPoseChanged()
+{
+  Q_D(qSlicerDRRGeneratorModuleWidget);
+  // 拖动旋转/平移滑块时, 成像平面内的位姿变化由上一帧精确结果变换得到, 滑块停下后再完整渲染
+  this->applyDRR(true);
+  d->settleTimer->start();
+}
+
+void qSlicerDRRGeneratorModuleWidget::applyDRR(bool incremental)
 {
   Q_D(qSlicerDRRGeneratorModuleWidget);
+  DRRTrace::Scope trace("onApplyDRR", "gui");
   vtkMRMLScalarVolumeNode* volumeNode = vtkMRMLScalarVolumeNode::SafeDownCast(d->volumeSelector->currentNode());
   vtkMRMLScalarVolumeNode* drrNode = vtkMRMLScalarVolumeNode::SafeDownCast(d->drrSelector->currentNode());
-  double rotation[3] = {d->rxSlider->value(), d->rySlider->value(), d->rzSlider->value()};
-  double translation[3] = {d->txSlider->value(), d->tySlider->value(), d->tzSlider->value()};
-  double threshold = d->thSlider->value();
+  d->settleTimer->stop();
+  double rotation[3], translation[3], spacing[3];
   int size[3];
-  if (d->xraySelector->currentNode())
-  {
-    memcpy(size, d->drrNodeSize, 3 * sizeof(int));
-  }
-  else
-  {
-    size[0] = size[1] = (int)d->sizeSlider->value();
-    size[2] = 1;
-  }
-  double spacing[3] = {d->spacingSlider->value(), d->spacingSlider->value(), 1};
+  d->readParameters(rotation, translation, size, spacing);
+  double threshold = d->thSlider->value();
   double scd = d->scdSlider->value();
   double angle = d->angleSlider->value();
+  d->logic()->setIncremental(incremental);
   d->logic()->applyDRR(volumeNode, drrNode, angle, threshold, scd, rotation, translation, size, spacing);
   vtkNew<vtkMatrix4x4> IJKToRASDirectionMatrix;
   volumeNode->GetIJKToRASDirectionMatrix(IJKToRASDirectionMatrix);
@@ -378,6 +460,87 @@ void qSlicerDRRGeneratorModuleWidget::onApplyDRR()
   this->displayRegistrationPoint(ijkPoints);
 }
 
+void qSlicerDRRGeneratorModuleWidget::onAngleChanged()
+{
+  Q_D(qSlicerDRRGeneratorModuleWidget);
+  DRRTrace::Scope trace("onAngleChanged", "gui");
+  vtkMRMLScalarVolumeNode* volumeNode = vtkMRMLScalarVolumeNode::SafeDownCast(d->volumeSelector->currentNode());
+  vtkMRMLScalarVolumeNode* drrNode = vtkMRMLScalarVolumeNode::SafeDownCast(d->drrSelector->currentNode());
+  double rotation[3], translation[3], spacing[3];
+  int size[3];
+  d->readParameters(rotation, translation, size, spacing);
+  // 图集中有相邻的视图时先显示插值的预览, 滑块停下后再完整渲染
+  if (d->atlasCheckBox->isChecked() && d->logic()->previewDRR(volumeNode, drrNode, d->angleSlider->value(),
+                                                              d->thSlider->value(), d->scdSlider->value(),
+                                                              rotation, translation, size, spacing))
+  {
+    d->settleTimer->start();
+    return;
+  }
+  this->onApplyDRR();
+}
+
+void qSlicerDRRGeneratorModuleWidget::onCineToggled(bool enabled)
+{
+  Q_D(qSlicerDRRGeneratorModuleWidget);
+  vtkMRMLScalarVolumeNode* volumeNode = vtkMRMLScalarVolumeNode::SafeDownCast(d->volumeSelector->currentNode());
+  vtkMRMLScalarVolumeNode* drrNode = vtkMRMLScalarVolumeNode::SafeDownCast(d->drrSelector->currentNode());
+  d->cineTimer->stop();
+  d->logic()->stopCine();
+  if (!enabled) return;
+
+  double rotation[3], translation[3], spacing[3];
+  int size[3];
+  d->readParameters(rotation, translation, size, spacing);
+  std::vector<double> angles;
+  for (int step = 0; step < 360; step++) angles.push_back(d->angleSlider->value() + step);
+  const double fps = d->cineFpsSpinBox->value();
+  if (!volumeNode || !drrNode ||
+      !d->logic()->startCine(volumeNode, angles, fps, d->thSlider->value(), d->scdSlider->value(), rotation,
+                             translation, size, spacing))
+  {
+    d->cineButton->setChecked(false);
+    return;
+  }
+  vtkNew<vtkMatrix4x4> IJKToRASDirectionMatrix;
+  volumeNode->GetIJKToRASDirectionMatrix(IJKToRASDirectionMatrix);
+  drrNode->SetIJKToRASDirectionMatrix(IJKToRASDirectionMatrix);
+  drrNode->SetOrigin(d->drrNodeOrigin);
+  drrNode->SetSpacing(d->drrNodeSpacing);
+  auto compositeNode = d->logic()->getNodeByID<vtkMRMLSliceCompositeNode>("vtkMRMLSliceCompositeNodeRed");
+  compositeNode->SetForegroundVolumeID(drrNode->GetID());
+  compositeNode->SetForegroundOpacity(d->opacitySlider->value());
+  // 以两倍帧率检查, 帧的显示时刻误差不超过半个帧间隔
+  d->cineTimer->start(static_cast<int>(500 / fps));
+}
+
+void qSlicerDRRGeneratorModuleWidget::onCineTimeout()
+{
+  Q_D(qSlicerDRRGeneratorModuleWidget);
+  vtkMRMLScalarVolumeNode* drrNode = vtkMRMLScalarVolumeNode::SafeDownCast(d->drrSelector->currentNode());
+  if (!d->logic()->updateCine(drrNode)) d->cineButton->setChecked(false);
+}
+
+void qSlicerDRRGeneratorModuleWidget::onAtlasToggled(bool enabled)
+{
+  Q_D(qSlicerDRRGeneratorModuleWidget);
+  d->logic()->setAtlas(enabled);
+  if (enabled && d->volumeSelector->currentNode() && d->drrSelector->currentNode()) this->onApplyDRR();
+}
+
+void qSlicerDRRGeneratorModuleWidget::onTraceToggled(bool enabled)
+{
+  if (enabled) DRRTrace::SetThreadName("GUI");
+  DRRTrace::SetEnabled(enabled);
+}
+
+void qSlicerDRRGeneratorModuleWidget::onSaveTrace()
+{
+  QString fileName = QFileDialog::getSaveFileName(this, "Save Trace", "drr_trace.json", "Chrome Trace (*.json)");
+  if (fileName.isEmpty()) return;
+  if (!DRRTrace::Write(fileName.toStdString())) qWarning() << "Cannot save trace to" << fileName;
+}
+
 void qSlicerDRRGeneratorModuleWidget::onXRaySelected(vtkMRMLNode* node)
 {
   Q_D(qSlicerDRRGeneratorModuleWidget);
@@ -416,13 +579,22 @@ void qSlicerDRRGeneratorModuleWidget::displayRegistrationPoint(IJKVec& ijkPoints
   if (!drrNode) return;
   vtkNew<vtkMatrix4x4> IJKToRAS;
   drrNode->GetIJKToRASMatrix(IJKToRAS);
-  registNode->RemoveAllControlPoints();
+  vtkNew<vtkPoints> rasPoints;
+  rasPoints->SetNumberOfPoints(static_cast<vtkIdType>(ijkPoints.size()));
   double ijkPos[4]{0, 0, 0, 1}, rasPos[4]{0, 0, 0, 1};
   for (size_t i = 0; i < ijkPoints.size(); i++)
   {
     ijkPos[0] = ijkPoints[i][0];
     ijkPos[1] = ijkPoints[i][1];
     IJKToRAS->MultiplyPoint(ijkPos, rasPos);
-    registNode->AddControlPoint(rasPos, std::to_string(i + 1));
+    rasPoints->SetPoint(static_cast<vtkIdType>(i), rasPos);
+  }
+  // 一次性替换所有点, 整个过程只触发一次Modified
+  int wasModifying = registNode->StartModify();
+  registNode->SetControlPointPositionsWorld(rasPoints);
+  for (size_t i = 0; i < ijkPoints.size(); i++)
+  {
+    registNode->SetNthControlPointLabel(static_cast<int>(i), std::to_string(i + 1));
   }
+  registNode->EndModify(wasModifying);
 }
\ No newline at end of file
@@ -47,6 +47,13 @@ class Q_SLICER_QTMODULES_DRRGENERATOR_EXPORT qSlicerDRRGeneratorModuleWidget
 
  public slots:
   void onApplyDRR();
+  void onAngleChanged();
+  void onPoseChanged();
+  void onCineToggled(bool);
+  void onCineTimeout();
+  void onAtlasToggled(bool);
+  void onTraceToggled(bool);
+  void onSaveTrace();
   void onOpacityChanged(double);
   void onXRaySelected(vtkMRMLNode *);
 
@@ -55,6 +62,7 @@ class Q_SLICER_QTMODULES_DRRGENERATOR_EXPORT qSlicerDRRGeneratorModuleWidget
 
   void setup() override;
   void displayRegistrationPoint(IJKVec&);
+  void applyDRR(bool incremental);
 
  private:
   Q_DECLARE_PRIVATE(qSlicerDRRGeneratorModuleWidget);